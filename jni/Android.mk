@@ -13,7 +13,11 @@ include $(CLEAR_VARS)
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/include
 
 LOCAL_MODULE    := audio-jni
-LOCAL_SRC_FILES := audio-jni.cpp audio.cpp player.cpp util.cpp
+LOCAL_SRC_FILES := audio-jni.cpp audio.cpp player.cpp util.cpp cpu_time.cpp \
+	io.cpp http_cache.cpp probe_cache.cpp seek_index.cpp dsp.cpp mixer.cpp \
+	clip_bank.cpp time_stretch.cpp eq.cpp reverb.cpp dynamics.cpp gain.cpp \
+	loudness.cpp spectrum.cpp meter.cpp waveform.cpp \
+	export.cpp metadata.cpp
 
 # for native audio
 LOCAL_LDLIBS    += -lOpenSLES
@@ -28,4 +32,9 @@ LOCAL_SHARED_LIBRARIES += libstlport
 
 LOCAL_CFLAGS += -D__STDC_CONSTANT_MACROS=1
 
+# dsp.cpp has NEON kernels, armeabi builds use the scalar ones
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+LOCAL_ARM_NEON := true
+endif
+
 include $(BUILD_SHARED_LIBRARY)
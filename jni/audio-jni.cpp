@@ -14,38 +14,89 @@ static SLEngineItf engineEngine;
 
 // output mix interfaces
 static SLObjectItf outputMixObject = NULL;
-static SLEnvironmentalReverbItf outputMixEnvironmentalReverb = NULL;
 
 // buffer queue player interfaces
 static SLObjectItf bqPlayerObject = NULL;
 static SLPlayItf bqPlayerPlay;
 static SLAndroidSimpleBufferQueueItf bqPlayerBufferQueue;
-static SLEffectSendItf bqPlayerEffectSend;
-static SLVolumeItf bqPlayerVolume;
 static uint8_t decoded_audio_buf[AVCODEC_MAX_AUDIO_FRAME_SIZE];
 
-// this callback handler is called every time a buffer finishes playing
-void bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void *context) {
+// samples per channel of each enqueued buffer
+#define OUTPUT_BUFFER_FRAMES 1024
+
+// serializes the callback with fireOnPlayer() and flushPlayer()
+static pthread_mutex_t bqPlayerMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// serializes openOutput() and destroyPlayerAndEngine()
+static pthread_mutex_t outputMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// format the player was created with
+static int bqPlayerRate = 0;
+static int bqPlayerChannels = 0;
+
+// no buffer is in flight, so no callback will come until fireOnPlayer()
+static volatile bool bqPlayerIdle = true;
+
+// decodes and enqueues the next buffer, called with bqPlayerMutex held
+static void enqueueNextBuffer() {
 	SLresult result;
 
-	//LOGV2("bqPlayerCallback...");
+	bqPlayerIdle = true;
 
-	if (bq != bqPlayerBufferQueue) {
-		LOGV2("bqPlayerCallback : not the same player object.");
+	// S16 on the way out, whatever the tracks were decoded to
+	int decoded_size = player_read_audio((int16_t*) decoded_audio_buf,
+			OUTPUT_BUFFER_FRAMES) * global_context.audio_tgt.channels
+			* sizeof(int16_t);
+	if (decoded_size <= 0) {
+		// nothing queued yet, the read loop fires us again
 		return;
 	}
 
-	int decoded_size = audio_decode_frame(decoded_audio_buf,
-			sizeof(decoded_audio_buf));
-	if (decoded_size > 0) {
-		result = (*bqPlayerBufferQueue)->Enqueue(bqPlayerBufferQueue,
-				decoded_audio_buf, decoded_size);
-		// the most likely other result is SL_RESULT_BUFFER_INSUFFICIENT,
-		// which for this code example would indicate a programming error
-		if (SL_RESULT_SUCCESS != result) {
-			LOGV2("bqPlayerCallback : bqPlayerBufferQueue Enqueue failure.");
-		}
+	result = (*bqPlayerBufferQueue)->Enqueue(bqPlayerBufferQueue,
+			decoded_audio_buf, decoded_size);
+	// the most likely other result is SL_RESULT_BUFFER_INSUFFICIENT,
+	// which for this code example would indicate a programming error
+	if (SL_RESULT_SUCCESS != result) {
+		LOGV2("bqPlayerCallback : bqPlayerBufferQueue Enqueue failure.");
+		return;
+	}
+
+	bqPlayerIdle = false;
+
+	if (global_context.seek_start
+			&& global_context.audio_serial == global_context.seek_serial) {
+		// first buffer of the seek target
+		global_context.seek_latency_us = av_gettime_relative()
+				- global_context.seek_start;
+		global_context.seek_start = 0;
+		LOGV2("seek : first sample after %lld us",
+				(long long) global_context.seek_latency_us);
+	}
+
+	if (!global_context.startup.first_buffer_us) {
+		StartupTimes *startup = &global_context.startup;
+		startup->first_buffer_us = av_gettime_relative() - startup->begin;
+		LOGV2("startup : open %lld, probe %lld%s, codec %lld, output %lld, "
+				"first buffer %lld us", (long long) startup->open_us,
+				(long long) startup->probe_us,
+				startup->probe_cache_hit ? " (cached)" : "",
+				(long long) startup->codec_us,
+				(long long) startup->output_us,
+				(long long) startup->first_buffer_us);
+	}
+}
+
+// this callback handler is called every time a buffer finishes playing
+void bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void *context) {
+	//LOGV2("bqPlayerCallback...");
+
+	pthread_mutex_lock(&bqPlayerMutex);
+	if (bq == bqPlayerBufferQueue) {
+		enqueueNextBuffer();
+	} else {
+		LOGV2("bqPlayerCallback : not the same player object.");
 	}
+	pthread_mutex_unlock(&bqPlayerMutex);
 }
 
 int createEngine() {
@@ -80,11 +131,9 @@ int createEngine() {
 		return -1;
 	}
 
-	// create output mix, with environmental reverb specified as a non-required interface
-	const SLInterfaceID ids[1] = { SL_IID_ENVIRONMENTALREVERB };
-	const SLboolean req[1] = { SL_BOOLEAN_FALSE };
-	result = (*engineEngine)->CreateOutputMix(engineEngine, &outputMixObject, 1,
-			ids, req);
+	// create output mix; effects are rendered in software, see reverb.cpp
+	result = (*engineEngine)->CreateOutputMix(engineEngine, &outputMixObject, 0,
+			NULL, NULL);
 	if (SL_RESULT_SUCCESS != result) {
 		LOGV2("engineObject CreateOutputMix failure.");
 		(*engineObject)->Destroy(engineObject);
@@ -100,24 +149,6 @@ int createEngine() {
 
 		(*outputMixObject)->Destroy(outputMixObject);
 		outputMixObject = NULL;
-		outputMixEnvironmentalReverb = NULL;
-		(*engineObject)->Destroy(engineObject);
-		engineObject = NULL;
-		engineEngine = NULL;
-		return -1;
-	}
-
-	// get the environmental reverb interface
-	// this could fail if the environmental reverb effect is not available,
-	// either because the feature is not present, excessive CPU load, or
-	// the required MODIFY_AUDIO_SETTINGS permission was not requested and granted
-	result = (*outputMixObject)->GetInterface(outputMixObject,
-			SL_IID_ENVIRONMENTALREVERB, &outputMixEnvironmentalReverb);
-	if (SL_RESULT_SUCCESS != result) {
-		LOGV2("outputMixObject Realize failure.");
-		(*outputMixObject)->Destroy(outputMixObject);
-		outputMixObject = NULL;
-		outputMixEnvironmentalReverb = NULL;
 		(*engineObject)->Destroy(engineObject);
 		engineObject = NULL;
 		engineEngine = NULL;
@@ -136,14 +167,14 @@ int createBufferQueueAudioPlayer() {
 	SLDataLocator_AndroidSimpleBufferQueue loc_bufq = {
 			SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, 2 };
 
-	if (global_context.acodec_ctx->channels == 2)
+	if (global_context.audio_tgt.channels == 2)
 		channelMask = SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT;
 	else
 		channelMask = SL_SPEAKER_FRONT_CENTER;
 
 	SLDataFormat_PCM format_pcm = { SL_DATAFORMAT_PCM,
-			global_context.acodec_ctx->channels,
-			global_context.acodec_ctx->sample_rate * 1000,
+			(SLuint32) global_context.audio_tgt.channels,
+			(SLuint32) global_context.audio_tgt.freq * 1000,
 			SL_PCMSAMPLEFORMAT_FIXED_16, SL_PCMSAMPLEFORMAT_FIXED_16,
 			channelMask, SL_BYTEORDER_LITTLEENDIAN };
 
@@ -155,12 +186,11 @@ int createBufferQueueAudioPlayer() {
 	SLDataSink audioSnk = { &loc_outmix, NULL };
 
 	// create audio player
-	const SLInterfaceID ids[3] = { SL_IID_BUFFERQUEUE, SL_IID_EFFECTSEND,
-			SL_IID_VOLUME };
-	const SLboolean req[3] =
-			{ SL_BOOLEAN_TRUE, SL_BOOLEAN_TRUE, SL_BOOLEAN_TRUE };
+	// the volume is applied in software, see gain.cpp
+	const SLInterfaceID ids[1] = { SL_IID_BUFFERQUEUE };
+	const SLboolean req[1] = { SL_BOOLEAN_TRUE };
 	result = (*engineEngine)->CreateAudioPlayer(engineEngine, &bqPlayerObject,
-			&audioSrc, &audioSnk, 3, ids, req);
+			&audioSrc, &audioSnk, 1, ids, req);
 	if (SL_RESULT_SUCCESS != result) {
 		LOGV2("CreateAudioPlayer failure.");
 		return -1;
@@ -197,22 +227,6 @@ int createBufferQueueAudioPlayer() {
 		return -1;
 	}
 
-	// get the effect send interface
-	result = (*bqPlayerObject)->GetInterface(bqPlayerObject, SL_IID_EFFECTSEND,
-			&bqPlayerEffectSend);
-	if (SL_RESULT_SUCCESS != result) {
-		LOGV2("bqPlayerObject GetInterface SL_IID_EFFECTSEND failure.");
-		return -1;
-	}
-
-	// get the volume interface
-	result = (*bqPlayerObject)->GetInterface(bqPlayerObject, SL_IID_VOLUME,
-			&bqPlayerVolume);
-	if (SL_RESULT_SUCCESS != result) {
-		LOGV2("bqPlayerObject GetInterface SL_IID_VOLUME failure.");
-		return -1;
-	}
-
 	// set the player's state to playing
 	result = (*bqPlayerPlay)->SetPlayState(bqPlayerPlay, SL_PLAYSTATE_PLAYING );
 	if (SL_RESULT_SUCCESS != result) {
@@ -225,8 +239,29 @@ int createBufferQueueAudioPlayer() {
 	return 0;
 }
 
+// restarts the buffer queue chain when nothing is in flight
 void fireOnPlayer() {
-	bqPlayerCallback(bqPlayerBufferQueue, NULL);
+	pthread_mutex_lock(&bqPlayerMutex);
+	if (bqPlayerIdle && bqPlayerBufferQueue) {
+		enqueueNextBuffer();
+	}
+	pthread_mutex_unlock(&bqPlayerMutex);
+}
+
+bool isPlayerIdle() {
+	return bqPlayerIdle;
+}
+
+// drops the PCM already handed to OpenSL ES, e.g. after a seek
+void flushPlayer() {
+	pthread_mutex_lock(&bqPlayerMutex);
+
+	if (bqPlayerBufferQueue) {
+		(*bqPlayerBufferQueue)->Clear(bqPlayerBufferQueue);
+	}
+	bqPlayerIdle = true;
+
+	pthread_mutex_unlock(&bqPlayerMutex);
 }
 
 /**
@@ -241,15 +276,125 @@ static void DestroyObject(SLObjectItf& object) {
 	object = 0;
 }
 
+static void destroyPlayer() {
+	SLObjectItf player = bqPlayerObject;
+
+	// no callback enqueues anything from here on
+	pthread_mutex_lock(&bqPlayerMutex);
+	bqPlayerObject = NULL;
+	bqPlayerPlay = NULL;
+	bqPlayerBufferQueue = NULL;
+	bqPlayerIdle = true;
+	pthread_mutex_unlock(&bqPlayerMutex);
+
+	// waits for a running callback, so not under bqPlayerMutex
+	DestroyObject(player);
+}
+
+/**
+ * Creates the engine and the buffer queue player on first use and keeps
+ * them afterwards: every track and every mixer voice plays through this
+ * one player, which is only recreated when the output format changes.
+ */
+int openOutput() {
+	int ret = 0;
+
+	pthread_mutex_lock(&outputMutex);
+
+	if (!engineObject && createEngine() < 0) {
+		ret = -1;
+		goto end;
+	}
+
+	if (bqPlayerObject && (bqPlayerRate != global_context.audio_tgt.freq
+			|| bqPlayerChannels != global_context.audio_tgt.channels)) {
+		destroyPlayer();
+	}
+
+	if (!bqPlayerObject) {
+		if (createBufferQueueAudioPlayer() < 0) {
+			destroyPlayer();
+			ret = -1;
+			goto end;
+		}
+		bqPlayerRate = global_context.audio_tgt.freq;
+		bqPlayerChannels = global_context.audio_tgt.channels;
+	} else {
+		SLuint32 state = SL_PLAYSTATE_PLAYING;
+
+		// stopAudioPlayer() stopped it, restart the buffer chain too
+		(*bqPlayerPlay)->GetPlayState(bqPlayerPlay, &state);
+		if (SL_PLAYSTATE_PLAYING != state) {
+			flushPlayer();
+			(*bqPlayerPlay)->SetPlayState(bqPlayerPlay, SL_PLAYSTATE_PLAYING );
+		}
+	}
+
+	end:
+
+	pthread_mutex_unlock(&outputMutex);
+	return ret;
+}
+
 void destroyPlayerAndEngine() {
+	pthread_mutex_lock(&outputMutex);
+
 	// Destroy audio player object
-	DestroyObject(bqPlayerObject);
+	destroyPlayer();
 
 	// Destroy output mix object
 	DestroyObject(outputMixObject);
 
 	// Destroy the engine instance
 	DestroyObject(engineObject);
+	engineEngine = NULL;
+
+	pthread_mutex_unlock(&outputMutex);
+}
+
+static pthread_t media_thread;
+static bool media_thread_running = false;
+
+// direct ByteBuffer played by MEDIA_SOURCE_MEMORY, pinned while playing
+static jobject source_buffer = NULL;
+
+// the next start plays a single source
+static void clearPlaylist() {
+	av_freep(&global_context.playlist);
+	global_context.nb_playlist = 0;
+}
+
+static int startMediaThread() {
+	// cleared before the thread exists, so a stop racing its start holds
+	global_context.quit = 0;
+
+	if (pthread_create(&media_thread, NULL, open_media, NULL)) {
+		LOGV2("startMediaThread : pthread_create failure.");
+		return -1;
+	}
+
+	media_thread_running = true;
+	return 0;
+}
+
+// waits for open_media() to return, after which the source is unused
+static void joinMediaThread(JNIEnv *env) {
+	if (media_thread_running) {
+		global_context.quit = 1;
+		pthread_join(media_thread, NULL);
+		media_thread_running = false;
+	}
+
+	if (source_buffer) {
+		env->DeleteGlobalRef(source_buffer);
+		source_buffer = NULL;
+	}
+}
+
+jint JNI_OnLoad(JavaVM *vm, void *reserved) {
+	// FFmpeg registration runs while the app is still starting up
+	player_global_init_async();
+	return JNI_VERSION_1_4;
 }
 
 /*
@@ -257,12 +402,173 @@ void destroyPlayerAndEngine() {
  * Method:    startAudioPlayer
  * Signature: ()I
  */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_startAudioPlayer(
-		JNIEnv *, jclass) {
-	pthread_t thread;
-	pthread_create(&thread, NULL, open_media, NULL);
+		JNIEnv *env, jclass) {
+	joinMediaThread(env);
+	clearPlaylist();
+	memset(&global_context.source, 0, sizeof(MediaSource));
+	global_context.source.type = MEDIA_SOURCE_URL;
+	return startMediaThread();
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    startAudioPlayerFromUrl
+ * Signature: (Ljava/lang/String;)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_startAudioPlayerFromUrl(
+		JNIEnv *env, jclass, jstring url) {
+	const char *str;
+
+	joinMediaThread(env);
+	clearPlaylist();
+
+	str = env->GetStringUTFChars(url, NULL);
+	if (NULL == str) {
+		return -1;
+	}
+
+	memset(&global_context.source, 0, sizeof(MediaSource));
+	global_context.source.type = MEDIA_SOURCE_URL;
+	av_strlcpy(global_context.source.url, str,
+			sizeof(global_context.source.url));
+	env->ReleaseStringUTFChars(url, str);
+
+	return startMediaThread();
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    startAudioPlayerFromBuffer
+ * Signature: (Ljava/nio/ByteBuffer;)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_startAudioPlayerFromBuffer(
+		JNIEnv *env, jclass, jobject buffer) {
+	void *data = env->GetDirectBufferAddress(buffer);
+	jlong size = env->GetDirectBufferCapacity(buffer);
+
+	if (NULL == data || size <= 0) {
+		LOGV2("startAudioPlayerFromBuffer : not a direct ByteBuffer.");
+		return -1;
+	}
+
+	joinMediaThread(env);
+	clearPlaylist();
+
+	// keep the buffer reachable, its memory is read in place
+	source_buffer = env->NewGlobalRef(buffer);
+
+	memset(&global_context.source, 0, sizeof(MediaSource));
+	global_context.source.type = MEDIA_SOURCE_MEMORY;
+	global_context.source.data = (const uint8_t*) data;
+	global_context.source.size = size;
+	return startMediaThread();
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    startAudioPlayerFromFd
+ * Signature: (IJJ)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_startAudioPlayerFromFd(
+		JNIEnv *env, jclass, jint fd, jlong offset, jlong length) {
+	if (fd < 0 || offset < 0) {
+		return -1;
+	}
+
+	joinMediaThread(env);
+	clearPlaylist();
+
+	memset(&global_context.source, 0, sizeof(MediaSource));
+	global_context.source.type = MEDIA_SOURCE_FD;
+	global_context.source.fd = fd;
+	global_context.source.offset = offset;
+	global_context.source.length = length > 0 ? length : -1;
+	return startMediaThread();
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    startPlaylist
+ * Signature: ([Ljava/lang/String;)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_startPlaylist(
+		JNIEnv *env, jclass, jobjectArray urls) {
+	jsize i, count = env->GetArrayLength(urls);
+
+	if (count <= 0) {
+		return -1;
+	}
+
+	joinMediaThread(env);
+	clearPlaylist();
+
+	global_context.playlist = (MediaSource*) av_mallocz_array(count,
+			sizeof(MediaSource));
+	if (!global_context.playlist) {
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		jstring url = (jstring) env->GetObjectArrayElement(urls, i);
+		const char *str = url ? env->GetStringUTFChars(url, NULL) : NULL;
+
+		global_context.playlist[i].type = MEDIA_SOURCE_URL;
+		if (str) {
+			av_strlcpy(global_context.playlist[i].url, str,
+					sizeof(global_context.playlist[i].url));
+			env->ReleaseStringUTFChars(url, str);
+		}
+		if (url) {
+			env->DeleteLocalRef(url);
+		}
+	}
+
+	global_context.nb_playlist = count;
+	global_context.source = global_context.playlist[0];
+	return startMediaThread();
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setPreloadTime
+ * Signature: (I)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setPreloadTime(
+		JNIEnv *, jclass, jint seconds) {
+	// the next track is opened this close to the end of the current one
+	global_context.preload_us = (int64_t) seconds * AV_TIME_BASE;
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setCrossfade
+ * Signature: (I)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setCrossfade(
+		JNIEnv *, jclass, jint seconds) {
+	// 0 splices the tracks gaplessly
+	if (seconds != 0 && (seconds < 1 || seconds > 12)) {
+		return -1;
+	}
+
+	global_context.crossfade_us = (int64_t) seconds * AV_TIME_BASE;
 	return 0;
 }
 
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getCrossfadeHeadroom
+ * Signature: ()I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_getCrossfadeHeadroom(
+		JNIEnv *, jclass) {
+	// percent of the buffer time left over by the busiest crossfade buffer
+	return global_context.crossfade_headroom;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getTrackIndex
+ * Signature: ()I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_getTrackIndex(
+		JNIEnv *, jclass) {
+	return global_context.track_index;
+}
+
 /*
  * Class:     com_opensles_ffmpeg_MainActivity
  * Method:    destroyEngine
@@ -278,10 +584,860 @@ void destroyPlayerAndEngine() {
  * Method:    stopAudioPlayer
  * Signature: ()I
  */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_stopAudioPlayer(
-		JNIEnv *, jclass) {
-	(*bqPlayerPlay)->SetPlayState(bqPlayerPlay, SL_PLAYSTATE_STOPPED );
+		JNIEnv *env, jclass) {
+	if (bqPlayerPlay) {
+		(*bqPlayerPlay)->SetPlayState(bqPlayerPlay, SL_PLAYSTATE_STOPPED );
+	}
 	global_context.pause = 1;
 	global_context.quit = 1;
 	usleep(50000);
+	joinMediaThread(env);
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setReadAheadSize
+ * Signature: (I)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setReadAheadSize(
+		JNIEnv *, jclass, jint bytes) {
+	// takes effect on the next startAudioPlayer()
+	global_context.io_chunk_size = bytes;
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getIOWaitPerSecond
+ * Signature: ()I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_getIOWaitPerSecond(
+		JNIEnv *, jclass) {
+	// milliseconds the demuxer spent waiting for storage in the last second
+	return global_context.io_wait_ms;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setCacheDir
+ * Signature: (Ljava/lang/String;)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setCacheDir(
+		JNIEnv *env, jclass, jstring dir) {
+	const char *str = env->GetStringUTFChars(dir, NULL);
+
+	if (NULL == str) {
+		return -1;
+	}
+
+	mkdir(str, 0700);
+	av_strlcpy(global_context.cache_dir, str,
+			sizeof(global_context.cache_dir));
+	env->ReleaseStringUTFChars(dir, str);
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getHttpCacheStats
+ * Signature: ()[J
+ */JNIEXPORT jlongArray JNICALL Java_com_opensles_ffmpeg_MainActivity_getHttpCacheStats(
+		JNIEnv *env, jclass) {
+	// { bytes served from the cache (saved), bytes fetched from network }
+	jlong stats[2] = { global_context.cache_bytes_hit,
+			global_context.cache_bytes_miss };
+	jlongArray array = env->NewLongArray(2);
+
+	if (array) {
+		env->SetLongArrayRegion(array, 0, 2, stats);
+	}
+	return array;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setFastStart
+ * Signature: (Z)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setFastStart(
+		JNIEnv *, jclass, jboolean enable) {
+	global_context.fast_start = enable ? 1 : 0;
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getStartupTimes
+ * Signature: ()[J
+ */JNIEXPORT jlongArray JNICALL Java_com_opensles_ffmpeg_MainActivity_getStartupTimes(
+		JNIEnv *env, jclass) {
+	StartupTimes *startup = &global_context.startup;
+	jlong times[6] = { startup->open_us, startup->probe_us, startup->codec_us,
+			startup->output_us, startup->first_buffer_us,
+			startup->probe_cache_hit };
+	jlongArray array = env->NewLongArray(6);
+
+	if (array) {
+		env->SetLongArrayRegion(array, 0, 6, times);
+	}
+	return array;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    seekTo
+ * Signature: (J)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_seekTo(
+		JNIEnv *, jclass, jlong ms) {
+	request_seek(ms * 1000);
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    scrubBegin
+ * Signature: ()I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_scrubBegin(
+		JNIEnv *, jclass) {
+	scrub_begin();
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    scrubTo
+ * Signature: (J)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_scrubTo(
+		JNIEnv *, jclass, jlong ms) {
+	// a pending position is overwritten, only the latest one is decoded
+	request_seek(ms * 1000);
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    scrubEnd
+ * Signature: ()J
+ */JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_scrubEnd(
+		JNIEnv *, jclass) {
+	return scrub_end();
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getPosition
+ * Signature: ()J
+ */JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getPosition(
+		JNIEnv *, jclass) {
+	return global_context.audio_clock / 1000;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getSeekLatency
+ * Signature: ()J
+ */JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getSeekLatency(
+		JNIEnv *, jclass) {
+	// microseconds from the last seekTo() to its first enqueued buffer
+	return global_context.seek_latency_us;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    loadSound
+ * Signature: (Ljava/lang/String;)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_loadSound(
+		JNIEnv *env, jclass, jstring url) {
+	const char *str = env->GetStringUTFChars(url, NULL);
+	int id;
+
+	if (NULL == str) {
+		return -1;
+	}
+
+	// decoded whole on the calling thread unless already in the bank
+	id = clip_bank_load(str);
+	env->ReleaseStringUTFChars(url, str);
+	return id;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    unloadSound
+ * Signature: (I)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_unloadSound(
+		JNIEnv *, jclass, jint id) {
+	mixer_unload(id);
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    playSound
+ * Signature: (IFFJ)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_playSound(
+		JNIEnv *, jclass, jint id, jfloat gain, jfloat pan, jlong startFrame) {
+	int handle = mixer_play(id, gain, pan, startFrame);
+
+	if (handle < 0) {
+		return -1;
+	}
+
+	// the voice plays through the track output, start it if nothing else did
+	if (openOutput() < 0) {
+		mixer_stop(handle);
+		return -1;
+	}
+	if (isPlayerIdle()) {
+		fireOnPlayer();
+	}
+	return handle;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setVoice
+ * Signature: (IFF)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setVoice(
+		JNIEnv *, jclass, jint handle, jfloat gain, jfloat pan) {
+	mixer_set_voice(handle, gain, pan);
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    stopVoice
+ * Signature: (I)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_stopVoice(
+		JNIEnv *, jclass, jint handle) {
+	mixer_stop(handle);
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getMixerTime
+ * Signature: ()J
+ */JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getMixerTime(
+		JNIEnv *, jclass) {
+	// output frames mixed so far, the clock of playSound() start frames
+	return mixer_get_time();
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getMixerLoad
+ * Signature: ()I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_getMixerLoad(
+		JNIEnv *, jclass) {
+	// percent of the output time the voices took to mix in the last second
+	return global_context.mixer_load;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setClipBankBudget
+ * Signature: (I)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setClipBankBudget(
+		JNIEnv *, jclass, jint bytes) {
+	// idle sounds are evicted at once if the bank is over the new budget
+	clip_bank_set_budget(bytes);
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getClipBankStats
+ * Signature: ()[J
+ */JNIEXPORT jlongArray JNICALL Java_com_opensles_ffmpeg_MainActivity_getClipBankStats(
+		JNIEnv *env, jclass) {
+	// { hits, misses (decodes), bytes of PCM held, budget }
+	jlong stats[4];
+	int64_t values[4];
+	jlongArray array = env->NewLongArray(4);
+	int i;
+
+	clip_bank_get_stats(values);
+	for (i = 0; i < 4; i++) {
+		stats[i] = values[i];
+	}
+
+	if (array) {
+		env->SetLongArrayRegion(array, 0, 4, stats);
+	}
+	return array;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setSpeed
+ * Signature: (F)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setSpeed(
+		JNIEnv *, jclass, jfloat speed) {
+	// applied from the next output buffer, the pitch is kept
+	if (speed < 0.5f || speed > 3.0f) {
+		return -1;
+	}
+
+	global_context.speed = speed;
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getTimeStretchCpu
+ * Signature: ()J
+ */JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getTimeStretchCpu(
+		JNIEnv *, jclass) {
+	// microseconds of CPU the stretch took per second of output
+	return global_context.stretch_cpu_us;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setEqBand
+ * Signature: (IFFF)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setEqBand(
+		JNIEnv *, jclass, jint band, jfloat freq, jfloat gainDb, jfloat q) {
+	// picked up by the output callback at its next buffer, without a lock
+	return eq_set_band(band, freq, gainDb, q);
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getEqResponse
+ * Signature: (F)F
+ */JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getEqResponse(
+		JNIEnv *, jclass, jfloat freq) {
+	return eq_response_db(freq);
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getEqBandCpu
+ * Signature: ()J
+ */JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getEqBandCpu(
+		JNIEnv *, jclass) {
+	// microseconds of CPU one band took per second of output
+	return global_context.eq_band_cpu_us;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    loadReverb
+ * Signature: (Ljava/lang/String;)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_loadReverb(
+		JNIEnv *env, jclass, jstring url) {
+	const char *str = env->GetStringUTFChars(url, NULL);
+	int ret;
+
+	if (NULL == str) {
+		return -1;
+	}
+
+	// an impulse response file, decoded on the calling thread
+	ret = reverb_load(str);
+	env->ReleaseStringUTFChars(url, str);
+	return ret;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    unloadReverb
+ * Signature: ()I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_unloadReverb(
+		JNIEnv *, jclass) {
+	reverb_unload();
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setReverbLevel
+ * Signature: (F)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setReverbLevel(
+		JNIEnv *, jclass, jfloat level) {
+	// gain of the wet signal added to the dry one
+	if (level < 0 || level > 1) {
+		return -1;
+	}
+
+	reverb_set_gain(level);
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getReverbLoad
+ * Signature: ()I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_getReverbLoad(
+		JNIEnv *, jclass) {
+	// percent of the output time the convolution took in the last second
+	return global_context.reverb_load;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setCompressor
+ * Signature: (ZZFFFFF)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setCompressor(
+		JNIEnv *, jclass, jboolean enabled, jboolean rms,
+		jfloat thresholdDb, jfloat ratio, jfloat attackMs, jfloat releaseMs,
+		jfloat makeupDb) {
+	return dynamics_set_compressor(enabled, rms, thresholdDb, ratio, attackMs,
+			releaseMs, makeupDb);
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setLimiter
+ * Signature: (ZFF)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setLimiter(
+		JNIEnv *, jclass, jboolean enabled, jfloat ceilingDb,
+		jfloat lookaheadMs) {
+	// the look-ahead delays the whole output
+	return dynamics_set_limiter(enabled, ceilingDb, lookaheadMs);
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getGainReduction
+ * Signature: ()F
+ */JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getGainReduction(
+		JNIEnv *, jclass) {
+	// dB below the makeup gain, of the last block
+	return global_context.gain_reduction_db;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getDynamicsBlockCost
+ * Signature: ()J
+ */JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getDynamicsBlockCost(
+		JNIEnv *, jclass) {
+	// nanoseconds of CPU per 32 frame block, averaged over a second
+	return global_context.dynamics_block_ns;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setVolume
+ * Signature: (F)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setVolume(
+		JNIEnv *, jclass, jfloat volume) {
+	if (volume < 0 || volume > 1) {
+		return -1;
+	}
+
+	// ramped in over at most 20 ms
+	gain_set_volume(volume);
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setReplayGainMode
+ * Signature: (I)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setReplayGainMode(
+		JNIEnv *, jclass, jint mode) {
+	if (mode < REPLAY_GAIN_OFF || mode > REPLAY_GAIN_ALBUM) {
+		return -1;
+	}
+
+	gain_set_replay_gain_mode(mode);
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    scanLoudness
+ * Signature: ([Ljava/lang/String;[I)[F
+ */JNIEXPORT jfloatArray JNICALL Java_com_opensles_ffmpeg_MainActivity_scanLoudness(
+		JNIEnv *env, jclass, jobjectArray paths, jintArray albums) {
+	// blocks until the whole list is measured, call it off the UI thread
+	jsize i, count = env->GetArrayLength(paths);
+	const char **strs;
+	LoudnessResult *results;
+	jint *album_ids = NULL;
+	jfloatArray array = NULL;
+	char cache_path[1024];
+
+	if (count <= 0) {
+		return NULL;
+	}
+
+	strs = (const char**) av_mallocz_array(count, sizeof(char*));
+	results = (LoudnessResult*) av_malloc_array(count, sizeof(LoudnessResult));
+	if (!strs || !results) {
+		goto end;
+	}
+
+	for (i = 0; i < count; i++) {
+		jstring path = (jstring) env->GetObjectArrayElement(paths, i);
+		const char *str = path ? env->GetStringUTFChars(path, NULL) : NULL;
+
+		strs[i] = av_strdup(str ? str : "");
+		if (str) {
+			env->ReleaseStringUTFChars(path, str);
+		}
+		if (path) {
+			env->DeleteLocalRef(path);
+		}
+		if (!strs[i]) {
+			goto end;
+		}
+	}
+
+	if (albums && env->GetArrayLength(albums) == count) {
+		album_ids = env->GetIntArrayElements(albums, NULL);
+	}
+
+	snprintf(cache_path, sizeof(cache_path), "%s/loudness.cache",
+			global_context.cache_dir);
+	loudness_scan(strs, (const int*) album_ids, count,
+			global_context.cache_dir[0] ? cache_path : NULL, results);
+
+	if (album_ids) {
+		env->ReleaseIntArrayElements(albums, album_ids, JNI_ABORT);
+	}
+
+	array = env->NewFloatArray(count * 6);
+	if (array) {
+		env->SetFloatArrayRegion(array, 0, count * 6, (const jfloat*) results);
+	}
+
+	end:
+
+	for (i = 0; strs && i < count; i++) {
+		av_free((void*) strs[i]);
+	}
+	av_free(strs);
+	av_free(results);
+	return array;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getLoudnessScanRate
+ * Signature: ()F
+ */JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getLoudnessScanRate(
+		JNIEnv *, jclass) {
+	// files per second per worker thread of the last scan
+	return global_context.loudness_files_per_core;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setSpectrum
+ * Signature: (IIF)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setSpectrum(
+		JNIEnv *, jclass, jint fftSize, jint bins,
+		jfloat rate) {
+	return spectrum_configure(fftSize, bins, rate);
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getSpectrumBuffer
+ * Signature: ()Ljava/nio/ByteBuffer;
+ */JNIEXPORT jobject JNICALL Java_com_opensles_ffmpeg_MainActivity_getSpectrumBuffer(
+		JNIEnv *env, jclass) {
+	// the same memory for the whole process, the analysis writes into it
+	int size;
+	uint8_t *buf = spectrum_get_buffer(&size);
+
+	return buf ? env->NewDirectByteBuffer(buf, size) : NULL;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getSpectrumCpu
+ * Signature: ()J
+ */JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getSpectrumCpu(
+		JNIEnv *, jclass) {
+	// microseconds of CPU the analysis took in the last second
+	return global_context.spectrum_cpu_us;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getMeter
+ * Signature: ()[F
+ */JNIEXPORT jfloatArray JNICALL Java_com_opensles_ffmpeg_MainActivity_getMeter(
+		JNIEnv *env, jclass) {
+	MeterSnapshot s;
+	jfloatArray array = env->NewFloatArray(6);
+	jfloat values[6];
+
+	meter_get_snapshot(&s);
+	values[0] = s.peak_db[0];
+	values[1] = s.peak_db[1];
+	values[2] = s.rms_db[0];
+	values[3] = s.rms_db[1];
+	values[4] = s.momentary_lufs;
+	values[5] = s.short_term_lufs;
+
+	if (array) {
+		env->SetFloatArrayRegion(array, 0, 6, values);
+	}
+	return array;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getMeterCpu
+ * Signature: ()J
+ */JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getMeterCpu(
+		JNIEnv *, jclass) {
+	// microseconds of CPU the meter took per second of output
+	return global_context.meter_cpu_us;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getWaveform
+ * Signature: (Ljava/lang/String;I)[F
+ */JNIEXPORT jfloatArray JNICALL Java_com_opensles_ffmpeg_MainActivity_getWaveform(
+		JNIEnv *env, jclass, jstring url, jint buckets) {
+	// blocks while the file is decoded, call it off the UI thread
+	const char *str = env->GetStringUTFChars(url, NULL);
+	jfloatArray array = NULL;
+	float *out;
+
+	if (NULL == str) {
+		return NULL;
+	}
+
+	out = (float*) av_malloc_array(FFMAX(buckets, 1), 3 * sizeof(float));
+	if (out && !waveform_compute(str, buckets, out)) {
+		array = env->NewFloatArray(buckets * 3);
+		if (array) {
+			env->SetFloatArrayRegion(array, 0, buckets * 3, out);
+		}
+	}
+
+	av_free(out);
+	env->ReleaseStringUTFChars(url, str);
+	return array;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getWaveformSpeed
+ * Signature: ()F
+ */JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getWaveformSpeed(
+		JNIEnv *, jclass) {
+	// seconds the last uncached overview took per hour of audio
+	return global_context.waveform_s_per_hour;
+}
+
+// flags of exportPcm(), see MainActivity
+#define EXPORT_FLAG_WAV 1
+#define EXPORT_FLAG_FLOAT 2
+
+static bool export_params(ExportParams *params, jlong start_ms, jlong end_ms,
+		jint flags) {
+	if (start_ms < 0 || end_ms < 0 || (end_ms && end_ms <= start_ms)) {
+		return false;
+	}
+
+	params->container = flags & EXPORT_FLAG_WAV ? EXPORT_WAV : EXPORT_RAW;
+	params->fmt = flags & EXPORT_FLAG_FLOAT ?
+			AV_SAMPLE_FMT_FLT : AV_SAMPLE_FMT_S16;
+	params->start = start_ms * 1000;
+	params->end = end_ms * 1000;
+	return true;
+}
+
+typedef struct JavaPcmSink {
+	JNIEnv *env;
+	jobject sink;
+	jmethodID write;
+} JavaPcmSink;
+
+// hands a batch to PcmSink.write() in a direct buffer over the PCM
+static int java_sink_write(void *opaque, const uint8_t *buf, int size) {
+	JavaPcmSink *s = (JavaPcmSink*) opaque;
+	JNIEnv *env = s->env;
+	jobject buffer;
+	jint ret;
+
+	buffer = env->NewDirectByteBuffer((void*) buf, size);
+	if (NULL == buffer) {
+		return -1;
+	}
+
+	ret = env->CallIntMethod(s->sink, s->write, buffer, size);
+	env->DeleteLocalRef(buffer);
+
+	return env->ExceptionCheck() ? -1 : ret;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    exportPcm
+ * Signature: (Ljava/lang/String;IJJI)J
+ */JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_exportPcm(
+		JNIEnv *env, jclass, jstring url, jint fd, jlong start_ms, jlong end_ms,
+		jint flags) {
+	// blocks while the range is decoded, call it off the UI thread
+	const char *str;
+	ExportParams params;
+	int64_t frames;
+
+	if (fd < 0 || !export_params(&params, start_ms, end_ms, flags)) {
+		return -1;
+	}
+
+	str = env->GetStringUTFChars(url, NULL);
+	if (NULL == str) {
+		return -1;
+	}
+
+	frames = pcm_export_fd(str, &params, fd);
+
+	env->ReleaseStringUTFChars(url, str);
+	return frames;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    exportPcmToSink
+ * Signature: (Ljava/lang/String;JJILcom/opensles/ffmpeg/MainActivity$PcmSink;)J
+ */JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_exportPcmToSink(
+		JNIEnv *env, jclass, jstring url, jlong start_ms, jlong end_ms, jint flags,
+		jobject sink) {
+	const char *str;
+	ExportParams params;
+	JavaPcmSink java_sink;
+	jclass cls;
+	int64_t frames;
+
+	if (NULL == sink || !export_params(&params, start_ms, end_ms, flags)) {
+		return -1;
+	}
+
+	cls = env->GetObjectClass(sink);
+	java_sink.env = env;
+	java_sink.sink = sink;
+	java_sink.write = env->GetMethodID(cls, "write",
+			"(Ljava/nio/ByteBuffer;I)I");
+	env->DeleteLocalRef(cls);
+	if (NULL == java_sink.write) {
+		return -1;
+	}
+
+	str = env->GetStringUTFChars(url, NULL);
+	if (NULL == str) {
+		return -1;
+	}
+
+	frames = pcm_export(str, &params, java_sink_write, &java_sink);
+
+	env->ReleaseStringUTFChars(url, str);
+	return frames;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getExportSpeed
+ * Signature: ()F
+ */JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getExportSpeed(
+		JNIEnv *, jclass) {
+	// audio duration over wall time of the last export
+	return global_context.export_speed;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    scanMetadata
+ * Signature: ([Ljava/lang/String;Ljava/lang/String;)I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_scanMetadata(
+		JNIEnv *env, jclass, jobjectArray paths, jstring table_path) {
+	// blocks until every header is read, call it off the UI thread
+	jsize i, count = env->GetArrayLength(paths);
+	const char **strs;
+	const char *table;
+	int ret = -1;
+
+	if (count <= 0) {
+		return -1;
+	}
+
+	table = env->GetStringUTFChars(table_path, NULL);
+	if (NULL == table) {
+		return -1;
+	}
+
+	strs = (const char**) av_mallocz_array(count, sizeof(char*));
+	if (!strs) {
+		goto end;
+	}
+
+	for (i = 0; i < count; i++) {
+		jstring path = (jstring) env->GetObjectArrayElement(paths, i);
+		const char *str = path ? env->GetStringUTFChars(path, NULL) : NULL;
+
+		strs[i] = av_strdup(str ? str : "");
+		if (str) {
+			env->ReleaseStringUTFChars(path, str);
+		}
+		if (path) {
+			env->DeleteLocalRef(path);
+		}
+		if (!strs[i]) {
+			goto end;
+		}
+	}
+
+	ret = metadata_scan(strs, count, table);
+
+	end:
+
+	for (i = 0; strs && i < count; i++) {
+		av_free((void*) strs[i]);
+	}
+	av_free(strs);
+	env->ReleaseStringUTFChars(table_path, table);
+	return ret;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getMetadataScanRate
+ * Signature: ()F
+ */JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getMetadataScanRate(
+		JNIEnv *, jclass) {
+	// files per second of the last metadata scan
+	return global_context.metadata_files_per_sec;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    cancelLoudnessScan
+ * Signature: ()I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_cancelLoudnessScan(
+		JNIEnv *, jclass) {
+	// the running scanLoudness() returns with NaN for what it had left
+	loudness_scan_cancel();
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    cancelWaveform
+ * Signature: ()I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_cancelWaveform(
+		JNIEnv *, jclass) {
+	// the running getWaveform() calls return null
+	waveform_cancel();
+	return 0;
+}
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    cancelMetadataScan
+ * Signature: ()I
+ */JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_cancelMetadataScan(
+		JNIEnv *, jclass) {
+	// the running scanMetadata() returns -1 and keeps the old table
+	metadata_scan_cancel();
 	return 0;
 }
@@ -2,12 +2,9 @@
 
 #define DECODE_AUDIO_BUFFER_SIZE ((AVCODEC_MAX_AUDIO_FRAME_SIZE * 3) )
 
-static AVFilterContext *in_audio_filter;  // the first filter in the audio chain
-static AVFilterContext *out_audio_filter;  // the last filter in the audio chain
-static AVFilterGraph *agraph;              // audio filter graph
-static struct AudioParams audio_filter_src;
-
-static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
+// converts frames described by audio_filter_src to the output format tgt
+static int init_filter_graph(const AudioParams *audio_filter_src,
+		const AudioParams *tgt, AVFilterGraph **graph, AVFilterContext **src,
 		AVFilterContext **sink) {
 	AVFilterGraph *filter_graph;
 	AVFilterContext *abuffer_ctx;
@@ -34,6 +31,7 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 	abuffer = avfilter_get_by_name("abuffer");
 	if (!abuffer) {
 		av_log(NULL, AV_LOG_ERROR, "Could not find the abuffer filter.\n");
+		avfilter_graph_free(&filter_graph);
 		return AVERROR_FILTER_NOT_FOUND ;
 	}
 
@@ -41,21 +39,22 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 	if (!abuffer_ctx) {
 		av_log(NULL, AV_LOG_ERROR,
 				"Could not allocate the abuffer instance.\n");
+		avfilter_graph_free(&filter_graph);
 		return AVERROR(ENOMEM);
 	}
 
 	/* Set the filter options through the AVOptions API. */
 	av_get_channel_layout_string(ch_layout, sizeof(ch_layout), (int) 0,
-			audio_filter_src.channel_layout);
+			audio_filter_src->channel_layout);
 	av_opt_set(abuffer_ctx, "channel_layout", ch_layout,
 			AV_OPT_SEARCH_CHILDREN);
 	av_opt_set(abuffer_ctx, "sample_fmt",
-			av_get_sample_fmt_name(audio_filter_src.fmt),
+			av_get_sample_fmt_name(audio_filter_src->fmt),
 			AV_OPT_SEARCH_CHILDREN);
 	av_opt_set_q(abuffer_ctx, "time_base",
-			(AVRational ) { 1, audio_filter_src.freq },
+			(AVRational ) { 1, audio_filter_src->freq },
 			AV_OPT_SEARCH_CHILDREN);
-	av_opt_set_int(abuffer_ctx, "sample_rate", audio_filter_src.freq,
+	av_opt_set_int(abuffer_ctx, "sample_rate", audio_filter_src->freq,
 			AV_OPT_SEARCH_CHILDREN);
 
 	/* Now initialize the filter; we pass NULL options, since we have already
@@ -64,6 +63,7 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 	if (err < 0) {
 		av_log(NULL, AV_LOG_ERROR,
 				"Could not initialize the abuffer filter.\n");
+		avfilter_graph_free(&filter_graph);
 		return err;
 	}
 
@@ -72,6 +72,7 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 	aformat = avfilter_get_by_name("aformat");
 	if (!aformat) {
 		av_log(NULL, AV_LOG_ERROR, "Could not find the aformat filter.\n");
+		avfilter_graph_free(&filter_graph);
 		return AVERROR_FILTER_NOT_FOUND ;
 	}
 
@@ -79,6 +80,7 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 	if (!aformat_ctx) {
 		av_log(NULL, AV_LOG_ERROR,
 				"Could not allocate the aformat instance.\n");
+		avfilter_graph_free(&filter_graph);
 		return AVERROR(ENOMEM);
 	}
 
@@ -86,12 +88,12 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 	 * key1=value1:key2=value2.... */
 	snprintf(options_str, sizeof(options_str),
 			"sample_fmts=%s:sample_rates=%d:channel_layouts=0x%x",
-			av_get_sample_fmt_name(AV_SAMPLE_FMT_S16), audio_filter_src.freq,
-			audio_filter_src.channel_layout);
+			av_get_sample_fmt_name(tgt->fmt), tgt->freq, tgt->channel_layout);
 	err = avfilter_init_str(aformat_ctx, options_str);
 	if (err < 0) {
 		av_log(NULL, AV_LOG_ERROR,
 				"Could not initialize the aformat filter.\n");
+		avfilter_graph_free(&filter_graph);
 		return err;
 	}
 
@@ -100,6 +102,7 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 	abuffersink = avfilter_get_by_name("abuffersink");
 	if (!abuffersink) {
 		av_log(NULL, AV_LOG_ERROR, "Could not find the abuffersink filter.\n");
+		avfilter_graph_free(&filter_graph);
 		return AVERROR_FILTER_NOT_FOUND ;
 	}
 
@@ -108,6 +111,7 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 	if (!abuffersink_ctx) {
 		av_log(NULL, AV_LOG_ERROR,
 				"Could not allocate the abuffersink instance.\n");
+		avfilter_graph_free(&filter_graph);
 		return AVERROR(ENOMEM);
 	}
 
@@ -116,6 +120,7 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 	if (err < 0) {
 		av_log(NULL, AV_LOG_ERROR,
 				"Could not initialize the abuffersink instance.\n");
+		avfilter_graph_free(&filter_graph);
 		return err;
 	}
 
@@ -128,6 +133,7 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 
 	if (err < 0) {
 		av_log(NULL, AV_LOG_ERROR, "Error connecting filters\n");
+		avfilter_graph_free(&filter_graph);
 		return err;
 	}
 
@@ -135,6 +141,7 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 	err = avfilter_graph_config(filter_graph, NULL);
 	if (err < 0) {
 		av_log(NULL, AV_LOG_ERROR, "Error configuring the filter graph\n");
+		avfilter_graph_free(&filter_graph);
 		return err;
 	}
 
@@ -145,6 +152,7 @@ static int init_filter_graph(AVFilterGraph **graph, AVFilterContext **src,
 	return 0;
 }
 
+
 static inline int64_t get_valid_channel_layout(int64_t channel_layout,
 		int channels) {
 	if (channel_layout
@@ -155,112 +163,374 @@ static inline int64_t get_valid_channel_layout(int64_t channel_layout,
 	}
 }
 
-// decode a new packet(not multi-frame)
-// return decoded frame size, not decoded packet size
-int audio_decode_frame(uint8_t *audio_buf, int buf_size) {
-	static AVPacket pkt;
-	static uint8_t *audio_pkt_data = NULL;
-	static int audio_pkt_size = 0;
-	int len1, data_size;
-	int got_frame;
-	AVFrame * frame = NULL;
-	static int reconfigure = 1;
-	int ret = -1;
+/**
+ * Prepares d to decode st from the packets of q. avctx must be open, frames
+ * are converted to tgt, the output format shared by every track.
+ */
+void audio_decoder_init(AudioDecoder *d, AVCodecContext *avctx, AVStream *st,
+		PacketQueue *q, const AudioParams *tgt) {
+	memset(d, 0, sizeof(AudioDecoder));
+
+	d->avctx = avctx;
+	d->stream = st;
+	d->queue = q;
+	d->tgt = *tgt;
+
+	d->pkt_serial = -1;
+	d->decoder_serial = -1;
+	d->serial = -1;
+	d->seek_trim_pts = AV_NOPTS_VALUE;
+	d->trim_pts = AV_NOPTS_VALUE;
+	d->reconfigure = 1;
+}
 
-	for (;;) {
+void audio_decoder_destroy(AudioDecoder *d) {
+	av_free_packet(&d->pkt);
+	avfilter_graph_free(&d->agraph);
+	av_freep(&d->buf);
+	d->buf_alloc = 0;
+	d->buf_size = d->buf_index = 0;
+}
+
+// number of leading samples of frame that lie before the seek target
+static int frame_trim_samples(AudioDecoder *d, AVFrame *frame) {
+	int64_t pts = av_frame_get_best_effort_timestamp(frame);
+	int64_t skip;
+
+	if (AV_NOPTS_VALUE == d->trim_pts || AV_NOPTS_VALUE == pts) {
+		return 0;
+	}
+
+	skip = av_rescale_q(d->trim_pts - pts, d->stream->time_base,
+			(AVRational ) { 1, frame->sample_rate });
+	if (skip < frame->nb_samples) {
+		// the target is inside this frame, trimming ends here
+		d->trim_pts = AV_NOPTS_VALUE;
+	}
+
+	return (int) av_clip64(skip, 0, frame->nb_samples);
+}
+
+static void update_audio_clock(AudioDecoder *d, AVFrame *frame) {
+	AVStream *st = d->stream;
+	int64_t pts = av_frame_get_best_effort_timestamp(frame);
+
+	if (AV_NOPTS_VALUE == pts) {
+		return;
+	}
+
+	if (AV_NOPTS_VALUE != st->start_time) {
+		pts -= st->start_time;
+	}
+
+	d->clock = av_rescale_q(pts, st->time_base, AV_TIME_BASE_Q)
+			+ av_rescale(frame->nb_samples, AV_TIME_BASE, frame->sample_rate);
+}
+
+// libavcodec drops the encoder delay and padding itself when the demuxer
+// attaches AV_PKT_DATA_SKIP_SAMPLES (mp3 with a LAME tag, ogg, mp4 edit
+// lists); streams that only declare them in the codec parameters are
+// trimmed here, or the next track would not splice sample-accurately
+static void check_encoder_padding(AudioDecoder *d) {
+	AVCodecParameters *par = d->stream->codecpar;
+
+	if (av_packet_get_side_data(&d->pkt, AV_PKT_DATA_SKIP_SAMPLES, NULL)) {
+		return;
+	}
+
+	d->skip_samples = par->initial_padding;
+	d->trailing_padding = par->trailing_padding;
+}
+
+// appends a filtered frame to d->buf, minus the output samples to skip
+static int audio_decoder_append(AudioDecoder *d, AVFrame *frame) {
+	int frame_size = av_get_bytes_per_sample(
+			(enum AVSampleFormat) frame->format) * frame->channels;
+	int skip = (int) FFMIN(d->out_skip, frame->nb_samples);
+	int size = (frame->nb_samples - skip) * frame_size;
+	uint8_t *buf;
+
+	d->out_skip -= skip;
+	if (size <= 0) {
+		return 0;
+	}
+
+	buf = (uint8_t*) av_fast_realloc(d->buf, &d->buf_alloc,
+			d->buf_size + size);
+	if (!buf) {
+		return AVERROR(ENOMEM);
+	}
+	d->buf = buf;
+
+	memcpy(d->buf + d->buf_size, frame->data[0] + skip * frame_size, size);
+	d->buf_size += size;
+
+	return 0;
+}
+
+// converts a decoded frame through the filter graph and appends the
+// output to d->buf, minus the samples before the seek target and the
+// encoder delay
+static int audio_decoder_filter(AudioDecoder *d, AVFrame *frame) {
+	int64_t dec_channel_layout;
+	int skip, ret;
+
+	dec_channel_layout = get_valid_channel_layout(frame->channel_layout,
+			av_frame_get_channels(frame));
+
+	if (d->reconfigure || frame->format != d->src.fmt
+			|| av_frame_get_channels(frame) != d->src.channels
+			|| dec_channel_layout != d->src.channel_layout
+			|| frame->sample_rate != d->src.freq) {
+
+		d->reconfigure = 0;
+		avfilter_graph_free(&d->agraph);
+
+		// used by init_filter_graph()
+		d->src.fmt = (enum AVSampleFormat) frame->format;
+		d->src.channels = av_frame_get_channels(frame);
+		d->src.channel_layout = dec_channel_layout;
+		d->src.freq = frame->sample_rate;
+
+		if (init_filter_graph(&d->src, &d->tgt, &d->agraph, &d->in_filter,
+				&d->out_filter) < 0) {
+			d->reconfigure = 1;
+			return 0;
+		}
+	}
+
+	// samples before the seek target and the encoder delay, counted at the
+	// output rate since the filter may resample
+	skip = frame_trim_samples(d, frame);
+	if (d->skip_samples > 0) {
+		int n = FFMIN(d->skip_samples, frame->nb_samples - skip);
+		skip += n;
+		d->skip_samples -= n;
+	}
+	d->out_skip += av_rescale(skip, d->tgt.freq, frame->sample_rate);
+
+	// the encoder padding ends the stream, as many output bytes are kept
+	// back until the drain tells where that is
+	d->buf_hold = d->trailing_padding > 0 ?
+			(int) av_rescale(d->trailing_padding, d->tgt.freq,
+					frame->sample_rate) * d->tgt.frame_size : 0;
+
+	// computed on the decoded frame, whose pts is in stream time base
+	update_audio_clock(d, frame);
+
+	if ((ret = av_buffersrc_add_frame(d->in_filter, frame)) < 0) {
+		av_log(NULL, AV_LOG_ERROR, "av_buffersrc_add_frame :  failure. \n");
+		return 0;
+	}
+
+	// resampling may hold samples back or release several frames
+	while (av_buffersink_get_frame(d->out_filter, frame) >= 0) {
+		ret = audio_decoder_append(d, frame);
+		av_frame_unref(frame);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
 
-		while (audio_pkt_size > 0) {
+// appends what the decoder and the resampler still hold once the last
+// packet is decoded, then cuts the encoder padding from the end
+static int audio_decoder_drain(AudioDecoder *d, AVFrame *frame) {
+	AVPacket flush;
+	int got_frame, ret;
 
-			if (NULL == frame) {
-				frame = av_frame_alloc();
+	av_init_packet(&flush);
+	flush.data = NULL;
+	flush.size = 0;
+
+	// decoders with a delay release their last frames on empty packets
+	for (;;) {
+		got_frame = 0;
+		if (avcodec_decode_audio4(d->avctx, frame, &got_frame, &flush) < 0
+				|| !got_frame) {
+			break;
+		}
+		if ((ret = audio_decoder_filter(d, frame)) < 0) {
+			return ret;
+		}
+	}
+
+	if (d->agraph && av_buffersrc_add_frame(d->in_filter, NULL) >= 0) {
+		while (av_buffersink_get_frame(d->out_filter, frame) >= 0) {
+			ret = audio_decoder_append(d, frame);
+			av_frame_unref(frame);
+			if (ret < 0) {
+				return ret;
 			}
+		}
+	}
 
-			data_size = buf_size;
-			got_frame = 0;
+	d->buf_size = FFMAX(d->buf_index, d->buf_size - d->buf_hold);
+	d->drained = 1;
+	return 0;
+}
 
-			// len1 is decoded packet size
-			len1 = avcodec_decode_audio4(global_context.acodec_ctx, frame,
-					&got_frame, &pkt);
-			if (got_frame) {
-
-				if (reconfigure) {
-
-					reconfigure = 0;
-					int64_t dec_channel_layout = get_valid_channel_layout(
-							frame->channel_layout,
-							av_frame_get_channels(frame));
-
-					// used by init_filter_graph()
-					audio_filter_src.fmt = (enum AVSampleFormat) frame->format;
-					audio_filter_src.channels = av_frame_get_channels(frame);
-					audio_filter_src.channel_layout = dec_channel_layout;
-					audio_filter_src.freq = frame->sample_rate;
-
-					init_filter_graph(&agraph, &in_audio_filter,
-							&out_audio_filter);
-				}
-
-				if ((ret = av_buffersrc_add_frame(in_audio_filter, frame))
-						< 0) {
-					av_log(NULL, AV_LOG_ERROR,
-							"av_buffersrc_add_frame :  failure. \n");
-					return ret;
-				}
-
-				if ((ret = av_buffersink_get_frame(out_audio_filter, frame))
-						< 0) {
-					av_log(NULL, AV_LOG_ERROR,
-							"av_buffersink_get_frame :  failure. \n");
-					continue;
-				}
-
-				data_size = av_samples_get_buffer_size(NULL, frame->channels,
-						frame->nb_samples, (enum AVSampleFormat) frame->format,
-						1);
-
-				// len1 is decoded packet size
-				// < 0  means failure or error，so break to get a new packet
-				if (len1 < 0) {
-					audio_pkt_size = 0;
-					av_log(NULL, AV_LOG_ERROR,
-							"avcodec_decode_audio4 failure. \n");
-					break;
-				}
-
-				// decoded data to audio buf
-				memcpy(audio_buf, frame->data[0], data_size);
-
-				audio_pkt_data += len1;
-				audio_pkt_size -= len1;
-
-				int n = 2 * global_context.acodec_ctx->channels;
-				/*audio_clock += (double) data_size
-				 / (double) (n * global_context.acodec_ctx->sample_rate); // add bytes offset */
-				av_free_packet(&pkt);
-				av_frame_free(&frame);
+// end of the output PCM that can be read, short of the bytes held back
+static inline int audio_decoder_readable(AudioDecoder *d) {
+	return d->drained ?
+			d->buf_size : FFMAX(d->buf_index, d->buf_size - d->buf_hold);
+}
 
-				return data_size;
-			} else if (len1 < 0) {
+// decodes until more output PCM can be read from d->buf
+// return the bytes not read yet, 0 when no packet is queued yet,
+// AVERROR_EOF at the end
+static int audio_decoder_fill(AudioDecoder *d) {
+	AVFrame *frame;
+	int len, got_frame, eof, ret;
+	int readable;
+
+	frame = av_frame_alloc();
+	if (!frame) {
+		return AVERROR(ENOMEM);
+	}
+
+	// only the held back bytes are left, move them to the front
+	if (d->buf_index > 0 && d->buf_index >= audio_decoder_readable(d)) {
+		memmove(d->buf, d->buf + d->buf_index, d->buf_size - d->buf_index);
+		d->buf_size -= d->buf_index;
+		d->buf_index = 0;
+	}
+	readable = audio_decoder_readable(d);
+
+	for (;;) {
+
+		// a seek flushed the queue, the packet we hold is stale
+		if (d->pkt_serial != d->queue->serial) {
+			d->pkt_temp.size = 0;
+		}
+
+		while (d->pkt_temp.size > 0) {
+			got_frame = 0;
+
+			// len is decoded packet size
+			len = avcodec_decode_audio4(d->avctx, frame, &got_frame,
+					&d->pkt_temp);
+			if (len < 0) {
 				char errbuf[64];
-				av_strerror(ret, errbuf, 64);
+				av_strerror(len, errbuf, 64);
 				LOGV2("avcodec_decode_audio4 ret < 0, %s", errbuf);
+				d->pkt_temp.size = 0;
+				break;
+			}
+
+			if (!got_frame) {
+				// the whole packet is always submitted, so without a frame
+				// it has been consumed; move to the next one
+				d->pkt_temp.size = 0;
+				break;
+			}
+
+			d->pkt_temp.data += len;
+			d->pkt_temp.size -= len;
+
+			if ((ret = audio_decoder_filter(d, frame)) < 0) {
+				av_frame_free(&frame);
+				return ret;
+			}
+
+			if (audio_decoder_readable(d) > readable) {
+				d->serial = d->pkt_serial;
+				av_frame_free(&frame);
+				return audio_decoder_readable(d) - d->buf_index;
 			}
 		}
 
-		av_free_packet(&pkt);
-		av_frame_free(&frame);
+		av_free_packet(&d->pkt);
+
+		// the demuxer sets eof after queuing its last packet
+		eof = d->eof;
 
 		// get a new packet
-		if (packet_queue_get(&global_context.audio_queue, &pkt) < 0) {
-			return -1;
+		if (!packet_queue_get(d->queue, &d->pkt, &d->pkt_serial)) {
+			if (eof && !d->drained
+					&& (ret = audio_decoder_drain(d, frame)) < 0) {
+				av_frame_free(&frame);
+				return ret;
+			}
+			av_frame_free(&frame);
+			if (audio_decoder_readable(d) > readable) {
+				d->serial = d->pkt_serial;
+				return audio_decoder_readable(d) - d->buf_index;
+			}
+			return eof ? AVERROR_EOF : 0;
+		}
+
+		// first packet after a seek, drop the decoder and filter history
+		if (d->pkt_serial != d->decoder_serial) {
+			if (d->decoder_serial >= 0) {
+				avcodec_flush_buffers(d->avctx);
+				avfilter_graph_free(&d->agraph);
+				d->reconfigure = 1;
+			} else if (AV_NOPTS_VALUE == d->seek_trim_pts) {
+				// the stream is played from its very first packet
+				check_encoder_padding(d);
+			}
+			d->decoder_serial = d->pkt_serial;
+			d->trim_pts = d->seek_trim_pts;
+			d->out_skip = 0;
+			d->drained = 0;
 		}
 
-		//LOGV2("pkt.size is %d", pkt.size);
+		d->pkt_temp = d->pkt;
+	}
+}
 
-		audio_pkt_data = pkt.data;
-		audio_pkt_size = pkt.size;
+/**
+ * Copies up to len bytes of output PCM to buf, len being a multiple of the
+ * output frame size.
+ *
+ * @return bytes copied, 0 when no packet is queued yet, AVERROR_EOF once
+ *         the demuxer is done and everything has been read
+ */
+int audio_decoder_read(AudioDecoder *d, uint8_t *buf, int len) {
+	int copied = 0, n, ret;
+
+	// PCM decoded before a seek is stale
+	if (d->serial != d->queue->serial) {
+		d->buf_index = d->buf_size;
 	}
 
-	return ret;
+	while (copied < len) {
+		if (d->buf_index >= audio_decoder_readable(d)) {
+			ret = audio_decoder_fill(d);
+			if (ret <= 0) {
+				return copied ? copied : ret;
+			}
+		}
+
+		n = FFMIN(len - copied, audio_decoder_readable(d) - d->buf_index);
+		memcpy(buf + copied, d->buf + d->buf_index, n);
+		d->buf_index += n;
+		copied += n;
+	}
+
+	return copied;
 }
 
+/**
+ * Decodes ahead until size bytes of output PCM are buffered, so the reads
+ * that follow are plain copies. Only valid before d is read by another
+ * thread.
+ *
+ * @return the bytes buffered, 0 when more packets are needed, AVERROR_EOF
+ *         at the end
+ */
+int audio_decoder_prefill(AudioDecoder *d, int size) {
+	int ret;
+
+	while (audio_decoder_readable(d) - d->buf_index < size) {
+		ret = audio_decoder_fill(d);
+		if (ret <= 0) {
+			return ret;
+		}
+	}
+
+	return audio_decoder_readable(d) - d->buf_index;
+}
@@ -0,0 +1,334 @@
+
+#include "player.h"
+
+#define CLIP_BANK_MAX_CLIPS 64
+#define CLIP_BANK_DEFAULT_BUDGET (16 * 1024 * 1024)
+
+// bytes decoded per step, a multiple of any frame size
+#define CLIP_DECODE_CHUNK (4096 * 8)
+
+typedef struct ClipEntry {
+	char url[1024]; // empty once unloaded
+	ClipBuffer buffer; // buffer.data is NULL while evicted
+	int bytes;
+	int refs; // voices playing the buffer
+	int64_t last_used; // bank tick of the last load or play
+	int unloaded; // freed by the next sweep once refs drops to 0
+} ClipEntry;
+
+// Decoded PCM of short sounds, in the output format, so that triggering
+// a sound costs a buffer reference instead of a demux and decode. The
+// bank keeps at most budget bytes; least recently used sounds no voice
+// is playing are evicted and decoded again on their next use. Buffers are
+// only freed on the loading threads, never by the output callback.
+static ClipEntry entries[CLIP_BANK_MAX_CLIPS];
+static int64_t bank_bytes;
+static int64_t bank_budget = CLIP_BANK_DEFAULT_BUDGET;
+static int64_t bank_tick;
+static int64_t bank_hits;
+static int64_t bank_misses;
+static pthread_mutex_t bank_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Decodes url whole to PCM in the output format, see fix_output_params().
+ *
+ * @return the PCM size in bytes, -1 on failure
+ */
+int clip_decode(const char *url, float **pcm) {
+	AVFormatContext *fmt_ctx = NULL;
+	PacketQueue queue;
+	AudioDecoder dec;
+	AVPacket pkt;
+	uint8_t *data = NULL, *buf;
+	unsigned int alloc = 0;
+	int size = 0, stream_index, ret = -1;
+
+	packet_queue_init(&queue);
+	memset(&dec, 0, sizeof(AudioDecoder));
+
+	if (avformat_open_input(&fmt_ctx, url, NULL, NULL) < 0) {
+		av_log(NULL, AV_LOG_ERROR, "clip bank : cannot open %s\n", url);
+		goto end;
+	}
+
+	if (avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+		goto end;
+	}
+
+	stream_index = find_audio_stream(fmt_ctx);
+	if (-1 == stream_index
+			|| open_audio_decoder(fmt_ctx, stream_index, true) < 0) {
+		goto end;
+	}
+
+	audio_decoder_init(&dec, fmt_ctx->streams[stream_index]->codec,
+			fmt_ctx->streams[stream_index], &queue, &global_context.audio_tgt);
+
+	for (;;) {
+		buf = (uint8_t*) av_fast_realloc(data, &alloc,
+				size + CLIP_DECODE_CHUNK);
+		if (!buf) {
+			goto end;
+		}
+		data = buf;
+
+		ret = audio_decoder_read(&dec, data + size, CLIP_DECODE_CHUNK);
+		if (ret > 0) {
+			size += ret;
+			continue;
+		} else if (ret < 0) {
+			break;
+		}
+
+		// the decoder needs another packet
+		if (av_read_frame(fmt_ctx, &pkt) < 0) {
+			dec.eof = 1;
+		} else if (pkt.stream_index == stream_index) {
+			packet_queue_put(&queue, &pkt);
+		} else {
+			av_free_packet(&pkt);
+		}
+	}
+
+	// give back what the doubling allocated past the end
+	ret = -1;
+	if (size > 0 && (buf = (uint8_t*) av_realloc(data, size))) {
+		*pcm = (float*) buf;
+		data = NULL;
+		ret = size;
+	}
+
+	end:
+
+	av_free(data);
+	audio_decoder_destroy(&dec);
+	packet_queue_destroy(&queue);
+	if (fmt_ctx) {
+		avformat_close_input(&fmt_ctx);
+	}
+
+	return ret;
+}
+
+static void entry_free_buffer(ClipEntry *e) {
+	av_freep(&e->buffer.data);
+	bank_bytes -= e->bytes;
+	e->bytes = 0;
+}
+
+// frees unloaded entries no voice plays anymore
+static void clip_bank_sweep() {
+	int i;
+
+	for (i = 0; i < CLIP_BANK_MAX_CLIPS; i++) {
+		ClipEntry *e = &entries[i];
+		if (e->unloaded && !e->refs) {
+			entry_free_buffer(e);
+			e->unloaded = 0;
+		}
+	}
+}
+
+// evicts idle buffers, least recently used first, until size fits
+static int clip_bank_make_room(int64_t size) {
+	int i, lru;
+
+	clip_bank_sweep();
+
+	while (bank_bytes + size > bank_budget) {
+		lru = -1;
+		for (i = 0; i < CLIP_BANK_MAX_CLIPS; i++) {
+			ClipEntry *e = &entries[i];
+			if (e->buffer.data && !e->refs && e->url[0]
+					&& (lru < 0 || e->last_used < entries[lru].last_used)) {
+				lru = i;
+			}
+		}
+		if (lru < 0) {
+			return -1;
+		}
+
+		LOGV("clip bank : evicting %s, %d bytes", entries[lru].url,
+				entries[lru].bytes);
+		entry_free_buffer(&entries[lru]);
+	}
+
+	return 0;
+}
+
+static int clip_bank_find(const char *url) {
+	int i;
+
+	for (i = 0; i < CLIP_BANK_MAX_CLIPS; i++) {
+		if (entries[i].url[0] && !strcmp(entries[i].url, url)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+// decodes the evicted or new entry id, called with bank_mutex held
+static int clip_bank_fill(int id) {
+	ClipEntry *e = &entries[id];
+	char url[1024];
+	float *pcm = NULL;
+	int size;
+
+	av_strlcpy(url, e->url, sizeof(url));
+
+	// decoding takes a while, let the callback unref meanwhile
+	pthread_mutex_unlock(&bank_mutex);
+	size = clip_decode(url, &pcm);
+	pthread_mutex_lock(&bank_mutex);
+
+	if (size < 0) {
+		return -1;
+	}
+
+	// another thread filled or unloaded it meanwhile
+	if (e->buffer.data || strcmp(e->url, url)) {
+		av_free(pcm);
+		return e->buffer.data ? 0 : -1;
+	}
+
+	if (clip_bank_make_room(size) < 0) {
+		av_log(NULL, AV_LOG_ERROR,
+				"clip bank : %s does not fit in %lld bytes\n", url,
+				(long long) bank_budget);
+		av_free(pcm);
+		return -1;
+	}
+
+	e->buffer.data = pcm;
+	e->buffer.nb_frames = size / global_context.audio_tgt.frame_size;
+	e->bytes = size;
+	bank_bytes += size;
+
+	LOGV("clip bank : %s, %d frames, %lld of %lld bytes used", url,
+			e->buffer.nb_frames, (long long) bank_bytes,
+			(long long) bank_budget);
+	return 0;
+}
+
+/**
+ * Adds url to the bank and decodes it unless it is there already.
+ *
+ * @return the clip id, -1 on failure
+ */
+int clip_bank_load(const char *url) {
+	int id, i;
+
+	player_global_init();
+	fix_output_params();
+
+	pthread_mutex_lock(&bank_mutex);
+
+	id = clip_bank_find(url);
+	if (id < 0) {
+		for (i = 0; i < CLIP_BANK_MAX_CLIPS; i++) {
+			if (!entries[i].url[0] && !entries[i].unloaded) {
+				id = i;
+				break;
+			}
+		}
+		if (id < 0) {
+			pthread_mutex_unlock(&bank_mutex);
+			av_log(NULL, AV_LOG_ERROR, "clip bank : too many sounds\n");
+			return -1;
+		}
+		av_strlcpy(entries[id].url, url, sizeof(entries[id].url));
+		entries[id].buffer.id = id;
+	}
+
+	entries[id].last_used = ++bank_tick;
+	if (entries[id].buffer.data) {
+		bank_hits++;
+	} else {
+		bank_misses++;
+		if (clip_bank_fill(id) < 0) {
+			if (!entries[id].buffer.data && !entries[id].refs) {
+				entries[id].url[0] = 0;
+			}
+			id = -1;
+		}
+	}
+
+	pthread_mutex_unlock(&bank_mutex);
+
+	return id;
+}
+
+/**
+ * References the PCM of clip id for a voice, decoding it again if it
+ * was evicted. Release it with clip_bank_unref().
+ */
+ClipBuffer *clip_bank_ref(int id) {
+	ClipBuffer *buffer = NULL;
+	ClipEntry *e;
+
+	if (id < 0 || id >= CLIP_BANK_MAX_CLIPS) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&bank_mutex);
+
+	e = &entries[id];
+	if (e->url[0]) {
+		e->last_used = ++bank_tick;
+		if (e->buffer.data) {
+			bank_hits++;
+		} else {
+			bank_misses++;
+			clip_bank_fill(id);
+		}
+	}
+
+	if (e->url[0] && e->buffer.data) {
+		e->refs++;
+		buffer = &e->buffer;
+	}
+
+	pthread_mutex_unlock(&bank_mutex);
+
+	return buffer;
+}
+
+// called by the output callback when a voice ends, frees nothing
+void clip_bank_unref(ClipBuffer *buffer) {
+	pthread_mutex_lock(&bank_mutex);
+	entries[buffer->id].refs--;
+	pthread_mutex_unlock(&bank_mutex);
+}
+
+// removes clip id, its buffer goes once no voice plays it
+void clip_bank_unload(int id) {
+	if (id < 0 || id >= CLIP_BANK_MAX_CLIPS) {
+		return;
+	}
+
+	pthread_mutex_lock(&bank_mutex);
+	if (entries[id].url[0]) {
+		entries[id].url[0] = 0;
+		entries[id].unloaded = 1;
+	}
+	clip_bank_sweep();
+	pthread_mutex_unlock(&bank_mutex);
+}
+
+void clip_bank_set_budget(int64_t bytes) {
+	pthread_mutex_lock(&bank_mutex);
+	bank_budget = bytes > 0 ? bytes : CLIP_BANK_DEFAULT_BUDGET;
+	clip_bank_make_room(0);
+	pthread_mutex_unlock(&bank_mutex);
+}
+
+// { hits, misses, bytes in use, budget }
+void clip_bank_get_stats(int64_t *stats) {
+	pthread_mutex_lock(&bank_mutex);
+	stats[0] = bank_hits;
+	stats[1] = bank_misses;
+	stats[2] = bank_bytes;
+	stats[3] = bank_budget;
+	pthread_mutex_unlock(&bank_mutex);
+}
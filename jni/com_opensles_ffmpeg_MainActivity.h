@@ -57,6 +57,46 @@ extern "C" {
 #define com_opensles_ffmpeg_MainActivity_DEFAULT_KEYS_SEARCH_LOCAL 3L
 #undef com_opensles_ffmpeg_MainActivity_DEFAULT_KEYS_SEARCH_GLOBAL
 #define com_opensles_ffmpeg_MainActivity_DEFAULT_KEYS_SEARCH_GLOBAL 4L
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    startPlaylist
+ * Signature: ([Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_startPlaylist
+  (JNIEnv *, jclass, jobjectArray);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setPreloadTime
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setPreloadTime
+  (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setCrossfade
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setCrossfade
+  (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getCrossfadeHeadroom
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_getCrossfadeHeadroom
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getTrackIndex
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_getTrackIndex
+  (JNIEnv *, jclass);
+
 /*
  * Class:     com_opensles_ffmpeg_MainActivity
  * Method:    destroyEngine
@@ -73,6 +113,30 @@ JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_destroyEngine
 JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_startAudioPlayer
   (JNIEnv *, jclass);
 
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    startAudioPlayerFromUrl
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_startAudioPlayerFromUrl
+  (JNIEnv *, jclass, jstring);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    startAudioPlayerFromBuffer
+ * Signature: (Ljava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_startAudioPlayerFromBuffer
+  (JNIEnv *, jclass, jobject);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    startAudioPlayerFromFd
+ * Signature: (IJJ)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_startAudioPlayerFromFd
+  (JNIEnv *, jclass, jint, jlong, jlong);
+
 /*
  * Class:     com_opensles_ffmpeg_MainActivity
  * Method:    stopAudioPlayer
@@ -81,6 +145,430 @@ JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_startAudioPlayer
 JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_stopAudioPlayer
   (JNIEnv *, jclass);
 
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setReadAheadSize
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setReadAheadSize
+  (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getIOWaitPerSecond
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_getIOWaitPerSecond
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setCacheDir
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setCacheDir
+  (JNIEnv *, jclass, jstring);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getHttpCacheStats
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_opensles_ffmpeg_MainActivity_getHttpCacheStats
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setFastStart
+ * Signature: (Z)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setFastStart
+  (JNIEnv *, jclass, jboolean);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getStartupTimes
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_opensles_ffmpeg_MainActivity_getStartupTimes
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    seekTo
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_seekTo
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    scrubBegin
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_scrubBegin
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    scrubTo
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_scrubTo
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    scrubEnd
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_scrubEnd
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getPosition
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getPosition
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getSeekLatency
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getSeekLatency
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    loadSound
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_loadSound
+  (JNIEnv *, jclass, jstring);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    unloadSound
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_unloadSound
+  (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    playSound
+ * Signature: (IFFJ)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_playSound
+  (JNIEnv *, jclass, jint, jfloat, jfloat, jlong);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setVoice
+ * Signature: (IFF)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setVoice
+  (JNIEnv *, jclass, jint, jfloat, jfloat);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    stopVoice
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_stopVoice
+  (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getMixerTime
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getMixerTime
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getMixerLoad
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_getMixerLoad
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setClipBankBudget
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setClipBankBudget
+  (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getClipBankStats
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_opensles_ffmpeg_MainActivity_getClipBankStats
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setSpeed
+ * Signature: (F)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setSpeed
+  (JNIEnv *, jclass, jfloat);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getTimeStretchCpu
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getTimeStretchCpu
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setEqBand
+ * Signature: (IFFF)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setEqBand
+  (JNIEnv *, jclass, jint, jfloat, jfloat, jfloat);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getEqResponse
+ * Signature: (F)F
+ */
+JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getEqResponse
+  (JNIEnv *, jclass, jfloat);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getEqBandCpu
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getEqBandCpu
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    loadReverb
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_loadReverb
+  (JNIEnv *, jclass, jstring);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    unloadReverb
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_unloadReverb
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setReverbLevel
+ * Signature: (F)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setReverbLevel
+  (JNIEnv *, jclass, jfloat);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getReverbLoad
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_getReverbLoad
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setCompressor
+ * Signature: (ZZFFFFF)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setCompressor
+  (JNIEnv *, jclass, jboolean, jboolean, jfloat, jfloat, jfloat, jfloat, jfloat);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setLimiter
+ * Signature: (ZFF)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setLimiter
+  (JNIEnv *, jclass, jboolean, jfloat, jfloat);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getGainReduction
+ * Signature: ()F
+ */
+JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getGainReduction
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getDynamicsBlockCost
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getDynamicsBlockCost
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setVolume
+ * Signature: (F)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setVolume
+  (JNIEnv *, jclass, jfloat);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setReplayGainMode
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setReplayGainMode
+  (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    scanLoudness
+ * Signature: ([Ljava/lang/String;[I)[F
+ */
+JNIEXPORT jfloatArray JNICALL Java_com_opensles_ffmpeg_MainActivity_scanLoudness
+  (JNIEnv *, jclass, jobjectArray, jintArray);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getLoudnessScanRate
+ * Signature: ()F
+ */
+JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getLoudnessScanRate
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    setSpectrum
+ * Signature: (IIF)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_setSpectrum
+  (JNIEnv *, jclass, jint, jint, jfloat);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getSpectrumBuffer
+ * Signature: ()Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_com_opensles_ffmpeg_MainActivity_getSpectrumBuffer
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getSpectrumCpu
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getSpectrumCpu
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getMeter
+ * Signature: ()[F
+ */
+JNIEXPORT jfloatArray JNICALL Java_com_opensles_ffmpeg_MainActivity_getMeter
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getMeterCpu
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_getMeterCpu
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getWaveform
+ * Signature: (Ljava/lang/String;I)[F
+ */
+JNIEXPORT jfloatArray JNICALL Java_com_opensles_ffmpeg_MainActivity_getWaveform
+  (JNIEnv *, jclass, jstring, jint);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getWaveformSpeed
+ * Signature: ()F
+ */
+JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getWaveformSpeed
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    exportPcm
+ * Signature: (Ljava/lang/String;IJJI)J
+ */
+JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_exportPcm
+  (JNIEnv *, jclass, jstring, jint, jlong, jlong, jint);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    exportPcmToSink
+ * Signature: (Ljava/lang/String;JJILcom/opensles/ffmpeg/MainActivity$PcmSink;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_opensles_ffmpeg_MainActivity_exportPcmToSink
+  (JNIEnv *, jclass, jstring, jlong, jlong, jint, jobject);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getExportSpeed
+ * Signature: ()F
+ */
+JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getExportSpeed
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    scanMetadata
+ * Signature: ([Ljava/lang/String;Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_scanMetadata
+  (JNIEnv *, jclass, jobjectArray, jstring);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    getMetadataScanRate
+ * Signature: ()F
+ */
+JNIEXPORT jfloat JNICALL Java_com_opensles_ffmpeg_MainActivity_getMetadataScanRate
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    cancelLoudnessScan
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_cancelLoudnessScan
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    cancelWaveform
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_cancelWaveform
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_opensles_ffmpeg_MainActivity
+ * Method:    cancelMetadataScan
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_opensles_ffmpeg_MainActivity_cancelMetadataScan
+  (JNIEnv *, jclass);
+
 #ifdef __cplusplus
 }
 #endif
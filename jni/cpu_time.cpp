@@ -0,0 +1,19 @@
+#include "player.h"
+
+// kept apart from util.cpp so the host benchmarks link them without FFmpeg
+
+// CPU time consumed by the calling thread, in microseconds
+int64_t get_thread_cpu_time() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * INT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
+// CPU time consumed by all threads of the process, in microseconds
+int64_t get_process_cpu_time() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * INT64_C(1000000) + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,436 @@
+
+#include "player.h"
+
+#include <math.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_DSP_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_DSP_SSE 1
+#endif
+
+// Float kernels of the output path. Buffers are interleaved, n counts
+// samples of all channels; NEON and SSE do four at a time and the scalar
+// loop finishes the tail, so no alignment or length is required.
+
+/**
+ * Equal-power fade gains for the frames [pos, pos + nb_frames) of a fade
+ * of len frames: gain_out follows cos and gain_in sin over a quarter turn,
+ * so gain_out^2 + gain_in^2 stays 1 and uncorrelated tracks keep their
+ * loudness through the overlap. Gains are repeated for every channel.
+ */
+void dsp_fade_gains(float *gain_out, float *gain_in, int nb_frames,
+		int channels, int64_t pos, int64_t len) {
+	double step = M_PI / 2 / FFMAX(len, 1);
+	double c = cos(pos * step), s = sin(pos * step);
+	double dc = cos(step), ds = sin(step);
+	double t;
+	int i, ch;
+
+	// a rotation per frame instead of two libm calls, exact enough over
+	// the length of one buffer
+	for (i = 0; i < nb_frames; i++) {
+		for (ch = 0; ch < channels; ch++) {
+			*gain_out++ = (float) FFMAX(c, 0);
+			*gain_in++ = (float) FFMIN(s, 1);
+		}
+		t = c * dc - s * ds;
+		s = s * dc + c * ds;
+		c = t;
+	}
+}
+
+// dst = a * gain_a + b * gain_b
+void dsp_mix2(float *dst, const float *a, const float *gain_a,
+		const float *b, const float *gain_b, int n) {
+	int i = 0;
+
+#if HAVE_DSP_NEON
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t v = vmulq_f32(vld1q_f32(a + i), vld1q_f32(gain_a + i));
+		v = vmlaq_f32(v, vld1q_f32(b + i), vld1q_f32(gain_b + i));
+		vst1q_f32(dst + i, v);
+	}
+#elif HAVE_DSP_SSE
+	for (; i + 4 <= n; i += 4) {
+		__m128 v = _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(gain_a + i));
+		v = _mm_add_ps(v,
+				_mm_mul_ps(_mm_loadu_ps(b + i), _mm_loadu_ps(gain_b + i)));
+		_mm_storeu_ps(dst + i, v);
+	}
+#endif
+
+	for (; i < n; i++) {
+		dst[i] = a[i] * gain_a[i] + b[i] * gain_b[i];
+	}
+}
+
+/**
+ * Converts [-1, 1] float to S16, rounding to nearest and saturating, and
+ * applies a gain on the way, moving by step every frame from gain at
+ * frame 0, so a volume ramp costs no pass of its own.
+ */
+void dsp_float_to_s16(int16_t *dst, const float *src, int nb_frames,
+		int channels, float gain, float step) {
+	int n = nb_frames * channels;
+	int i = 0;
+
+	// lanes hold the gains of the frames of four samples, as 16 bit scale
+#if HAVE_DSP_NEON || HAVE_DSP_SSE
+	float lanes[4], inc = step * (4 / channels) * 32768.0f;
+	for (i = 0; i < 4; i++) {
+		lanes[i] = (gain + step * (i / channels)) * 32768.0f;
+	}
+	i = 0;
+#endif
+#if HAVE_DSP_NEON
+	float32x4_t scale = vld1q_f32(lanes), d = vdupq_n_f32(inc);
+	float32x4_t half = vdupq_n_f32(0.5f);
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t v = vmulq_f32(vld1q_f32(src + i), scale);
+		// vcvtq truncates towards zero, round half away from zero first
+		uint32x4_t neg = vcltq_f32(v, vdupq_n_f32(0));
+		v = vaddq_f32(v, vbslq_f32(neg, vnegq_f32(half), half));
+		vst1_s16(dst + i, vqmovn_s32(vcvtq_s32_f32(v)));
+		scale = vaddq_f32(scale, d);
+	}
+#elif HAVE_DSP_SSE
+	__m128 scale = _mm_loadu_ps(lanes), d = _mm_set1_ps(inc);
+	for (; i + 8 <= n; i += 8) {
+		__m128i lo = _mm_cvtps_epi32(
+				_mm_mul_ps(_mm_loadu_ps(src + i), scale));
+		scale = _mm_add_ps(scale, d);
+		__m128i hi = _mm_cvtps_epi32(
+				_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale));
+		scale = _mm_add_ps(scale, d);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+
+	for (; i < n; i++) {
+		dst[i] = (int16_t) av_clip_int16(lrintf(src[i]
+				* (gain + step * (i / channels)) * 32768.0f));
+	}
+}
+
+// dst += src * gain, with one gain per channel for one or two channels
+void dsp_mix_gain(float *dst, const float *src, const float *gain,
+		int nb_frames, int channels) {
+	int n = nb_frames * channels;
+	int i = 0;
+	float g0 = gain[0], g1 = channels == 2 ? gain[1] : gain[0];
+
+	// lanes hold g0 g1 g0 g1, in step with interleaved stereo
+#if HAVE_DSP_NEON
+	float lanes[4] = { g0, g1, g0, g1 };
+	float32x4_t g = vld1q_f32(lanes);
+	for (; i + 4 <= n; i += 4) {
+		vst1q_f32(dst + i,
+				vmlaq_f32(vld1q_f32(dst + i), vld1q_f32(src + i), g));
+	}
+#elif HAVE_DSP_SSE
+	__m128 g = _mm_setr_ps(g0, g1, g0, g1);
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(dst + i,
+				_mm_add_ps(_mm_loadu_ps(dst + i),
+						_mm_mul_ps(_mm_loadu_ps(src + i), g)));
+	}
+#endif
+
+	for (; i < n; i++) {
+		dst[i] += src[i] * ((i & 1) ? g1 : g0);
+	}
+}
+
+// sum of a[i] * b[i]
+float dsp_dot(const float *a, const float *b, int n) {
+	float sum = 0;
+	int i = 0;
+
+#if HAVE_DSP_NEON
+	float32x4_t acc = vdupq_n_f32(0);
+	float32x2_t half;
+	for (; i + 4 <= n; i += 4) {
+		acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+	}
+	half = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+	sum = vget_lane_f32(vpadd_f32(half, half), 0);
+#elif HAVE_DSP_SSE
+	__m128 acc = _mm_setzero_ps();
+	float lanes[4];
+	for (; i + 4 <= n; i += 4) {
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i),
+				_mm_loadu_ps(b + i)));
+	}
+	_mm_storeu_ps(lanes, acc);
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+	for (; i < n; i++) {
+		sum += a[i] * b[i];
+	}
+
+	return sum;
+}
+
+/**
+ * Transposed direct form II biquad, in place on one or two channels.
+ *
+ * @param c      { b0, b1, b2, a1, a2 }, normalized by a0
+ * @param state  { z1 of each channel, z2 of each channel }, 4 floats
+ */
+void dsp_biquad(float *buf, int nb_frames, int channels, const float *c,
+		float *state) {
+	int i, ch;
+
+	// the channels of a frame go through the section side by side
+#if HAVE_DSP_NEON
+	if (channels == 2) {
+		float32x2_t b0 = vdup_n_f32(c[0]), b1 = vdup_n_f32(c[1]);
+		float32x2_t b2 = vdup_n_f32(c[2]), a1 = vdup_n_f32(c[3]);
+		float32x2_t a2 = vdup_n_f32(c[4]);
+		float32x2_t z1 = vld1_f32(state), z2 = vld1_f32(state + 2);
+		for (i = 0; i < nb_frames; i++) {
+			float32x2_t x = vld1_f32(buf + i * 2);
+			float32x2_t y = vmla_f32(z1, b0, x);
+			z1 = vmls_f32(vmla_f32(z2, b1, x), a1, y);
+			z2 = vmls_f32(vmul_f32(b2, x), a2, y);
+			vst1_f32(buf + i * 2, y);
+		}
+		vst1_f32(state, z1);
+		vst1_f32(state + 2, z2);
+		return;
+	}
+#elif HAVE_DSP_SSE
+	if (channels == 2) {
+		__m128 b0 = _mm_set1_ps(c[0]), b1 = _mm_set1_ps(c[1]);
+		__m128 b2 = _mm_set1_ps(c[2]), a1 = _mm_set1_ps(c[3]);
+		__m128 a2 = _mm_set1_ps(c[4]);
+		__m128 z1 = _mm_setr_ps(state[0], state[1], 0, 0);
+		__m128 z2 = _mm_setr_ps(state[2], state[3], 0, 0);
+		float lanes[4];
+		for (i = 0; i < nb_frames; i++) {
+			__m128 x = _mm_castsi128_ps(
+					_mm_loadl_epi64((const __m128i*) (buf + i * 2)));
+			__m128 y = _mm_add_ps(z1, _mm_mul_ps(b0, x));
+			z1 = _mm_sub_ps(_mm_add_ps(z2, _mm_mul_ps(b1, x)),
+					_mm_mul_ps(a1, y));
+			z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+			_mm_storel_epi64((__m128i*) (buf + i * 2), _mm_castps_si128(y));
+		}
+		_mm_storeu_ps(lanes, z1);
+		state[0] = lanes[0];
+		state[1] = lanes[1];
+		_mm_storeu_ps(lanes, z2);
+		state[2] = lanes[0];
+		state[3] = lanes[1];
+		return;
+	}
+#endif
+
+	for (ch = 0; ch < channels; ch++) {
+		float z1 = state[ch], z2 = state[2 + ch];
+		for (i = 0; i < nb_frames; i++) {
+			float x = buf[i * channels + ch];
+			float y = c[0] * x + z1;
+			z1 = c[1] * x - c[3] * y + z2;
+			z2 = c[2] * x - c[4] * y;
+			buf[i * channels + ch] = y;
+		}
+		state[ch] = z1;
+		state[2 + ch] = z2;
+	}
+}
+
+// acc += a * b on n / 2 interleaved complex values
+void dsp_complex_mac(float *acc, const float *a, const float *b, int n) {
+	int i = 0;
+
+#if HAVE_DSP_NEON
+	for (; i + 8 <= n; i += 8) {
+		float32x4x2_t va = vld2q_f32(a + i);
+		float32x4x2_t vb = vld2q_f32(b + i);
+		float32x4x2_t vc = vld2q_f32(acc + i);
+		vc.val[0] = vmlaq_f32(vc.val[0], va.val[0], vb.val[0]);
+		vc.val[0] = vmlsq_f32(vc.val[0], va.val[1], vb.val[1]);
+		vc.val[1] = vmlaq_f32(vc.val[1], va.val[0], vb.val[1]);
+		vc.val[1] = vmlaq_f32(vc.val[1], va.val[1], vb.val[0]);
+		vst2q_f32(acc + i, vc);
+	}
+#elif HAVE_DSP_SSE
+	const __m128 sign = _mm_setr_ps(-1, 1, -1, 1);
+	for (; i + 4 <= n; i += 4) {
+		__m128 va = _mm_loadu_ps(a + i);
+		__m128 vb = _mm_loadu_ps(b + i);
+		__m128 b_re = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(2, 2, 0, 0));
+		__m128 b_im = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 3, 1, 1));
+		__m128 a_swap = _mm_shuffle_ps(va, va, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 prod = _mm_add_ps(_mm_mul_ps(va, b_re),
+				_mm_mul_ps(_mm_mul_ps(a_swap, b_im), sign));
+		_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), prod));
+	}
+#endif
+
+	for (; i + 2 <= n; i += 2) {
+		acc[i] += a[i] * b[i] - a[i + 1] * b[i + 1];
+		acc[i + 1] += a[i] * b[i + 1] + a[i + 1] * b[i];
+	}
+}
+
+// buf *= gain, the gain moving by step every frame from gain at frame 0
+void dsp_gain_ramp(float *buf, int nb_frames, int channels, float gain,
+		float step) {
+	int n = nb_frames * channels;
+	int i = 0;
+
+	// four samples are two frames of stereo or four of mono
+#if HAVE_DSP_NEON || HAVE_DSP_SSE
+	float lanes[4], inc = step * (4 / channels);
+	for (i = 0; i < 4; i++) {
+		lanes[i] = gain + step * (i / channels);
+	}
+	i = 0;
+#endif
+#if HAVE_DSP_NEON
+	float32x4_t g = vld1q_f32(lanes), d = vdupq_n_f32(inc);
+	for (; i + 4 <= n; i += 4) {
+		vst1q_f32(buf + i, vmulq_f32(vld1q_f32(buf + i), g));
+		g = vaddq_f32(g, d);
+	}
+#elif HAVE_DSP_SSE
+	__m128 g = _mm_loadu_ps(lanes), d = _mm_set1_ps(inc);
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(buf + i, _mm_mul_ps(_mm_loadu_ps(buf + i), g));
+		g = _mm_add_ps(g, d);
+	}
+#endif
+
+	for (; i < n; i++) {
+		buf[i] *= gain + step * (i / channels);
+	}
+}
+
+// dst = src / 32768
+void dsp_s16_to_float(float *dst, const int16_t *src, int n) {
+	int i = 0;
+
+#if HAVE_DSP_NEON
+	float32x4_t scale = vdupq_n_f32(1.0f / 32768);
+	for (; i + 4 <= n; i += 4) {
+		int32x4_t v = vmovl_s16(vld1_s16(src + i));
+		vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(v), scale));
+	}
+#elif HAVE_DSP_SSE
+	__m128 scale = _mm_set1_ps(1.0f / 32768);
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadl_epi64((const __m128i*) (src + i));
+		// sign extension: the sample in the high half, shifted back down
+		v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+#endif
+
+	for (; i < n; i++) {
+		dst[i] = src[i] * (1.0f / 32768);
+	}
+}
+
+/**
+ * Largest magnitude and sum of squares of each of one or two channels,
+ * merged into peak and added to power.
+ */
+void dsp_peak_power(const float *buf, int nb_frames, int channels,
+		float *peak, float *power) {
+	int n = nb_frames * channels;
+	int i = 0, ch;
+
+	// lane k of the vectors holds channel k % channels
+#if HAVE_DSP_NEON
+	float32x4_t vmax = vdupq_n_f32(0), vsum = vdupq_n_f32(0);
+	float lanes_max[4], lanes_sum[4];
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t x = vld1q_f32(buf + i);
+		vmax = vmaxq_f32(vmax, vabsq_f32(x));
+		vsum = vmlaq_f32(vsum, x, x);
+	}
+	vst1q_f32(lanes_max, vmax);
+	vst1q_f32(lanes_sum, vsum);
+#elif HAVE_DSP_SSE
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 vmax = _mm_setzero_ps(), vsum = _mm_setzero_ps();
+	float lanes_max[4], lanes_sum[4];
+	for (; i + 4 <= n; i += 4) {
+		__m128 x = _mm_loadu_ps(buf + i);
+		vmax = _mm_max_ps(vmax, _mm_and_ps(x, abs_mask));
+		vsum = _mm_add_ps(vsum, _mm_mul_ps(x, x));
+	}
+	_mm_storeu_ps(lanes_max, vmax);
+	_mm_storeu_ps(lanes_sum, vsum);
+#endif
+#if HAVE_DSP_NEON || HAVE_DSP_SSE
+	for (ch = 0; ch < 4; ch++) {
+		peak[ch % channels] = FFMAX(peak[ch % channels], lanes_max[ch]);
+		power[ch % channels] += lanes_sum[ch];
+	}
+#endif
+
+	for (; i < n; i++) {
+		ch = i % channels;
+		peak[ch] = FFMAX(peak[ch], fabsf(buf[i]));
+		power[ch] += buf[i] * buf[i];
+	}
+}
+
+// smallest and largest sample and sum of squares of n samples, merged into
+// min and max and added to power
+void dsp_min_max_power(const float *buf, int n, float *min, float *max,
+		float *power) {
+	float lo = *min, hi = *max, sum = 0;
+	int i = 0;
+
+#if HAVE_DSP_NEON
+	float32x4_t vlo = vdupq_n_f32(lo), vhi = vdupq_n_f32(hi);
+	float32x4_t vsum = vdupq_n_f32(0);
+	float32x2_t half;
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t x = vld1q_f32(buf + i);
+		vlo = vminq_f32(vlo, x);
+		vhi = vmaxq_f32(vhi, x);
+		vsum = vmlaq_f32(vsum, x, x);
+	}
+	half = vpmin_f32(vget_low_f32(vlo), vget_high_f32(vlo));
+	lo = vget_lane_f32(vpmin_f32(half, half), 0);
+	half = vpmax_f32(vget_low_f32(vhi), vget_high_f32(vhi));
+	hi = vget_lane_f32(vpmax_f32(half, half), 0);
+	half = vadd_f32(vget_low_f32(vsum), vget_high_f32(vsum));
+	sum = vget_lane_f32(vpadd_f32(half, half), 0);
+#elif HAVE_DSP_SSE
+	__m128 vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(hi);
+	__m128 vsum = _mm_setzero_ps();
+	float lanes_lo[4], lanes_hi[4], lanes_sum[4];
+	for (; i + 4 <= n; i += 4) {
+		__m128 x = _mm_loadu_ps(buf + i);
+		vlo = _mm_min_ps(vlo, x);
+		vhi = _mm_max_ps(vhi, x);
+		vsum = _mm_add_ps(vsum, _mm_mul_ps(x, x));
+	}
+	_mm_storeu_ps(lanes_lo, vlo);
+	_mm_storeu_ps(lanes_hi, vhi);
+	_mm_storeu_ps(lanes_sum, vsum);
+	lo = FFMIN(FFMIN(lanes_lo[0], lanes_lo[1]), FFMIN(lanes_lo[2], lanes_lo[3]));
+	hi = FFMAX(FFMAX(lanes_hi[0], lanes_hi[1]), FFMAX(lanes_hi[2], lanes_hi[3]));
+	sum = lanes_sum[0] + lanes_sum[1] + lanes_sum[2] + lanes_sum[3];
+#endif
+
+	for (; i < n; i++) {
+		lo = FFMIN(lo, buf[i]);
+		hi = FFMAX(hi, buf[i]);
+		sum += buf[i] * buf[i];
+	}
+
+	*min = lo;
+	*max = hi;
+	*power += sum;
+}
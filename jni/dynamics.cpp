@@ -0,0 +1,266 @@
+
+#include "player.h"
+
+#include <math.h>
+
+// frames per gain computation; the gain ramps linearly across a block
+#define DYN_BLOCK 32
+#define DYN_MAX_LOOKAHEAD_BLOCKS 16
+#define DYN_MAX_CHANNELS 2
+
+typedef struct DynamicsParams {
+	int compress;
+	int rms; // RMS detector if set, peak otherwise
+	float threshold_db;
+	float ratio;
+	float attack_ms;
+	float release_ms;
+	float makeup_db;
+	int limit;
+	float ceiling_db;
+	float lookahead_ms;
+} DynamicsParams;
+
+// Compressor and limiter on the final float output, ahead of the S16
+// conversion that would clip. Levels and gains are computed once per
+// DYN_BLOCK frames and the gain is ramped across the next block; the
+// output is delayed by the look-ahead, and the gain of a block is the
+// lowest one wanted by the blocks inside the look-ahead, so a peak is
+// already turned down when it comes out. All state is static, the
+// output callback allocates nothing. Settings are published like the
+// equalizer's, see eq.cpp.
+static DynamicsParams dyn_params = { 0, 0, -20, 4, 5, 200, 0, 0, -0.3f, 5 };
+static volatile int dyn_seq;
+static pthread_mutex_t dyn_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// output callback side
+static DynamicsParams dyn;
+static int dyn_seq_used = -1;
+static int dyn_rate;
+static int dyn_channels;
+static float dyn_attack; // per block envelope coefficients
+static float dyn_release;
+static float dyn_makeup;
+static float dyn_ceiling;
+static int dyn_lookahead; // in blocks
+
+static float dyn_delay[DYN_MAX_LOOKAHEAD_BLOCKS * DYN_BLOCK
+		* DYN_MAX_CHANNELS];
+static int dyn_delay_pos; // frame of the delay line, block aligned
+static float dyn_targets[DYN_MAX_LOOKAHEAD_BLOCKS];
+static int dyn_target_pos;
+
+static int dyn_block_pos; // frames of the current block
+static float dyn_peak; // of the current block
+static float dyn_sum_sq;
+static float dyn_env; // detector envelope, linear
+static float dyn_gain = 1; // gain of the next frame
+static float dyn_step; // added to dyn_gain every frame
+
+static int64_t dyn_blocks;
+static int64_t dyn_cpu_us;
+
+int dynamics_set_compressor(bool enabled, bool rms, float threshold_db,
+		float ratio, float attack_ms, float release_ms, float makeup_db) {
+	if (threshold_db < -60 || threshold_db > 0 || ratio < 1 || ratio > 20
+			|| attack_ms < 0.1f || attack_ms > 500 || release_ms < 1
+			|| release_ms > 5000 || makeup_db < 0 || makeup_db > 24) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&dyn_mutex);
+	__sync_fetch_and_add(&dyn_seq, 1);
+	dyn_params.compress = enabled;
+	dyn_params.rms = rms;
+	dyn_params.threshold_db = threshold_db;
+	dyn_params.ratio = ratio;
+	dyn_params.attack_ms = attack_ms;
+	dyn_params.release_ms = release_ms;
+	dyn_params.makeup_db = makeup_db;
+	__sync_fetch_and_add(&dyn_seq, 1);
+	pthread_mutex_unlock(&dyn_mutex);
+
+	return 0;
+}
+
+/**
+ * @param ceiling_db    highest output peak, -12 to 0 dBFS
+ * @param lookahead_ms  0 to the length of DYN_MAX_LOOKAHEAD_BLOCKS; peaks
+ *                      are only caught in time from 2 blocks (1.5 ms)
+ */
+int dynamics_set_limiter(bool enabled, float ceiling_db, float lookahead_ms) {
+	if (ceiling_db < -12 || ceiling_db > 0 || lookahead_ms < 0
+			|| lookahead_ms > 10) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&dyn_mutex);
+	__sync_fetch_and_add(&dyn_seq, 1);
+	dyn_params.limit = enabled;
+	dyn_params.ceiling_db = ceiling_db;
+	dyn_params.lookahead_ms = lookahead_ms;
+	__sync_fetch_and_add(&dyn_seq, 1);
+	pthread_mutex_unlock(&dyn_mutex);
+
+	return 0;
+}
+
+static void dynamics_reset() {
+	int i;
+
+	memset(dyn_delay, 0, sizeof(dyn_delay));
+	dyn_delay_pos = 0;
+	for (i = 0; i < DYN_MAX_LOOKAHEAD_BLOCKS; i++) {
+		dyn_targets[i] = 1;
+	}
+	dyn_target_pos = 0;
+	dyn_block_pos = 0;
+	dyn_peak = dyn_sum_sq = 0;
+	dyn_env = 0;
+	dyn_gain = 1;
+	dyn_step = 0;
+}
+
+// picks up new settings or a new output format, in the output callback
+static void dynamics_update(int rate, int channels) {
+	DynamicsParams params;
+	int seq, lookahead;
+	double block_s;
+
+	seq = dyn_seq;
+	__sync_synchronize();
+	if ((seq == dyn_seq_used && rate == dyn_rate && channels == dyn_channels)
+			|| (seq & 1)) {
+		return;
+	}
+
+	params = dyn_params;
+	__sync_synchronize();
+	if (seq != dyn_seq) {
+		return;
+	}
+
+	block_s = (double) DYN_BLOCK / rate;
+	dyn_attack = (float) exp(-block_s * 1000 / params.attack_ms);
+	dyn_release = (float) exp(-block_s * 1000 / params.release_ms);
+	dyn_makeup = (float) pow(10, params.makeup_db / 20);
+	dyn_ceiling = (float) pow(10, params.ceiling_db / 20);
+
+	lookahead = params.limit ? (int) lrint(params.lookahead_ms / 1000 / block_s)
+			: 0;
+	lookahead = av_clip(lookahead, 0, DYN_MAX_LOOKAHEAD_BLOCKS);
+
+	// a new delay starts from silence, a short gap beats a jump
+	if (lookahead != dyn_lookahead || rate != dyn_rate
+			|| channels != dyn_channels || (!dyn.compress && !dyn.limit)) {
+		dynamics_reset();
+	}
+
+	dyn = params;
+	dyn_lookahead = lookahead;
+	dyn_seq_used = seq;
+	dyn_rate = rate;
+	dyn_channels = channels;
+}
+
+// gain wanted once the block just measured comes out, ramped to over
+// the next block
+static void dynamics_block() {
+	float level, target, want, gain;
+	int i, n;
+
+	level = dyn.rms ? sqrtf(dyn_sum_sq / (DYN_BLOCK * dyn_channels))
+			: dyn_peak;
+	dyn_env = level > dyn_env ? dyn_attack * dyn_env
+			+ (1 - dyn_attack) * level : dyn_release * dyn_env
+			+ (1 - dyn_release) * level;
+
+	target = 1;
+	if (dyn.compress) {
+		float over = 20 * log10f(dyn_env + 1e-9f) - dyn.threshold_db;
+		target = dyn_makeup;
+		if (over > 0) {
+			target *= powf(10, -over * (1 - 1 / dyn.ratio) / 20);
+		}
+	}
+	if (dyn.limit && dyn_peak * target > dyn_ceiling) {
+		target = dyn_ceiling / dyn_peak;
+	}
+
+	// the lowest target of the blocks still in the delay line
+	n = FFMAX(dyn_lookahead, 1);
+	dyn_targets[dyn_target_pos] = target;
+	dyn_target_pos = (dyn_target_pos + 1) % n;
+	want = target;
+	for (i = 0; i < n; i++) {
+		want = FFMIN(want, dyn_targets[i]);
+	}
+
+	// down at once, the look-ahead hides it; back up at the release rate
+	gain = want < dyn_gain ? want
+			: dyn_gain + (want - dyn_gain) * (1 - dyn_release);
+	dyn_step = (gain - dyn_gain) / DYN_BLOCK;
+
+	global_context.gain_reduction_db = FFMAX(0,
+			20 * log10f((dyn.compress ? dyn_makeup : 1) / gain));
+
+	dyn_peak = dyn_sum_sq = 0;
+}
+
+// compresses and limits nb_frames of output in place
+void dynamics_process(float *buf, int nb_frames) {
+	int channels = global_context.audio_tgt.channels;
+	int64_t cpu;
+	int i, k, n, delay, blocks = 0;
+
+	dynamics_update(global_context.audio_tgt.freq, channels);
+	if ((!dyn.compress && !dyn.limit) || channels > DYN_MAX_CHANNELS) {
+		global_context.gain_reduction_db = 0;
+		return;
+	}
+
+	delay = dyn_lookahead * DYN_BLOCK;
+	cpu = get_thread_cpu_time();
+
+	for (i = 0; i < nb_frames; i += n) {
+		float *frames = buf + i * channels;
+
+		n = FFMIN(nb_frames - i, DYN_BLOCK - dyn_block_pos);
+
+		for (k = 0; k < n * channels; k++) {
+			dyn_peak = FFMAX(dyn_peak, fabsf(frames[k]));
+			dyn_sum_sq += frames[k] * frames[k];
+		}
+
+		// the delay line is block aligned, so a block never wraps
+		if (delay) {
+			float *line = dyn_delay + dyn_delay_pos * channels;
+			for (k = 0; k < n * channels; k++) {
+				float x = frames[k];
+				frames[k] = line[k];
+				line[k] = x;
+			}
+			dyn_delay_pos = (dyn_delay_pos + n) % delay;
+		}
+
+		dsp_gain_ramp(frames, n, channels, dyn_gain, dyn_step);
+		dyn_gain += dyn_step * n;
+
+		dyn_block_pos += n;
+		if (dyn_block_pos == DYN_BLOCK) {
+			dynamics_block();
+			dyn_block_pos = 0;
+			blocks++;
+		}
+	}
+
+	dyn_cpu_us += get_thread_cpu_time() - cpu;
+	dyn_blocks += blocks;
+	if (dyn_blocks * DYN_BLOCK >= dyn_rate) {
+		global_context.dynamics_block_ns = dyn_cpu_us * 1000 / dyn_blocks;
+		LOGV2("dynamics : %lld ns CPU per %d frame block, %.1f dB reduction",
+				(long long) global_context.dynamics_block_ns, DYN_BLOCK,
+				global_context.gain_reduction_db);
+		dyn_blocks = dyn_cpu_us = 0;
+	}
+}
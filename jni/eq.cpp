@@ -0,0 +1,187 @@
+
+#include "player.h"
+
+#include <math.h>
+
+#define EQ_BANDS 10
+#define EQ_MAX_GAIN_DB 24
+
+typedef struct EqBand {
+	float freq;
+	float gain_db; // 0 takes the band out of the chain
+	float q;
+} EqBand;
+
+// Parametric equalizer on the float output of the tracks: a cascade of
+// peaking biquads (RBJ cookbook), one per band with a gain. The UI thread
+// publishes band settings under a sequence count and the output callback
+// copies them without a lock, keeping its coefficients for one more
+// buffer when it races a writer; the coefficients are computed by the
+// callback, which also knows the output rate.
+static EqBand eq_bands[EQ_BANDS] = {
+	{ 31.25f, 0, 1.41f }, { 62.5f, 0, 1.41f }, { 125, 0, 1.41f },
+	{ 250, 0, 1.41f }, { 500, 0, 1.41f }, { 1000, 0, 1.41f },
+	{ 2000, 0, 1.41f }, { 4000, 0, 1.41f }, { 8000, 0, 1.41f },
+	{ 16000, 0, 1.41f },
+};
+static volatile int eq_seq; // odd while eq_bands is being written
+static pthread_mutex_t eq_mutex = PTHREAD_MUTEX_INITIALIZER; // writers
+
+// output callback side
+static int eq_seq_used = -1;
+static int eq_rate;
+static float eq_coeffs[EQ_BANDS][5];
+static float eq_state[EQ_BANDS][4];
+static int eq_enabled[EQ_BANDS];
+static int eq_nb_enabled;
+static int64_t eq_frames;
+static int64_t eq_cpu_us;
+
+// peaking section, { b0, b1, b2, a1, a2 } normalized by a0
+static void eq_band_coeffs(const EqBand *band, int rate, double *c) {
+	double a = pow(10, band->gain_db / 40);
+	double w0 = 2 * M_PI * FFMIN(band->freq, rate * 0.45) / rate;
+	double alpha = sin(w0) / (2 * band->q);
+	double a0 = 1 + alpha / a;
+
+	c[0] = (1 + alpha * a) / a0;
+	c[1] = -2 * cos(w0) / a0;
+	c[2] = (1 - alpha * a) / a0;
+	c[3] = -2 * cos(w0) / a0;
+	c[4] = (1 - alpha / a) / a0;
+}
+
+/**
+ * Sets a band, from any thread but the output callback.
+ *
+ * @param freq     centre frequency in Hz
+ * @param gain_db  -24 to 24, 0 turns the band off
+ * @param q        bandwidth, 0.1 to 10
+ */
+int eq_set_band(int band, float freq, float gain_db, float q) {
+	if (band < 0 || band >= EQ_BANDS || freq < 20 || freq > 20000
+			|| fabsf(gain_db) > EQ_MAX_GAIN_DB || q < 0.1f || q > 10) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&eq_mutex);
+	__sync_fetch_and_add(&eq_seq, 1);
+	eq_bands[band].freq = freq;
+	eq_bands[band].gain_db = gain_db;
+	eq_bands[band].q = q;
+	__sync_fetch_and_add(&eq_seq, 1);
+	pthread_mutex_unlock(&eq_mutex);
+
+	return 0;
+}
+
+// picks up new settings or a new output rate, in the output callback
+static void eq_update(int rate) {
+	EqBand bands[EQ_BANDS];
+	double c[5];
+	int seq, i, k;
+
+	seq = eq_seq;
+	__sync_synchronize();
+	if ((seq == eq_seq_used && rate == eq_rate) || (seq & 1)) {
+		return;
+	}
+
+	memcpy(bands, eq_bands, sizeof(bands));
+	__sync_synchronize();
+	if (seq != eq_seq) {
+		// a writer got in, try again on the next buffer
+		return;
+	}
+
+	eq_nb_enabled = 0;
+	for (i = 0; i < EQ_BANDS; i++) {
+		int enabled = bands[i].gain_db != 0;
+
+		// a band coming back starts from silence, a new rate too
+		if ((enabled && !eq_enabled[i]) || rate != eq_rate) {
+			memset(eq_state[i], 0, sizeof(eq_state[i]));
+		}
+
+		eq_enabled[i] = enabled;
+		eq_nb_enabled += enabled;
+
+		eq_band_coeffs(&bands[i], rate, c);
+		for (k = 0; k < 5; k++) {
+			eq_coeffs[i][k] = (float) c[k];
+		}
+	}
+
+	eq_seq_used = seq;
+	eq_rate = rate;
+}
+
+// filters nb_frames of output in place, called by the output callback
+void eq_process(float *buf, int nb_frames) {
+	int rate = global_context.audio_tgt.freq;
+	int channels = global_context.audio_tgt.channels;
+	int64_t cpu;
+	int i;
+
+	eq_update(rate);
+	if (!eq_nb_enabled) {
+		return;
+	}
+
+	cpu = get_thread_cpu_time();
+	for (i = 0; i < EQ_BANDS; i++) {
+		if (eq_enabled[i]) {
+			dsp_biquad(buf, nb_frames, channels, eq_coeffs[i], eq_state[i]);
+		}
+	}
+	eq_cpu_us += get_thread_cpu_time() - cpu;
+
+	// cost of one band for a second of output
+	eq_frames += nb_frames;
+	if (eq_frames >= rate) {
+		global_context.eq_band_cpu_us = eq_cpu_us * rate
+				/ (eq_frames * eq_nb_enabled);
+		LOGV2("eq : %d bands, %lld us CPU per band per second of output",
+				eq_nb_enabled, (long long) global_context.eq_band_cpu_us);
+		eq_frames = eq_cpu_us = 0;
+	}
+}
+
+/**
+ * Magnitude response of the bands at freq, for drawing the curve.
+ *
+ * @return gain in dB at the output rate, 44100 Hz before any output
+ */
+float eq_response_db(float freq) {
+	int rate = global_context.audio_tgt.freq ? global_context.audio_tgt.freq
+			: 44100;
+	double w = 2 * M_PI * freq / rate;
+	double db = 0, c[5];
+	int i, k;
+
+	pthread_mutex_lock(&eq_mutex);
+	for (i = 0; i < EQ_BANDS; i++) {
+		double nr, ni, dr, di;
+
+		if (eq_bands[i].gain_db == 0) {
+			continue;
+		}
+
+		// the coefficients rounded like eq_update() does, their error
+		// shows below 30 Hz where the poles sit close to the unit circle
+		eq_band_coeffs(&eq_bands[i], rate, c);
+		for (k = 0; k < 5; k++) {
+			c[k] = (float) c[k];
+		}
+
+		// H(e^jw), numerator and denominator in z^-1 = e^-jw
+		nr = c[0] + c[1] * cos(w) + c[2] * cos(2 * w);
+		ni = -c[1] * sin(w) - c[2] * sin(2 * w);
+		dr = 1 + c[3] * cos(w) + c[4] * cos(2 * w);
+		di = -c[3] * sin(w) - c[4] * sin(2 * w);
+		db += 10 * log10((nr * nr + ni * ni) / (dr * dr + di * di));
+	}
+	pthread_mutex_unlock(&eq_mutex);
+
+	return (float) db;
+}
@@ -0,0 +1,303 @@
+
+#include "player.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+// PCM handed to the sink per write; large writes keep the syscall and
+// JNI overhead per second of audio negligible
+#define EXPORT_WRITE_SIZE (256 * 1024)
+
+#define WAV_HEADER_SIZE 44
+#define WAV_EXTENSIBLE_HEADER_SIZE 68
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+static uint8_t *put_le16(uint8_t *p, unsigned int v) {
+	p[0] = (uint8_t) v;
+	p[1] = (uint8_t) (v >> 8);
+	return p + 2;
+}
+
+static uint8_t *put_le32(uint8_t *p, uint32_t v) {
+	p = put_le16(p, v & 0xFFFF);
+	return put_le16(p, v >> 16);
+}
+
+static uint8_t *put_tag(uint8_t *p, const char *tag) {
+	memcpy(p, tag, 4);
+	return p + 4;
+}
+
+static int wav_header_size(const AudioParams *tgt) {
+	return tgt->channels > 2 ? WAV_EXTENSIBLE_HEADER_SIZE : WAV_HEADER_SIZE;
+}
+
+/**
+ * Writes the RIFF header for data_size bytes of tgt PCM to h, the sizes
+ * are left at their maximum when data_size is negative (not known yet).
+ * Layouts wider than stereo take WAVE_FORMAT_EXTENSIBLE.
+ *
+ * @return the header size
+ */
+static int wav_header_write(uint8_t *h, const AudioParams *tgt,
+		int64_t data_size) {
+	int size = wav_header_size(tgt);
+	bool is_float = AV_SAMPLE_FMT_FLT == tgt->fmt;
+	unsigned int tag = is_float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+	uint32_t data, riff;
+	uint8_t *p = h;
+
+	// RIFF sizes are 32 bits, longer exports are still readable as streams
+	if (data_size < 0 || data_size > UINT32_MAX - size) {
+		data = riff = UINT32_MAX;
+	} else {
+		data = (uint32_t) data_size;
+		riff = (uint32_t) (data_size + size - 8);
+	}
+
+	p = put_tag(p, "RIFF");
+	p = put_le32(p, riff);
+	p = put_tag(p, "WAVE");
+
+	p = put_tag(p, "fmt ");
+	p = put_le32(p, size - 28);
+	p = put_le16(p, size > WAV_HEADER_SIZE ? WAVE_FORMAT_EXTENSIBLE : tag);
+	p = put_le16(p, tgt->channels);
+	p = put_le32(p, tgt->freq);
+	p = put_le32(p, tgt->bytes_per_sec);
+	p = put_le16(p, tgt->frame_size);
+	p = put_le16(p, 8 * tgt->frame_size / tgt->channels);
+
+	if (size > WAV_HEADER_SIZE) {
+		static const uint8_t guid_tail[14] = { 0x00, 0x00, 0x00, 0x00, 0x10,
+				0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+
+		p = put_le16(p, 22);
+		p = put_le16(p, 8 * tgt->frame_size / tgt->channels);
+		p = put_le32(p, tgt->channel_layout);
+		// KSDATAFORMAT_SUBTYPE_PCM or _IEEE_FLOAT
+		p = put_le16(p, tag);
+		memcpy(p, guid_tail, sizeof(guid_tail));
+		p += sizeof(guid_tail);
+	}
+
+	p = put_tag(p, "data");
+	put_le32(p, data);
+
+	return size;
+}
+
+/**
+ * Decodes url from params->start to params->end into tgt PCM and passes it
+ * to write in EXPORT_WRITE_SIZE batches, the WAV header with the first one.
+ * The decode shares AudioDecoder with playback but runs on the calling
+ * thread with no output attached, as fast as the CPU allows.
+ *
+ * @param tgt  receives the format of the PCM written
+ * @return the number of frames written, -1 on failure
+ */
+static int64_t export_run(const char *url, const ExportParams *params,
+		ExportWriteFunc write, void *opaque, AudioParams *tgt) {
+	AVFormatContext *fmt_ctx = NULL;
+	AVStream *st;
+	PacketQueue queue;
+	AudioDecoder dec;
+	AVPacket pkt;
+	uint8_t *buf = NULL;
+	int64_t frames = 0, remaining = INT64_MAX, t = av_gettime_relative();
+	int64_t result = -1;
+	int stream_index, channels, batch, filled = 0, ret;
+
+	packet_queue_init(&queue);
+	memset(&dec, 0, sizeof(AudioDecoder));
+
+	if (params->fmt != AV_SAMPLE_FMT_S16 && params->fmt != AV_SAMPLE_FMT_FLT) {
+		goto end;
+	}
+
+	if (avformat_open_input(&fmt_ctx, url, NULL, NULL) < 0) {
+		av_log(NULL, AV_LOG_ERROR, "export : cannot open %s\n", url);
+		goto end;
+	}
+
+	if (avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+		goto end;
+	}
+
+	stream_index = find_audio_stream(fmt_ctx);
+	if (-1 == stream_index
+			|| open_audio_decoder(fmt_ctx, stream_index, true) < 0) {
+		goto end;
+	}
+	st = fmt_ctx->streams[stream_index];
+
+	// the source rate and channels, only the sample format changes
+	channels = st->codec->channels;
+	tgt->fmt = params->fmt;
+	tgt->freq = st->codec->sample_rate;
+	tgt->channels = channels;
+	tgt->channel_layout = (unsigned int) (
+			av_get_channel_layout_nb_channels(st->codec->channel_layout)
+					== channels ?
+					st->codec->channel_layout :
+					av_get_default_channel_layout(channels));
+	tgt->frame_size = av_samples_get_buffer_size(NULL, channels, 1, tgt->fmt,
+			1);
+	tgt->bytes_per_sec = tgt->freq * tgt->frame_size;
+	if (tgt->freq <= 0 || tgt->frame_size <= 0) {
+		goto end;
+	}
+
+	audio_decoder_init(&dec, st->codec, st, &queue, tgt);
+
+	if (params->start > 0) {
+		int64_t target = params->start;
+
+		if (AV_NOPTS_VALUE != fmt_ctx->start_time) {
+			target += fmt_ctx->start_time;
+		}
+
+		// without a seek the samples before the target are decoded and cut
+		if (avformat_seek_file(fmt_ctx, -1, INT64_MIN, target, target, 0)
+				< 0) {
+			av_log(NULL, AV_LOG_WARNING, "export : seek to %" PRId64
+					" failure, decoding from the start\n", params->start);
+		}
+		dec.seek_trim_pts = av_rescale_q(target, AV_TIME_BASE_Q,
+				st->time_base);
+	}
+
+	if (params->end > 0) {
+		if (params->end <= params->start) {
+			goto end;
+		}
+		remaining = av_rescale(params->end - FFMAX(params->start, 0),
+				tgt->freq, AV_TIME_BASE) * tgt->frame_size;
+	}
+
+	batch = EXPORT_WRITE_SIZE / tgt->frame_size * tgt->frame_size;
+	buf = (uint8_t*) av_malloc(batch);
+	if (!buf) {
+		goto end;
+	}
+
+	if (EXPORT_WAV == params->container) {
+		filled = wav_header_write(buf, tgt, -1);
+	}
+
+	while (remaining > 0) {
+		// reads are whole frames, the header may leave a partial one free
+		ret = audio_decoder_read(&dec, buf + filled,
+				(int) FFMIN((batch - filled) / tgt->frame_size
+						* tgt->frame_size, remaining));
+		if (ret > 0) {
+			filled += ret;
+			remaining -= ret;
+			frames += ret / tgt->frame_size;
+
+			if (batch - filled < tgt->frame_size) {
+				if (write(opaque, buf, filled) < 0) {
+					goto end;
+				}
+				filled = 0;
+			}
+			continue;
+		} else if (ret < 0) {
+			break;
+		}
+
+		// the decoder needs another packet
+		if (av_read_frame(fmt_ctx, &pkt) < 0) {
+			dec.eof = 1;
+		} else if (pkt.stream_index == stream_index) {
+			packet_queue_put(&queue, &pkt);
+		} else {
+			av_free_packet(&pkt);
+		}
+	}
+
+	if (filled > 0 && write(opaque, buf, filled) < 0) {
+		goto end;
+	}
+
+	t = av_gettime_relative() - t;
+	global_context.export_speed = t > 0 ?
+			(float) ((double) frames * AV_TIME_BASE / tgt->freq / t) : 0;
+	LOGV("export : %" PRId64 " frames in %" PRId64 " us, %.1fx realtime",
+			frames, t, global_context.export_speed);
+	result = frames;
+
+	end:
+
+	av_free(buf);
+	audio_decoder_destroy(&dec);
+	packet_queue_destroy(&queue);
+	if (fmt_ctx) {
+		avformat_close_input(&fmt_ctx);
+	}
+
+	return result;
+}
+
+/**
+ * Decodes url to PCM without an output, see ExportParams.
+ *
+ * @param write   receives the PCM in batches, returns < 0 to abort
+ * @return the number of frames written, -1 on failure
+ */
+int64_t pcm_export(const char *url, const ExportParams *params,
+		ExportWriteFunc write, void *opaque) {
+	AudioParams tgt;
+
+	return export_run(url, params, write, opaque, &tgt);
+}
+
+static int fd_write(void *opaque, const uint8_t *buf, int size) {
+	int fd = *(int*) opaque;
+	ssize_t n;
+
+	while (size > 0) {
+		n = write(fd, buf, size);
+		if (n < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			av_log(NULL, AV_LOG_ERROR, "export : write failure, %s\n",
+					strerror(errno));
+			return AVERROR(errno);
+		}
+		buf += n;
+		size -= (int) n;
+	}
+
+	return 0;
+}
+
+/**
+ * Decodes url to PCM written to fd from its current offset. A seekable fd
+ * gets the final sizes in its WAV header once the export is done; pipes
+ * and sockets keep the streaming header.
+ *
+ * @return the number of frames written, -1 on failure
+ */
+int64_t pcm_export_fd(const char *url, const ExportParams *params, int fd) {
+	uint8_t header[WAV_EXTENSIBLE_HEADER_SIZE];
+	AudioParams tgt;
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+	int64_t frames;
+	int size;
+
+	frames = export_run(url, params, fd_write, &fd, &tgt);
+
+	if (frames >= 0 && EXPORT_WAV == params->container && pos >= 0) {
+		size = wav_header_write(header, &tgt, frames * tgt.frame_size);
+		if (pwrite(fd, header, size, pos) != size) {
+			LOGV("export : fd not seekable, WAV sizes left open");
+		}
+	}
+
+	return frames;
+}
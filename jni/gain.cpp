@@ -0,0 +1,161 @@
+
+#include "player.h"
+
+#include <math.h>
+
+// a full scale gain change takes this long, short enough to follow a
+// volume slider, long enough to stay free of zipper noise
+#define GAIN_RAMP_MS 20
+
+// R128 gains are relative to -23 LUFS, ReplayGain to about -18
+#define R128_TO_REPLAYGAIN_DB 5
+
+// Output gain: user volume times the ReplayGain of the track being heard,
+// applied by the float to S16 conversion. The gain moves towards a new
+// target by a linear ramp of at most one full scale per GAIN_RAMP_MS.
+static float user_volume = 1;
+static int replay_gain_mode = REPLAY_GAIN_TRACK;
+static float output_gain = 1; // gain of the next frame
+
+void gain_set_volume(float volume) {
+	user_volume = volume;
+}
+
+void gain_set_replay_gain_mode(int mode) {
+	replay_gain_mode = mode;
+}
+
+static bool parse_tag(AVDictionary *metadata, const char *key, float *value) {
+	AVDictionaryEntry *tag = av_dict_get(metadata, key, NULL, 0);
+	char *end;
+	double v;
+
+	if (!tag) {
+		return false;
+	}
+
+	v = strtod(tag->value, &end);
+	if (end == tag->value) {
+		return false;
+	}
+
+	*value = (float) v;
+	return true;
+}
+
+// reads the tags of dict into rg, keeps what it has already
+static void read_tags(AVDictionary *metadata, ReplayGain *rg) {
+	float v;
+
+	if (!rg->has_track && parse_tag(metadata, "REPLAYGAIN_TRACK_GAIN", &v)) {
+		rg->track_db = v;
+		rg->has_track = 1;
+		parse_tag(metadata, "REPLAYGAIN_TRACK_PEAK", &rg->track_peak);
+	}
+	if (!rg->has_album && parse_tag(metadata, "REPLAYGAIN_ALBUM_GAIN", &v)) {
+		rg->album_db = v;
+		rg->has_album = 1;
+		parse_tag(metadata, "REPLAYGAIN_ALBUM_PEAK", &rg->album_peak);
+	}
+
+	// Opus, in Q7.8 dB
+	if (!rg->has_track && parse_tag(metadata, "R128_TRACK_GAIN", &v)) {
+		rg->track_db = v / 256 + R128_TO_REPLAYGAIN_DB;
+		rg->has_track = 1;
+	}
+	if (!rg->has_album && parse_tag(metadata, "R128_ALBUM_GAIN", &v)) {
+		rg->album_db = v / 256 + R128_TO_REPLAYGAIN_DB;
+		rg->has_album = 1;
+	}
+}
+
+/**
+ * Finds the ReplayGain of a stream: the side data the demuxer exported
+ * from the tags, or the tags themselves, including the R128 ones.
+ */
+void replay_gain_read(AVFormatContext *fmt_ctx, int stream_index,
+		ReplayGain *rg) {
+	AVStream *st = fmt_ctx->streams[stream_index];
+	AVReplayGain *side;
+	int size;
+
+	memset(rg, 0, sizeof(ReplayGain));
+
+	side = (AVReplayGain*) av_stream_get_side_data(st,
+			AV_PKT_DATA_REPLAYGAIN, &size);
+	if (side && size >= (int) sizeof(AVReplayGain)) {
+		if (side->track_gain != INT32_MIN) {
+			rg->track_db = side->track_gain / 100000.0f;
+			rg->track_peak = side->track_peak / 100000.0f;
+			rg->has_track = 1;
+		}
+		if (side->album_gain != INT32_MIN) {
+			rg->album_db = side->album_gain / 100000.0f;
+			rg->album_peak = side->album_peak / 100000.0f;
+			rg->has_album = 1;
+		}
+	}
+
+	read_tags(st->metadata, rg);
+	read_tags(fmt_ctx->metadata, rg);
+
+	if (rg->has_track || rg->has_album) {
+		LOGV("replay gain : track %.2f dB, album %.2f dB",
+				rg->has_track ? rg->track_db : 0,
+				rg->has_album ? rg->album_db : 0);
+	}
+}
+
+// linear gain of rg in the current mode, kept below clipping of its peak
+static float replay_gain_factor(const ReplayGain *rg) {
+	float db, peak, gain;
+
+	if (!rg || REPLAY_GAIN_OFF == replay_gain_mode) {
+		return 1;
+	}
+
+	// album gain falls back to the track one, as the tags allow
+	if (REPLAY_GAIN_ALBUM == replay_gain_mode && rg->has_album) {
+		db = rg->album_db;
+		peak = rg->album_peak;
+	} else if (rg->has_track) {
+		db = rg->track_db;
+		peak = rg->track_peak;
+	} else {
+		return 1;
+	}
+
+	gain = powf(10, db / 20);
+	if (peak > 0 && gain * peak > 1) {
+		gain = 1 / peak;
+	}
+
+	return gain;
+}
+
+/**
+ * Converts nb_frames of float output to S16 with the output gain of the
+ * track rg belongs to, NULL when no track plays.
+ */
+void gain_to_s16(int16_t *dst, const float *src, int nb_frames,
+		const ReplayGain *rg) {
+	int channels = global_context.audio_tgt.channels;
+	float target = user_volume * replay_gain_factor(rg);
+	float max_step = 1000.0f / (GAIN_RAMP_MS * global_context.audio_tgt.freq);
+	float diff = target - output_gain, step;
+	int n = 0, ramp;
+
+	if (diff != 0) {
+		// the ramp may end inside the buffer, the rest stays at target
+		ramp = (int) ceilf(fabsf(diff) / max_step);
+		step = diff / ramp;
+		n = FFMIN(nb_frames, ramp);
+		dsp_float_to_s16(dst, src, n, channels, output_gain, step);
+		output_gain = n == ramp ? target : output_gain + step * n;
+	}
+
+	if (n < nb_frames) {
+		dsp_float_to_s16(dst + n * channels, src + n * channels,
+				nb_frames - n, channels, target, 0);
+	}
+}
@@ -0,0 +1,417 @@
+
+#include "player.h"
+
+#include <unistd.h>
+
+#define HTTP_CACHE_MAGIC MKTAG('F', 'O', 'H', 'C')
+#define HTTP_CACHE_VERSION 1
+#define HTTP_CACHE_AVIO_BUFFER_SIZE (32 * 1024)
+
+typedef struct CacheRange {
+	int64_t start;
+	int64_t end;
+} CacheRange;
+
+typedef struct CacheIndexHeader {
+	uint32_t magic;
+	uint32_t version;
+	int64_t length;
+	int32_t nb_ranges;
+	int32_t reserved;
+} CacheIndexHeader;
+
+// Progressive download cache for network sources.
+//
+// Fetched bytes are written at their own offset into a sparse data file,
+// and the sorted list of byte ranges present in it is kept in a small
+// index file next to it. Reads that fall into a cached range are served
+// from disk; missing ranges are fetched from the upstream connection,
+// which the http protocol turns into Range requests when it is seeked.
+struct HttpCache {
+	char url[1024];
+	char data_path[1024];
+	char index_path[1024];
+
+	AVIOContext *upstream;
+	int64_t upstream_pos;
+
+	int data_fd;
+
+	CacheRange *ranges; // sorted and merged
+	int nb_ranges;
+	int ranges_alloc;
+	int dirty;
+
+	int64_t length; // -1 until known
+	int64_t pos;
+
+	int64_t bytes_from_cache;
+	int64_t bytes_from_network;
+};
+
+static int http_cache_interrupt_cb(void *opaque) {
+	return global_context.quit;
+}
+
+// index of the last range starting at or before pos, -1 if none
+static int http_cache_find_range(HttpCache *hc, int64_t pos) {
+	int lo = 0, hi = hc->nb_ranges - 1, found = -1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (hc->ranges[mid].start <= pos) {
+			found = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	return found;
+}
+
+static int http_cache_add_range(HttpCache *hc, int64_t start, int64_t end) {
+	int i = http_cache_find_range(hc, start);
+	int j;
+
+	// extend the previous range if it touches [start, end)
+	if (i >= 0 && hc->ranges[i].end >= start) {
+		hc->ranges[i].end = FFMAX(hc->ranges[i].end, end);
+	} else {
+		if (hc->nb_ranges == hc->ranges_alloc) {
+			int alloc = FFMAX(16, hc->ranges_alloc * 2);
+			if (av_reallocp_array(&hc->ranges, alloc, sizeof(CacheRange))
+					< 0) {
+				hc->nb_ranges = hc->ranges_alloc = 0;
+				return AVERROR(ENOMEM);
+			}
+			hc->ranges_alloc = alloc;
+		}
+
+		i++;
+		memmove(hc->ranges + i + 1, hc->ranges + i,
+				(hc->nb_ranges - i) * sizeof(CacheRange));
+		hc->ranges[i].start = start;
+		hc->ranges[i].end = end;
+		hc->nb_ranges++;
+	}
+
+	// swallow the following ranges the new data now reaches
+	for (j = i + 1; j < hc->nb_ranges && hc->ranges[j].start <= hc->ranges[i].end;
+			j++) {
+		hc->ranges[i].end = FFMAX(hc->ranges[i].end, hc->ranges[j].end);
+	}
+
+	if (j > i + 1) {
+		memmove(hc->ranges + i + 1, hc->ranges + j,
+				(hc->nb_ranges - j) * sizeof(CacheRange));
+		hc->nb_ranges -= j - i - 1;
+	}
+
+	hc->dirty = 1;
+	return 0;
+}
+
+static void http_cache_load_index(HttpCache *hc) {
+	CacheIndexHeader header;
+	int fd;
+
+	fd = open(hc->index_path, O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+
+	if (read(fd, &header, sizeof(header)) == sizeof(header)
+			&& header.magic == HTTP_CACHE_MAGIC
+			&& header.version == HTTP_CACHE_VERSION && header.nb_ranges >= 0
+			&& header.nb_ranges < INT_MAX / (int) sizeof(CacheRange)) {
+		size_t size = header.nb_ranges * sizeof(CacheRange);
+
+		hc->ranges = (CacheRange*) av_malloc(FFMAX(size, 1));
+		if (hc->ranges && read(fd, hc->ranges, size) == (ssize_t) size) {
+			hc->nb_ranges = hc->ranges_alloc = header.nb_ranges;
+			hc->length = header.length;
+		} else {
+			av_freep(&hc->ranges);
+		}
+	}
+
+	close(fd);
+}
+
+static void http_cache_save_index(HttpCache *hc) {
+	CacheIndexHeader header = { 0 };
+	char tmp_path[1040];
+	size_t size = hc->nb_ranges * sizeof(CacheRange);
+	int fd;
+
+	if (!hc->dirty) {
+		return;
+	}
+
+	header.magic = HTTP_CACHE_MAGIC;
+	header.version = HTTP_CACHE_VERSION;
+	header.length = hc->length;
+	header.nb_ranges = hc->nb_ranges;
+
+	// write aside and rename, so a crash never leaves a torn index
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", hc->index_path);
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		return;
+	}
+
+	if (write(fd, &header, sizeof(header)) == sizeof(header)
+			&& write(fd, hc->ranges, size) == (ssize_t) size) {
+		fsync(fd);
+		close(fd);
+		rename(tmp_path, hc->index_path);
+		hc->dirty = 0;
+	} else {
+		close(fd);
+		unlink(tmp_path);
+	}
+}
+
+static void http_cache_invalidate(HttpCache *hc) {
+	av_log(NULL, AV_LOG_WARNING, "http_cache : %s changed, dropping cache\n",
+			hc->url);
+	hc->nb_ranges = 0;
+	hc->dirty = 1;
+	if (ftruncate(hc->data_fd, 0) < 0) {
+		av_log(NULL, AV_LOG_ERROR, "http_cache : ftruncate failure\n");
+	}
+}
+
+static int http_cache_open_upstream(HttpCache *hc) {
+	AVIOInterruptCB int_cb = { http_cache_interrupt_cb, NULL };
+	int64_t length;
+	int err;
+
+	err = avio_open2(&hc->upstream, hc->url, AVIO_FLAG_READ, &int_cb, NULL);
+	if (err < 0) {
+		char errbuf[64];
+		av_strerror(err, errbuf, 64);
+		av_log(NULL, AV_LOG_ERROR, "http_cache : avio_open2 %s, %s\n",
+				hc->url, errbuf);
+		return err;
+	}
+
+	hc->upstream_pos = 0;
+
+	length = avio_size(hc->upstream);
+	if (length > 0) {
+		if (hc->length > 0 && hc->length != length) {
+			http_cache_invalidate(hc);
+		}
+		if (hc->length != length) {
+			hc->length = length;
+			hc->dirty = 1;
+		}
+	}
+
+	return 0;
+}
+
+static int http_cache_fetch(HttpCache *hc, uint8_t *buf, int size) {
+	int n;
+
+	if (!hc->upstream) {
+		int err = http_cache_open_upstream(hc);
+		if (err < 0) {
+			return err;
+		}
+	}
+
+	if (hc->upstream_pos != hc->pos) {
+		int64_t ret = avio_seek(hc->upstream, hc->pos, SEEK_SET);
+		if (ret < 0) {
+			av_log(NULL, AV_LOG_ERROR, "http_cache : upstream seek failure\n");
+			return (int) ret;
+		}
+		hc->upstream_pos = hc->pos;
+	}
+
+	n = avio_read(hc->upstream, buf, size);
+	if (n <= 0) {
+		return n ? n : AVERROR_EOF;
+	}
+
+	hc->upstream_pos += n;
+
+	if (pwrite64(hc->data_fd, buf, n, hc->pos) == n) {
+		http_cache_add_range(hc, hc->pos, hc->pos + n);
+	}
+
+	hc->bytes_from_network += n;
+	return n;
+}
+
+// the whole file is in a single range from 0
+static int http_cache_is_complete(HttpCache *hc) {
+	return hc->length > 0 && 1 == hc->nb_ranges && 0 == hc->ranges[0].start
+			&& hc->ranges[0].end >= hc->length;
+}
+
+static int http_cache_read_packet(void *opaque, uint8_t *buf, int buf_size) {
+	HttpCache *hc = (HttpCache*) opaque;
+	int i = http_cache_find_range(hc, hc->pos);
+	int n;
+
+	if (hc->length >= 0 && hc->pos >= hc->length) {
+		return AVERROR_EOF;
+	}
+
+	if (i >= 0 && hc->pos < hc->ranges[i].end) {
+		n = (int) FFMIN(buf_size, hc->ranges[i].end - hc->pos);
+		n = (int) pread64(hc->data_fd, buf, n, hc->pos);
+		if (n > 0) {
+			hc->bytes_from_cache += n;
+			hc->pos += n;
+			return n;
+		}
+	}
+
+	// fetch up to the next cached range only
+	if (i + 1 < hc->nb_ranges) {
+		buf_size = (int) FFMIN(buf_size, hc->ranges[i + 1].start - hc->pos);
+	}
+
+	n = http_cache_fetch(hc, buf, buf_size);
+	if (n > 0) {
+		hc->pos += n;
+	}
+
+	return n;
+}
+
+static int64_t http_cache_seek(void *opaque, int64_t offset, int whence) {
+	HttpCache *hc = (HttpCache*) opaque;
+	int64_t target;
+
+	if (whence == AVSEEK_SIZE) {
+		if (hc->length < 0 && !hc->upstream) {
+			http_cache_open_upstream(hc);
+		}
+		return hc->length >= 0 ? hc->length : AVERROR(ENOSYS);
+	}
+
+	switch (whence & ~AVSEEK_FORCE) {
+	case SEEK_SET:
+		target = offset;
+		break;
+	case SEEK_CUR:
+		target = hc->pos + offset;
+		break;
+	case SEEK_END:
+		if (hc->length < 0) {
+			return AVERROR(ENOSYS);
+		}
+		target = hc->length + offset;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	if (target < 0) {
+		return AVERROR(EINVAL);
+	}
+
+	// the upstream connection is only moved when a missing range is read
+	hc->pos = target;
+	return target;
+}
+
+HttpCache *http_cache_open(const char *url, const char *cache_dir) {
+	HttpCache *hc;
+	uint8_t md5[16];
+	char name[33];
+	int i;
+
+	hc = (HttpCache*) av_mallocz(sizeof(HttpCache));
+	if (!hc) {
+		return NULL;
+	}
+
+	av_md5_sum(md5, (const uint8_t*) url, strlen(url));
+	for (i = 0; i < 16; i++) {
+		snprintf(name + i * 2, 3, "%02x", md5[i]);
+	}
+
+	av_strlcpy(hc->url, url, sizeof(hc->url));
+	snprintf(hc->data_path, sizeof(hc->data_path), "%s/%s.data", cache_dir,
+			name);
+	snprintf(hc->index_path, sizeof(hc->index_path), "%s/%s.idx", cache_dir,
+			name);
+	hc->length = -1;
+
+	hc->data_fd = open(hc->data_path, O_RDWR | O_CREAT, 0600);
+	if (hc->data_fd < 0) {
+		av_log(NULL, AV_LOG_ERROR, "http_cache : open %s failure, %s\n",
+				hc->data_path, strerror(errno));
+		av_free(hc);
+		return NULL;
+	}
+
+	http_cache_load_index(hc);
+
+	return hc;
+}
+
+AVIOContext *http_cache_alloc_avio(HttpCache *hc) {
+	AVIOContext *avio;
+	uint8_t *buffer;
+
+	buffer = (uint8_t*) av_malloc(HTTP_CACHE_AVIO_BUFFER_SIZE);
+	if (!buffer) {
+		return NULL;
+	}
+
+	avio = avio_alloc_context(buffer, HTTP_CACHE_AVIO_BUFFER_SIZE, 0, hc,
+			http_cache_read_packet, NULL, http_cache_seek);
+	if (!avio) {
+		av_free(buffer);
+		return NULL;
+	}
+
+	// seeks into missing ranges move the upstream connection, so unless
+	// everything is on disk the seekability is the server's
+	if (http_cache_is_complete(hc)) {
+		avio->seekable = AVIO_SEEKABLE_NORMAL;
+	} else if (hc->upstream || http_cache_open_upstream(hc) >= 0) {
+		avio->seekable = hc->upstream->seekable;
+	}
+
+	return avio;
+}
+
+void http_cache_get_stats(HttpCache *hc, int64_t *from_cache,
+		int64_t *from_network) {
+	*from_cache = hc ? hc->bytes_from_cache : 0;
+	*from_network = hc ? hc->bytes_from_network : 0;
+}
+
+void http_cache_close(HttpCache **phc) {
+	HttpCache *hc = *phc;
+	int64_t total;
+
+	if (!hc) {
+		return;
+	}
+
+	total = hc->bytes_from_cache + hc->bytes_from_network;
+	LOGV("http_cache : %" PRId64 " bytes from cache, %" PRId64
+			" from network, hit ratio %d%%", hc->bytes_from_cache,
+			hc->bytes_from_network,
+			total ? (int) (hc->bytes_from_cache * 100 / total) : 0);
+
+	http_cache_save_index(hc);
+
+	if (hc->upstream) {
+		avio_closep(&hc->upstream);
+	}
+
+	close(hc->data_fd);
+	av_freep(&hc->ranges);
+	av_freep(phc);
+}
@@ -0,0 +1,507 @@
+
+#include "player.h"
+
+#include <unistd.h>
+
+#define READAHEAD_ALIGN 4096
+#define READAHEAD_MIN_CHUNK (256 * 1024)
+#define READAHEAD_MAX_CHUNK (4 * 1024 * 1024)
+#define READAHEAD_NB_CHUNKS 4
+#define READAHEAD_AVIO_BUFFER_SIZE (32 * 1024)
+
+// Prefetches a byte range of a file descriptor on a dedicated thread.
+//
+// The ring holds READAHEAD_NB_CHUNKS aligned chunks; the byte at media
+// offset x lives at ring[x % ring_size], so every chunk read lands in one
+// contiguous slot. The I/O thread fills the whole ring in a burst and then
+// sleeps until half of it has been consumed, which leaves the storage idle
+// between bursts instead of issuing many small reads.
+struct ReadAheadContext {
+	int fd;
+	int own_fd;
+	int64_t offset; // start of the media inside fd
+	int64_t length; // size of the media, -1 if unknown
+
+	uint8_t *ring;
+	int ring_size;
+	int chunk_size;
+
+	int64_t pos; // demuxer read position
+	int64_t fill_pos; // end of the prefetched data
+	int64_t base_pos; // start of the prefetched data since the last reset
+	int generation; // bumped on every reset, drops in-flight reads
+
+	int eof;
+	int error;
+	int abort_request;
+
+	// I/O wait accounting, see readahead_get_io_wait()
+	int64_t wait_us;
+	int64_t window_start;
+	int io_wait_ms;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t thread;
+};
+
+static int64_t readahead_free_space(ReadAheadContext *ra) {
+	int64_t used = ra->fill_pos - FFMAX(ra->pos, ra->base_pos);
+	return ra->ring_size - FFMAX(used, 0);
+}
+
+static void* readahead_thread(void *arg) {
+	ReadAheadContext *ra = (ReadAheadContext*) arg;
+
+	pthread_mutex_lock(&ra->mutex);
+
+	while (!ra->abort_request) {
+		// refill only once half of the ring is free, so reads come in bursts
+		if (ra->eof || ra->error
+				|| readahead_free_space(ra) < ra->ring_size / 2) {
+			pthread_cond_wait(&ra->cond, &ra->mutex);
+			continue;
+		}
+
+		while (!ra->abort_request && !ra->eof && !ra->error
+				&& readahead_free_space(ra) >= ra->chunk_size) {
+			int64_t fill_pos = ra->fill_pos;
+			int generation = ra->generation;
+			int size = ra->chunk_size;
+			uint8_t *dst = ra->ring + fill_pos % ra->ring_size;
+			ssize_t n;
+
+			if (ra->length >= 0 && fill_pos + size > ra->length) {
+				size = (int) (ra->length - fill_pos);
+			}
+
+			pthread_mutex_unlock(&ra->mutex);
+
+#ifdef POSIX_FADV_WILLNEED
+			posix_fadvise(ra->fd, ra->offset + fill_pos + size,
+					ra->chunk_size, POSIX_FADV_WILLNEED);
+#endif
+			n = size > 0 ? pread64(ra->fd, dst, size, ra->offset + fill_pos) : 0;
+
+			pthread_mutex_lock(&ra->mutex);
+
+			// a seek reset the ring while we were reading, drop the chunk
+			if (generation != ra->generation) {
+				continue;
+			}
+
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				av_log(NULL, AV_LOG_ERROR, "readahead : pread failure, %s\n",
+						strerror(errno));
+				ra->error = AVERROR(errno);
+			} else {
+				ra->fill_pos += n;
+				if (n < size || n == 0) {
+					ra->eof = 1;
+				}
+			}
+
+			pthread_cond_broadcast(&ra->cond);
+		}
+	}
+
+	pthread_mutex_unlock(&ra->mutex);
+
+	return NULL;
+}
+
+static int readahead_read_packet(void *opaque, uint8_t *buf, int buf_size) {
+	ReadAheadContext *ra = (ReadAheadContext*) opaque;
+	int64_t now, start = 0;
+	int size = 0;
+
+	pthread_mutex_lock(&ra->mutex);
+
+	while (!ra->abort_request && ra->fill_pos <= ra->pos && !ra->eof
+			&& !ra->error) {
+		if (!start) {
+			start = av_gettime_relative();
+		}
+		pthread_cond_wait(&ra->cond, &ra->mutex);
+	}
+
+	now = av_gettime_relative();
+	if (start) {
+		ra->wait_us += now - start;
+	}
+	if (now - ra->window_start >= 1000000) {
+		ra->io_wait_ms = (int) (ra->wait_us * 1000
+				/ (now - ra->window_start));
+		ra->wait_us = 0;
+		ra->window_start = now;
+	}
+
+	if (ra->fill_pos > ra->pos) {
+		int64_t index = ra->pos % ra->ring_size;
+
+		size = (int) FFMIN(buf_size, ra->fill_pos - ra->pos);
+		size = (int) FFMIN(size, ra->ring_size - index);
+		memcpy(buf, ra->ring + index, size);
+		ra->pos += size;
+
+		if (readahead_free_space(ra) >= ra->ring_size / 2) {
+			pthread_cond_broadcast(&ra->cond);
+		}
+	}
+
+	pthread_mutex_unlock(&ra->mutex);
+
+	if (size > 0) {
+		return size;
+	}
+
+	return ra->error ? ra->error : AVERROR_EOF;
+}
+
+static int64_t readahead_seek(void *opaque, int64_t offset, int whence) {
+	ReadAheadContext *ra = (ReadAheadContext*) opaque;
+	int64_t target;
+
+	if (whence == AVSEEK_SIZE) {
+		return ra->length;
+	}
+
+	whence &= ~AVSEEK_FORCE;
+
+	pthread_mutex_lock(&ra->mutex);
+
+	if (whence == SEEK_SET) {
+		target = offset;
+	} else if (whence == SEEK_CUR) {
+		target = ra->pos + offset;
+	} else if (whence == SEEK_END && ra->length >= 0) {
+		target = ra->length + offset;
+	} else {
+		pthread_mutex_unlock(&ra->mutex);
+		return AVERROR(EINVAL);
+	}
+
+	if (target < 0) {
+		pthread_mutex_unlock(&ra->mutex);
+		return AVERROR(EINVAL);
+	}
+
+	// the slot of the chunk being read may alias the oldest ring data,
+	// so only the last ring_size - chunk_size bytes are safe to reuse
+	if (target >= FFMAX(ra->base_pos,
+					ra->fill_pos - ra->ring_size + ra->chunk_size)
+			&& target <= ra->fill_pos) {
+		ra->pos = target;
+	} else {
+		ra->pos = target;
+		ra->base_pos = ra->fill_pos = target - target % ra->chunk_size;
+		ra->generation++;
+		ra->eof = 0;
+		ra->error = 0;
+	}
+
+	pthread_cond_broadcast(&ra->cond);
+	pthread_mutex_unlock(&ra->mutex);
+
+	return target;
+}
+
+ReadAheadContext *readahead_open(int fd, int64_t offset, int64_t length,
+		int chunk_size) {
+	ReadAheadContext *ra;
+
+	ra = (ReadAheadContext*) av_mallocz(sizeof(ReadAheadContext));
+	if (!ra) {
+		return NULL;
+	}
+
+	chunk_size = av_clip(chunk_size, READAHEAD_MIN_CHUNK, READAHEAD_MAX_CHUNK);
+	chunk_size = FFALIGN(chunk_size, READAHEAD_ALIGN);
+
+	ra->fd = fd;
+	ra->offset = offset;
+	ra->length = length;
+	ra->chunk_size = chunk_size;
+	ra->ring_size = chunk_size * READAHEAD_NB_CHUNKS;
+	ra->window_start = av_gettime_relative();
+
+	if (ra->length < 0) {
+		struct stat st;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+			ra->length = st.st_size - offset;
+		}
+	}
+
+	if (posix_memalign((void**) &ra->ring, READAHEAD_ALIGN, ra->ring_size)) {
+		av_log(NULL, AV_LOG_ERROR, "readahead : ring allocation failure.\n");
+		av_free(ra);
+		return NULL;
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, offset, ra->length > 0 ? ra->length : 0,
+			POSIX_FADV_SEQUENTIAL);
+#endif
+
+	pthread_mutex_init(&ra->mutex, NULL);
+	pthread_cond_init(&ra->cond, NULL);
+
+	if (pthread_create(&ra->thread, NULL, readahead_thread, ra)) {
+		av_log(NULL, AV_LOG_ERROR, "readahead : pthread_create failure.\n");
+		pthread_mutex_destroy(&ra->mutex);
+		pthread_cond_destroy(&ra->cond);
+		free(ra->ring);
+		av_free(ra);
+		return NULL;
+	}
+
+	return ra;
+}
+
+ReadAheadContext *readahead_open_file(const char *path, int chunk_size) {
+	ReadAheadContext *ra;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		av_log(NULL, AV_LOG_ERROR, "readahead : open %s failure, %s\n", path,
+				strerror(errno));
+		return NULL;
+	}
+
+	ra = readahead_open(fd, 0, -1, chunk_size);
+	if (!ra) {
+		close(fd);
+		return NULL;
+	}
+
+	ra->own_fd = 1;
+	return ra;
+}
+
+ReadAheadContext *readahead_open_fd(int fd, int64_t offset, int64_t length,
+		int chunk_size) {
+	ReadAheadContext *ra;
+
+	// the caller may close its descriptor once playback has started
+	fd = dup(fd);
+	if (fd < 0) {
+		av_log(NULL, AV_LOG_ERROR, "readahead : dup failure, %s\n",
+				strerror(errno));
+		return NULL;
+	}
+
+	ra = readahead_open(fd, offset, length, chunk_size);
+	if (!ra) {
+		close(fd);
+		return NULL;
+	}
+
+	ra->own_fd = 1;
+	return ra;
+}
+
+AVIOContext *readahead_alloc_avio(ReadAheadContext *ra) {
+	AVIOContext *avio;
+	uint8_t *buffer;
+
+	buffer = (uint8_t*) av_malloc(READAHEAD_AVIO_BUFFER_SIZE);
+	if (!buffer) {
+		return NULL;
+	}
+
+	avio = avio_alloc_context(buffer, READAHEAD_AVIO_BUFFER_SIZE, 0, ra,
+			readahead_read_packet, NULL, readahead_seek);
+	if (!avio) {
+		av_free(buffer);
+		return NULL;
+	}
+
+	avio->seekable = ra->length >= 0 ? AVIO_SEEKABLE_NORMAL : 0;
+
+	return avio;
+}
+
+int readahead_get_io_wait(ReadAheadContext *ra) {
+	return ra ? ra->io_wait_ms : 0;
+}
+
+void readahead_close(ReadAheadContext **pra) {
+	ReadAheadContext *ra = *pra;
+
+	if (!ra) {
+		return;
+	}
+
+	pthread_mutex_lock(&ra->mutex);
+	ra->abort_request = 1;
+	pthread_cond_broadcast(&ra->cond);
+	pthread_mutex_unlock(&ra->mutex);
+
+	pthread_join(ra->thread, NULL);
+
+	pthread_mutex_destroy(&ra->mutex);
+	pthread_cond_destroy(&ra->cond);
+
+	if (ra->own_fd) {
+		close(ra->fd);
+	}
+
+	free(ra->ring);
+	av_freep(pra);
+}
+
+static int memory_read_packet(void *opaque, uint8_t *buf, int buf_size) {
+	MemoryReader *mr = (MemoryReader*) opaque;
+	int size;
+
+	if (mr->pos >= mr->size) {
+		return AVERROR_EOF;
+	}
+
+	size = (int) FFMIN(buf_size, mr->size - mr->pos);
+	memcpy(buf, mr->data + mr->pos, size);
+	mr->pos += size;
+
+	return size;
+}
+
+static int64_t memory_seek(void *opaque, int64_t offset, int whence) {
+	MemoryReader *mr = (MemoryReader*) opaque;
+	int64_t target;
+
+	switch (whence & ~AVSEEK_FORCE) {
+	case AVSEEK_SIZE:
+		return mr->size;
+	case SEEK_SET:
+		target = offset;
+		break;
+	case SEEK_CUR:
+		target = mr->pos + offset;
+		break;
+	case SEEK_END:
+		target = mr->size + offset;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	if (target < 0 || target > mr->size) {
+		return AVERROR(EINVAL);
+	}
+
+	mr->pos = target;
+	return target;
+}
+
+// reads straight from caller owned memory, e.g. a Java direct ByteBuffer;
+// the media is never duplicated, only the AVIOContext buffer is filled
+AVIOContext *memory_alloc_avio(MemoryReader *mr) {
+	AVIOContext *avio;
+	uint8_t *buffer;
+
+	buffer = (uint8_t*) av_malloc(READAHEAD_AVIO_BUFFER_SIZE);
+	if (!buffer) {
+		return NULL;
+	}
+
+	avio = avio_alloc_context(buffer, READAHEAD_AVIO_BUFFER_SIZE, 0, mr,
+			memory_read_packet, NULL, memory_seek);
+	if (!avio) {
+		av_free(buffer);
+		return NULL;
+	}
+
+	avio->seekable = AVIO_SEEKABLE_NORMAL;
+
+	return avio;
+}
+
+// frees a custom AVIOContext allocated by one of the *_alloc_avio() helpers
+void custom_avio_free(AVIOContext **pavio) {
+	if (*pavio) {
+		av_freep(&(*pavio)->buffer);
+		av_freep(pavio);
+	}
+}
+
+// local files are read through the read-ahead I/O thread
+static int is_local_file(const char *url) {
+	return av_strstart(url, "file:", NULL) || !strstr(url, "://");
+}
+
+/**
+ * Installs the custom AVIOContext matching src on fmt_ctx.
+ *
+ * @param io     I/O state, released by media_io_close(). [OUT]
+ * @param src    media to open. [IN]
+ * @param fmt_ctx format context, not opened yet. [IN/OUT]
+ * @param url    name to pass to avformat_open_input(). [OUT]
+ * @return 0 on success, < 0 on failure
+ */
+int media_io_open(MediaIO *io, const MediaSource *src,
+		AVFormatContext *fmt_ctx, const char **url) {
+	memset(io, 0, sizeof(MediaIO));
+
+	*url = "";
+
+	switch (src->type) {
+	case MEDIA_SOURCE_URL:
+		if (!is_local_file(src->url)) {
+			*url = src->url;
+
+			player_network_init();
+
+			// without a cache directory the protocol streams directly
+			if (!global_context.cache_dir[0]
+					|| !av_strstart(src->url, "http", NULL)) {
+				return 0;
+			}
+
+			io->http_cache = http_cache_open(src->url,
+					global_context.cache_dir);
+			if (io->http_cache) {
+				io->avio = http_cache_alloc_avio(io->http_cache);
+			}
+			break;
+		}
+
+		av_strstart(src->url, "file:", url);
+		io->readahead = readahead_open_file(*url, global_context.io_chunk_size);
+		break;
+	case MEDIA_SOURCE_FD:
+		io->readahead = readahead_open_fd(src->fd, src->offset, src->length,
+				global_context.io_chunk_size);
+		break;
+	case MEDIA_SOURCE_MEMORY:
+		io->memory.data = src->data;
+		io->memory.size = src->size;
+		io->avio = memory_alloc_avio(&io->memory);
+		break;
+	}
+
+	if (io->readahead) {
+		io->avio = readahead_alloc_avio(io->readahead);
+	}
+
+	if (!io->avio) {
+		av_log(NULL, AV_LOG_ERROR, "media_io_open : custom io failure. \n");
+		media_io_close(io);
+		return -1;
+	}
+
+	fmt_ctx->pb = io->avio;
+	fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	return 0;
+}
+
+// call after avformat_close_input()
+void media_io_close(MediaIO *io) {
+	custom_avio_free(&io->avio);
+	readahead_close(&io->readahead);
+	http_cache_close(&io->http_cache);
+}
@@ -0,0 +1,780 @@
+
+#include "player.h"
+
+#include <math.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define LOUDNESS_CACHE_MAGIC MKTAG('F', 'O', 'L', 'C')
+#define LOUDNESS_CACHE_VERSION 1
+#define LOUDNESS_MAX_THREADS 8
+#define LOUDNESS_NICE 10
+#define LOUDNESS_MAX_CHANNELS 8
+
+// bytes decoded per step, a multiple of any frame size
+#define LOUDNESS_DECODE_CHUNK (4096 * 8)
+
+// block loudness is binned by 0.1 LU from the -70 LUFS absolute gate to +5
+#define HIST_MIN -70.0
+#define HIST_STEP 0.1
+#define HIST_BINS 750
+
+// energies are kept per 100 ms; gating blocks span 400 ms, short-term
+// blocks for the loudness range 3 s, both advancing by 100 ms
+#define SUBBLOCK_MS 100
+#define MOMENTARY_SUBBLOCKS 4
+#define SHORT_TERM_SUBBLOCKS 30
+
+// taps per phase of the true peak interpolator
+#define TRUE_PEAK_TAPS 12
+
+typedef struct LoudnessHist {
+	uint32_t count[HIST_BINS];
+	double energy[HIST_BINS];
+} LoudnessHist;
+
+// Measurement of one track after ITU-R BS.1770-4 and EBU Tech 3342: the
+// channels are K-weighted, their mean squares summed with the surround
+// channels weighted by 1.41, and the loudness of every block counted in a
+// histogram. Gating then only needs the histogram, which is also what an
+// album sums over its tracks.
+typedef struct LoudnessState {
+	int channels;
+	float weight[LOUDNESS_MAX_CHANNELS];
+	float shelf[5];
+	float high_pass[5];
+	float z[LOUDNESS_MAX_CHANNELS][2][4];
+
+	int subblock_len; // frames per 100 ms
+	int subblock_pos;
+	double subblock_sum;
+	double ring[SHORT_TERM_SUBBLOCKS]; // mean squares of the last subblocks
+	int64_t nb_subblocks;
+
+	// polyphase interpolator, coefficients reversed for dsp_dot()
+	int oversample;
+	float phase[4][TRUE_PEAK_TAPS];
+	float phase_gain; // bound of an interpolated sample over its inputs
+	float tail[LOUDNESS_MAX_CHANNELS][TRUE_PEAK_TAPS - 1];
+	float peak;
+
+	LoudnessHist momentary;
+	LoudnessHist short_term;
+} LoudnessState;
+
+typedef struct LoudnessRecord {
+	uint8_t key[16]; // md5 of the path
+	uint8_t album_key[16]; // md5 of the keys of the album, 0 without one
+	int64_t file_size;
+	int64_t file_mtime;
+	LoudnessResult result;
+} LoudnessRecord;
+
+typedef struct LoudnessCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	int32_t nb_records;
+	int32_t reserved;
+} LoudnessCacheHeader;
+
+typedef struct LoudnessScan {
+	const char **paths;
+	const int *albums;
+	LoudnessResult *results;
+
+	LoudnessHist *album_hists; // momentary and short-term of each album
+	float *album_peaks;
+
+	int *todo;
+	int nb_todo;
+	int next;
+	int nb_scanned;
+	int64_t cpu_us;
+	int cancel_serial; // the global one when the scan started
+	pthread_mutex_t mutex;
+} LoudnessScan;
+
+// bumped to cancel the scans running, never by the player
+static volatile int cancel_serial;
+
+static inline double energy_to_lufs(double energy) {
+	return -0.691 + 10 * log10(energy);
+}
+
+static void hist_add(LoudnessHist *h, double energy) {
+	double lufs;
+	int bin;
+
+	if (energy <= 0 || (lufs = energy_to_lufs(energy)) < HIST_MIN) {
+		return;
+	}
+
+	bin = FFMIN((int) ((lufs - HIST_MIN) / HIST_STEP), HIST_BINS - 1);
+	h->count[bin]++;
+	h->energy[bin] += energy;
+}
+
+static void hist_merge(LoudnessHist *dst, const LoudnessHist *src) {
+	int i;
+
+	for (i = 0; i < HIST_BINS; i++) {
+		dst->count[i] += src->count[i];
+		dst->energy[i] += src->energy[i];
+	}
+}
+
+// first bin of the blocks at most gate LU below their mean, -1 if empty
+static int hist_gate(const LoudnessHist *h, double gate) {
+	double energy = 0;
+	int64_t count = 0;
+	int i;
+
+	for (i = 0; i < HIST_BINS; i++) {
+		count += h->count[i];
+		energy += h->energy[i];
+	}
+
+	if (!count) {
+		return -1;
+	}
+
+	i = (int) lrint((energy_to_lufs(energy / count) - gate - HIST_MIN)
+			/ HIST_STEP);
+	return av_clip(i, 0, HIST_BINS - 1);
+}
+
+// integrated loudness of the gating blocks, -70 for silence
+static float hist_integrated(const LoudnessHist *h) {
+	double energy = 0;
+	int64_t count = 0;
+	int i = hist_gate(h, 10);
+
+	for (; i >= 0 && i < HIST_BINS; i++) {
+		count += h->count[i];
+		energy += h->energy[i];
+	}
+
+	return count ? (float) energy_to_lufs(energy / count) : (float) HIST_MIN;
+}
+
+// spread between the 10th and 95th percentiles of the short-term loudness
+static float hist_range(const LoudnessHist *h) {
+	int64_t count = 0, sum = 0;
+	int first = hist_gate(h, 20), lo = -1, hi = -1, i;
+
+	if (first < 0) {
+		return 0;
+	}
+
+	for (i = first; i < HIST_BINS; i++) {
+		count += h->count[i];
+	}
+
+	for (i = first; i < HIST_BINS && hi < 0; i++) {
+		sum += h->count[i];
+		if (lo < 0 && sum * 10 >= count) {
+			lo = i;
+		}
+		if (sum * 20 >= count * 19) {
+			hi = i;
+		}
+	}
+
+	return (float) ((hi - lo) * HIST_STEP);
+}
+
+static inline float peak_to_db(float peak) {
+	return peak > 0 ? FFMAX(20 * log10f(peak), (float) HIST_MIN) :
+			(float) HIST_MIN;
+}
+
+// windowed sinc interpolator, 4x below 96 kHz and 2x below 192 kHz
+static void true_peak_init(LoudnessState *s, int rate) {
+	int len, n, p, k;
+	double center;
+
+	s->oversample = rate < 96000 ? 4 : rate < 192000 ? 2 : 1;
+	s->phase_gain = 1;
+	if (s->oversample == 1) {
+		return;
+	}
+
+	len = s->oversample * TRUE_PEAK_TAPS;
+	center = (len - 1) / 2.0;
+	for (p = 0; p < s->oversample; p++) {
+		double sum = 0, abs_sum = 0;
+		float h[TRUE_PEAK_TAPS];
+
+		for (k = 0; k < TRUE_PEAK_TAPS; k++) {
+			double t = (k * s->oversample + p - center) / s->oversample;
+			n = k * s->oversample + p;
+			h[k] = (float) ((t ? sin(M_PI * t) / (M_PI * t) : 1)
+					* (0.5 - 0.5 * cos(2 * M_PI * (n + 0.5) / len)));
+			sum += h[k];
+		}
+
+		// unity gain at DC, newest sample last to match the history order
+		for (k = 0; k < TRUE_PEAK_TAPS; k++) {
+			s->phase[p][TRUE_PEAK_TAPS - 1 - k] = (float) (h[k] / sum);
+			abs_sum += fabs(h[k] / sum);
+		}
+		s->phase_gain = FFMAX(s->phase_gain, (float) abs_sum);
+	}
+}
+
+static void loudness_state_init(LoudnessState *s, int rate, int channels,
+		uint64_t layout) {
+	int ch = 0, bit;
+
+	memset(s, 0, sizeof(LoudnessState));
+
+	s->channels = channels;
+	s->subblock_len = rate * SUBBLOCK_MS / 1000;
+
+	for (bit = 0; bit < 64 && ch < channels; bit++) {
+		uint64_t c = UINT64_C(1) << bit;
+		if (!(layout & c)) {
+			continue;
+		}
+		if (c == AV_CH_LOW_FREQUENCY || c == AV_CH_LOW_FREQUENCY_2) {
+			s->weight[ch] = 0;
+		} else if (c == AV_CH_SIDE_LEFT || c == AV_CH_SIDE_RIGHT
+				|| c == AV_CH_BACK_LEFT || c == AV_CH_BACK_RIGHT) {
+			s->weight[ch] = 1.41f;
+		} else {
+			s->weight[ch] = 1;
+		}
+		ch++;
+	}
+	for (; ch < channels; ch++) {
+		s->weight[ch] = 1;
+	}
+
+	k_weighting_init(rate, s->shelf, s->high_pass);
+	true_peak_init(s, rate);
+}
+
+static void loudness_subblock_end(LoudnessState *s) {
+	double sum = 0;
+	int i;
+
+	s->ring[s->nb_subblocks % SHORT_TERM_SUBBLOCKS] = s->subblock_sum
+			/ s->subblock_len;
+	s->nb_subblocks++;
+	s->subblock_sum = 0;
+	s->subblock_pos = 0;
+
+	for (i = 1; i <= SHORT_TERM_SUBBLOCKS && i <= s->nb_subblocks; i++) {
+		sum += s->ring[(s->nb_subblocks - i) % SHORT_TERM_SUBBLOCKS];
+		if (i == MOMENTARY_SUBBLOCKS) {
+			hist_add(&s->momentary, sum / MOMENTARY_SUBBLOCKS);
+		}
+	}
+	if (s->nb_subblocks >= SHORT_TERM_SUBBLOCKS) {
+		hist_add(&s->short_term, sum / SHORT_TERM_SUBBLOCKS);
+	}
+}
+
+// true peak of one channel; x is preceded by TRUE_PEAK_TAPS - 1 samples
+static void loudness_true_peak(LoudnessState *s, const float *x,
+		int nb_frames) {
+	float max = 0;
+	int i, p;
+
+	for (i = -(TRUE_PEAK_TAPS - 1); i < nb_frames; i++) {
+		max = FFMAX(max, fabsf(x[i]));
+	}
+	s->peak = FFMAX(s->peak, max);
+
+	// interpolation can only pass the sample peak by phase_gain
+	if (s->oversample == 1 || max * s->phase_gain <= s->peak) {
+		return;
+	}
+
+	for (i = 0; i < nb_frames; i++) {
+		const float *window = x + i - (TRUE_PEAK_TAPS - 1);
+		for (p = 0; p < s->oversample; p++) {
+			s->peak = FFMAX(s->peak,
+					fabsf(dsp_dot(window, s->phase[p], TRUE_PEAK_TAPS)));
+		}
+	}
+}
+
+/**
+ * Measures nb_frames of interleaved float PCM.
+ *
+ * @param planes  scratch of channels * (TRUE_PEAK_TAPS - 1 + nb_frames)
+ */
+static void loudness_process(LoudnessState *s, const float *buf,
+		int nb_frames, float *planes) {
+	int stride = TRUE_PEAK_TAPS - 1 + nb_frames;
+	int ch, i, pos, n;
+
+	for (ch = 0; ch < s->channels; ch++) {
+		float *plane = planes + ch * stride;
+		float *x = plane + TRUE_PEAK_TAPS - 1;
+
+		for (i = 0; i < nb_frames; i++) {
+			x[i] = buf[i * s->channels + ch];
+		}
+
+		memcpy(plane, s->tail[ch], sizeof(s->tail[ch]));
+		loudness_true_peak(s, x, nb_frames);
+		memcpy(s->tail[ch], plane + nb_frames, sizeof(s->tail[ch]));
+
+		dsp_biquad(x, nb_frames, 1, s->shelf, s->z[ch][0]);
+		dsp_biquad(x, nb_frames, 1, s->high_pass, s->z[ch][1]);
+	}
+
+	for (pos = 0; pos < nb_frames; pos += n) {
+		n = FFMIN(nb_frames - pos, s->subblock_len - s->subblock_pos);
+		for (ch = 0; ch < s->channels; ch++) {
+			const float *x = planes + ch * stride + TRUE_PEAK_TAPS - 1 + pos;
+			if (s->weight[ch] > 0) {
+				s->subblock_sum += s->weight[ch] * dsp_dot(x, x, n);
+			}
+		}
+
+		s->subblock_pos += n;
+		if (s->subblock_pos == s->subblock_len) {
+			loudness_subblock_end(s);
+		}
+	}
+}
+
+static int loudness_interrupt_cb(void *opaque) {
+	return ((LoudnessScan*) opaque)->cancel_serial != cancel_serial;
+}
+
+/**
+ * Decodes path whole through the player's decoder and measures it into s.
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int loudness_scan_file(LoudnessScan *scan, const char *path,
+		LoudnessState *s) {
+	AVFormatContext *fmt_ctx = NULL;
+	AVCodecContext *avctx;
+	PacketQueue queue;
+	AudioDecoder dec;
+	AudioParams tgt;
+	AVPacket pkt;
+	uint8_t *buf = NULL;
+	float *planes = NULL;
+	int stream_index, channels, ret = -1;
+	uint64_t layout;
+
+	packet_queue_init(&queue);
+	memset(&dec, 0, sizeof(AudioDecoder));
+
+	fmt_ctx = avformat_alloc_context();
+	if (!fmt_ctx) {
+		goto end;
+	}
+	fmt_ctx->interrupt_callback.callback = loudness_interrupt_cb;
+	fmt_ctx->interrupt_callback.opaque = scan;
+
+	if (avformat_open_input(&fmt_ctx, path, NULL, NULL) < 0) {
+		av_log(NULL, AV_LOG_ERROR, "loudness : cannot open %s\n", path);
+		goto end;
+	}
+
+	if (avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+		goto end;
+	}
+
+	stream_index = find_audio_stream(fmt_ctx);
+	if (-1 == stream_index
+			|| open_audio_decoder(fmt_ctx, stream_index, true) < 0) {
+		goto end;
+	}
+
+	// measured at the source rate and layout, wider ones are downmixed
+	avctx = fmt_ctx->streams[stream_index]->codec;
+	channels = avctx->channels;
+	layout = avctx->channel_layout;
+	if (!layout || av_get_channel_layout_nb_channels(layout) != channels) {
+		layout = av_get_default_channel_layout(channels);
+	}
+	if (channels > LOUDNESS_MAX_CHANNELS || layout > UINT_MAX) {
+		channels = 2;
+		layout = AV_CH_LAYOUT_STEREO;
+	}
+	if (channels <= 0 || avctx->sample_rate <= 0) {
+		goto end;
+	}
+
+	tgt.fmt = AV_SAMPLE_FMT_FLT;
+	tgt.freq = avctx->sample_rate;
+	tgt.channels = channels;
+	tgt.channel_layout = (unsigned int) layout;
+	tgt.frame_size = av_samples_get_buffer_size(NULL, channels, 1, tgt.fmt, 1);
+	tgt.bytes_per_sec = tgt.freq * tgt.frame_size;
+
+	buf = (uint8_t*) av_malloc(LOUDNESS_DECODE_CHUNK);
+	planes = (float*) av_malloc_array(channels,
+			(TRUE_PEAK_TAPS - 1 + LOUDNESS_DECODE_CHUNK / tgt.frame_size)
+					* sizeof(float));
+	if (!buf || !planes) {
+		goto end;
+	}
+
+	loudness_state_init(s, tgt.freq, channels, layout);
+	audio_decoder_init(&dec, avctx, fmt_ctx->streams[stream_index], &queue,
+			&tgt);
+
+	for (;;) {
+		ret = audio_decoder_read(&dec, buf, LOUDNESS_DECODE_CHUNK);
+		if (ret > 0) {
+			loudness_process(s, (const float*) buf, ret / tgt.frame_size,
+					planes);
+			continue;
+		} else if (ret < 0 || loudness_interrupt_cb(scan)) {
+			break;
+		}
+
+		// the decoder needs another packet
+		if (av_read_frame(fmt_ctx, &pkt) < 0) {
+			dec.eof = 1;
+		} else if (pkt.stream_index == stream_index) {
+			packet_queue_put(&queue, &pkt);
+		} else {
+			av_free_packet(&pkt);
+		}
+	}
+
+	ret = loudness_interrupt_cb(scan) ? -1 : 0;
+
+	end:
+
+	av_free(buf);
+	av_free(planes);
+	audio_decoder_destroy(&dec);
+	packet_queue_destroy(&queue);
+	if (fmt_ctx) {
+		avformat_close_input(&fmt_ctx);
+	}
+
+	return ret;
+}
+
+static void* loudness_thread(void *arg) {
+	LoudnessScan *scan = (LoudnessScan*) arg;
+	LoudnessState *s;
+	int64_t cpu = get_thread_cpu_time();
+	int i, album;
+
+	// a library scan must not starve playback
+	setpriority(PRIO_PROCESS, syscall(__NR_gettid), LOUDNESS_NICE);
+
+	s = (LoudnessState*) av_malloc(sizeof(LoudnessState));
+	if (!s) {
+		return NULL;
+	}
+
+	while (!loudness_interrupt_cb(scan)) {
+		pthread_mutex_lock(&scan->mutex);
+		i = scan->next < scan->nb_todo ? scan->todo[scan->next++] : -1;
+		pthread_mutex_unlock(&scan->mutex);
+
+		if (i < 0) {
+			break;
+		}
+
+		if (loudness_scan_file(scan, scan->paths[i], s) < 0) {
+			continue;
+		}
+
+		pthread_mutex_lock(&scan->mutex);
+		scan->results[i].integrated = hist_integrated(&s->momentary);
+		scan->results[i].range = hist_range(&s->short_term);
+		scan->results[i].true_peak = peak_to_db(s->peak);
+		album = scan->albums ? scan->albums[i] : -1;
+		if (album >= 0) {
+			hist_merge(&scan->album_hists[album * 2], &s->momentary);
+			hist_merge(&scan->album_hists[album * 2 + 1], &s->short_term);
+			scan->album_peaks[album] = FFMAX(scan->album_peaks[album],
+					s->peak);
+		}
+		scan->nb_scanned++;
+		pthread_mutex_unlock(&scan->mutex);
+	}
+
+	av_free(s);
+
+	pthread_mutex_lock(&scan->mutex);
+	scan->cpu_us += get_thread_cpu_time() - cpu;
+	pthread_mutex_unlock(&scan->mutex);
+
+	return NULL;
+}
+
+static int record_cmp(const void *a, const void *b) {
+	return memcmp(((const LoudnessRecord*) a)->key,
+			((const LoudnessRecord*) b)->key, 16);
+}
+
+// records of the cache at path, sorted by key
+static LoudnessRecord *loudness_cache_load(const char *path,
+		int *nb_records) {
+	LoudnessCacheHeader header;
+	LoudnessRecord *records = NULL;
+	int fd;
+
+	*nb_records = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	if (read(fd, &header, sizeof(header)) == sizeof(header)
+			&& header.magic == LOUDNESS_CACHE_MAGIC
+			&& header.version == LOUDNESS_CACHE_VERSION
+			&& header.nb_records > 0
+			&& header.nb_records < INT_MAX / (int) sizeof(LoudnessRecord)) {
+		size_t size = header.nb_records * sizeof(LoudnessRecord);
+
+		records = (LoudnessRecord*) av_malloc(size);
+		if (records && read(fd, records, size) == (ssize_t) size) {
+			*nb_records = header.nb_records;
+		} else {
+			av_freep(&records);
+		}
+	}
+
+	close(fd);
+	return records;
+}
+
+static void loudness_cache_save(const char *path,
+		const LoudnessRecord *records, int nb_records) {
+	LoudnessCacheHeader header = { 0 };
+	char tmp_path[1040];
+	size_t size = nb_records * sizeof(LoudnessRecord);
+	int fd;
+
+	header.magic = LOUDNESS_CACHE_MAGIC;
+	header.version = LOUDNESS_CACHE_VERSION;
+	header.nb_records = nb_records;
+
+	// write aside and rename, so a crash never leaves a torn cache
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		return;
+	}
+
+	if (write(fd, &header, sizeof(header)) == sizeof(header)
+			&& write(fd, records, size) == (ssize_t) size) {
+		fsync(fd);
+		close(fd);
+		rename(tmp_path, path);
+	} else {
+		close(fd);
+		unlink(tmp_path);
+	}
+}
+
+/**
+ * Measures the integrated loudness, loudness range and true peak of every
+ * path, and of the albums they belong to, on a pool of worker threads.
+ *
+ * Results are kept in the cache at cache_path, keyed by path and checked
+ * against the file size and mtime. An album is measured again whole when
+ * any of its tracks is missing from the cache or changed.
+ *
+ * @param albums   album of each path from 0, -1 for none; NULL for none
+ * @param results  nb_paths entries, NAN for the tracks that failed
+ * @return the number of tracks measured, cached ones included
+ */
+int loudness_scan(const char **paths, const int *albums, int nb_paths,
+		const char *cache_path, LoudnessResult *results) {
+	LoudnessScan scan;
+	LoudnessRecord *cached = NULL, *records = NULL, *rec;
+	uint8_t (*album_keys)[16] = NULL;
+	int *album_cached = NULL;
+	pthread_t threads[LOUDNESS_MAX_THREADS];
+	int nb_cached = 0, nb_albums = 0, nb_threads, nb_records = 0;
+	int64_t t = av_gettime_relative();
+	int i, j, ret = -1;
+	double wall;
+
+	memset(&scan, 0, sizeof(scan));
+	scan.paths = paths;
+	scan.albums = albums;
+	scan.results = results;
+	scan.cancel_serial = cancel_serial;
+	pthread_mutex_init(&scan.mutex, NULL);
+
+	for (i = 0; albums && i < nb_paths; i++) {
+		nb_albums = FFMAX(nb_albums, albums[i] + 1);
+	}
+
+	records = (LoudnessRecord*) av_mallocz_array(FFMAX(nb_paths, 1),
+			sizeof(LoudnessRecord));
+	scan.todo = (int*) av_malloc_array(FFMAX(nb_paths, 1), sizeof(int));
+	scan.album_hists = (LoudnessHist*) av_mallocz_array(nb_albums * 2 + 1,
+			sizeof(LoudnessHist));
+	scan.album_peaks = (float*) av_mallocz_array(nb_albums + 1,
+			sizeof(float));
+	album_keys = (uint8_t (*)[16]) av_mallocz_array(nb_albums + 1, 16);
+	album_cached = (int*) av_malloc_array(nb_albums + 1, sizeof(int));
+	if (!records || !scan.todo || !scan.album_hists || !scan.album_peaks
+			|| !album_keys || !album_cached) {
+		goto end;
+	}
+
+	if (cache_path) {
+		cached = loudness_cache_load(cache_path, &nb_cached);
+	}
+
+	// identity of every path, and of every album as the keys of its tracks
+	for (i = 0; i < nb_paths; i++) {
+		struct stat st;
+
+		av_md5_sum(records[i].key, (const uint8_t*) paths[i],
+				strlen(paths[i]));
+		if (!stat(paths[i], &st)) {
+			records[i].file_size = st.st_size;
+			records[i].file_mtime = st.st_mtime;
+		}
+		results[i].integrated = results[i].range = results[i].true_peak = NAN;
+	}
+
+	for (j = 0; j < nb_albums; j++) {
+		AVMD5 *md5 = av_md5_alloc();
+		if (!md5) {
+			goto end;
+		}
+		av_md5_init(md5);
+		for (i = 0; i < nb_paths; i++) {
+			if (albums[i] == j) {
+				av_md5_update(md5, records[i].key, 16);
+			}
+		}
+		av_md5_final(md5, album_keys[j]);
+		av_free(md5);
+		album_cached[j] = 1;
+	}
+
+	// look every track up, an album is reused only when all of it is
+	for (i = 0; i < nb_paths; i++) {
+		int album = albums ? albums[i] : -1;
+
+		if (album >= 0) {
+			memcpy(records[i].album_key, album_keys[album], 16);
+		}
+
+		rec = (LoudnessRecord*) bsearch(&records[i], cached, nb_cached,
+				sizeof(LoudnessRecord), record_cmp);
+		if (rec && rec->file_size == records[i].file_size
+				&& rec->file_mtime == records[i].file_mtime
+				&& !memcmp(rec->album_key, records[i].album_key, 16)) {
+			results[i] = rec->result;
+		} else if (album >= 0) {
+			album_cached[album] = 0;
+		} else {
+			scan.todo[scan.nb_todo++] = i;
+		}
+	}
+
+	for (i = 0; i < nb_paths; i++) {
+		if (albums && albums[i] >= 0 && !album_cached[albums[i]]) {
+			results[i].integrated = results[i].range = NAN;
+			results[i].true_peak = NAN;
+			scan.todo[scan.nb_todo++] = i;
+		}
+	}
+
+	nb_threads = av_clip((int) sysconf(_SC_NPROCESSORS_ONLN), 1,
+			LOUDNESS_MAX_THREADS);
+	nb_threads = FFMIN(nb_threads, scan.nb_todo);
+	for (i = 0; i < nb_threads; i++) {
+		if (pthread_create(&threads[i], NULL, loudness_thread, &scan)) {
+			av_log(NULL, AV_LOG_ERROR, "loudness : pthread_create failure.\n");
+			break;
+		}
+	}
+	nb_threads = i;
+
+	for (i = 0; i < nb_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	wall = (av_gettime_relative() - t) / 1000000.0;
+	if (scan.nb_scanned) {
+		global_context.loudness_files_per_core = (float) (scan.nb_scanned
+				/ (wall * FFMAX(nb_threads, 1)));
+		LOGV("loudness : %d files in %.2f s on %d threads, %.2f files/s "
+				"per core, %lld us CPU", scan.nb_scanned, wall, nb_threads,
+				global_context.loudness_files_per_core,
+				(long long) scan.cpu_us);
+	}
+
+	// album results of the measured albums, and the cache entries
+	ret = 0;
+	for (i = 0; i < nb_paths; i++) {
+		int album = albums ? albums[i] : -1;
+
+		if (album >= 0 && !album_cached[album]) {
+			results[i].album_integrated = hist_integrated(
+					&scan.album_hists[album * 2]);
+			results[i].album_range = hist_range(
+					&scan.album_hists[album * 2 + 1]);
+			results[i].album_true_peak = peak_to_db(scan.album_peaks[album]);
+		} else if (album < 0) {
+			results[i].album_integrated = results[i].integrated;
+			results[i].album_range = results[i].range;
+			results[i].album_true_peak = results[i].true_peak;
+		}
+
+		if (!isnan(results[i].integrated)) {
+			records[i].result = results[i];
+			records[nb_records++] = records[i];
+			ret++;
+		}
+	}
+
+	if (cache_path && scan.nb_scanned) {
+		LoudnessRecord *merged;
+		int n = 0;
+
+		// the fresh records replace the cached ones with the same key
+		qsort(records, nb_records, sizeof(LoudnessRecord), record_cmp);
+		merged = (LoudnessRecord*) av_malloc_array(nb_cached + nb_records,
+				sizeof(LoudnessRecord));
+		if (merged) {
+			for (i = j = 0; i < nb_cached || j < nb_records;) {
+				int cmp = i == nb_cached ? 1 : j == nb_records ? -1 :
+						record_cmp(&cached[i], &records[j]);
+				if (cmp < 0) {
+					merged[n++] = cached[i++];
+				} else {
+					merged[n++] = records[j++];
+					i += !cmp;
+				}
+			}
+			loudness_cache_save(cache_path, merged, n);
+			av_free(merged);
+		}
+	}
+
+	end:
+
+	av_free(cached);
+	av_free(records);
+	av_free(scan.todo);
+	av_free(scan.album_hists);
+	av_free(scan.album_peaks);
+	av_free(album_keys);
+	av_free(album_cached);
+	pthread_mutex_destroy(&scan.mutex);
+
+	return ret;
+}
+
+// makes the scans running return early, the tracks not measured yet NAN
+void loudness_scan_cancel() {
+	__sync_fetch_and_add(&cancel_serial, 1);
+}
@@ -0,0 +1,420 @@
+
+#include "player.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define METADATA_TABLE_MAGIC MKTAG('F', 'O', 'M', 'T')
+#define METADATA_TABLE_VERSION 1
+#define METADATA_MAX_THREADS 8
+#define METADATA_NICE 10
+
+// enough for the container header of anything with a usable header; tags
+// such as ID3v2 are read whole regardless
+#define METADATA_PROBESIZE (32 * 1024)
+#define METADATA_ANALYZE_DURATION (AV_TIME_BASE / 10)
+
+// pictures parsed out of tags are searched for in the file by this many
+// of their leading bytes, within the first METADATA_COVER_SEARCH bytes
+#define METADATA_COVER_KEY 64
+#define METADATA_COVER_SEARCH (16 * 1024 * 1024)
+#define METADATA_COVER_CHUNK (64 * 1024)
+
+enum MetadataFlags {
+	METADATA_OK = 1, // the file was opened
+	METADATA_DURATION_ESTIMATED = 2, // from the bitrate and file size
+	METADATA_PROBED = 4, // the header was incomplete, packets were read
+	METADATA_HAS_COVER = 8,
+	METADATA_COVER_UNLOCATED = 16, // the picture is not stored verbatim
+};
+
+// The table written by metadata_scan(), in native byte order:
+//   MetadataTableHeader | MetadataRecord[nb_records] | strings
+// Records are in the order of the scanned paths. Strings are UTF-8 and
+// NUL terminated, referenced by their offset from the start of the
+// strings; offset 0 is the empty string.
+typedef struct MetadataTableHeader {
+	uint32_t magic;
+	uint32_t version;
+	int32_t nb_records;
+	int32_t strings_size;
+} MetadataTableHeader;
+
+typedef struct MetadataRecord {
+	int64_t duration; // microseconds, -1 unknown
+	int64_t cover_offset; // byte offset of the attached picture, -1 unknown
+	int32_t cover_size; // bytes, 0 without one
+	int32_t bit_rate; // bits per second, 0 unknown
+	int32_t sample_rate;
+	int16_t channels;
+	int16_t flags; // MetadataFlags
+	uint32_t codec; // string offsets
+	uint32_t title;
+	uint32_t artist;
+	uint32_t album;
+} MetadataRecord;
+
+// record of a path before its strings are moved into the table
+typedef struct MetadataEntry {
+	MetadataRecord record;
+	char *strings[4]; // codec, title, artist, album
+} MetadataEntry;
+
+typedef struct MetadataScan {
+	const char **paths;
+	MetadataEntry *entries;
+	int nb_paths;
+	int next;
+	int nb_read;
+	int cancel_serial; // the global one when the scan started
+	pthread_mutex_t mutex;
+} MetadataScan;
+
+// bumped to cancel the scans running, never by the player
+static volatile int cancel_serial;
+
+static int metadata_interrupt_cb(void *opaque) {
+	return ((MetadataScan*) opaque)->cancel_serial != cancel_serial;
+}
+
+// a container tag, or the one of the stream for formats keeping them there
+static char *metadata_tag(AVFormatContext *fmt_ctx, AVStream *st,
+		const char *key) {
+	AVDictionaryEntry *tag = av_dict_get(fmt_ctx->metadata, key, NULL, 0);
+
+	if (!tag) {
+		tag = av_dict_get(st->metadata, key, NULL, 0);
+	}
+
+	return tag && tag->value[0] ? av_strdup(tag->value) : NULL;
+}
+
+/**
+ * Finds the byte offset of an attached picture the demuxer copied out of a
+ * tag, ID3v2 APIC and FLAC PICTURE, whose packet has no position. Both
+ * store the image as is, unless the ID3v2 tag is unsynchronised.
+ *
+ * @return the offset, -1 if it is not found
+ */
+static int64_t metadata_find_cover(AVIOContext *pb, const AVPacket *pic) {
+	int key = FFMIN(pic->size, METADATA_COVER_KEY);
+	int64_t base = 0, found = -1;
+	int kept = 0, n;
+	uint8_t *buf, *p;
+
+	if (key <= 0 || avio_seek(pb, 0, SEEK_SET) < 0) {
+		return -1;
+	}
+
+	buf = (uint8_t*) av_malloc(METADATA_COVER_CHUNK + METADATA_COVER_KEY);
+	if (!buf) {
+		return -1;
+	}
+
+	while (base < METADATA_COVER_SEARCH) {
+		n = avio_read(pb, buf + kept, METADATA_COVER_CHUNK);
+		if (n <= 0) {
+			break;
+		}
+		n += kept;
+
+		p = (uint8_t*) memmem(buf, n, pic->data, key);
+		if (p) {
+			found = base + (p - buf);
+			break;
+		}
+
+		// a match may straddle two reads
+		kept = FFMIN(n, key - 1);
+		memmove(buf, buf + n - kept, kept);
+		base += n - kept;
+	}
+
+	av_free(buf);
+	return found;
+}
+
+/**
+ * Reads the container header of path into e, without opening a decoder.
+ * Only headers that leave the audio parameters unknown are probed, within
+ * METADATA_PROBESIZE.
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int metadata_read(MetadataScan *scan, const char *path,
+		MetadataEntry *e) {
+	MetadataRecord *rec = &e->record;
+	AVFormatContext *fmt_ctx;
+	AVCodecParameters *par;
+	AVStream *st;
+	int64_t size;
+	unsigned int i;
+	int stream_index, ret = -1;
+
+	fmt_ctx = avformat_alloc_context();
+	if (!fmt_ctx) {
+		return -1;
+	}
+	fmt_ctx->interrupt_callback.callback = metadata_interrupt_cb;
+	fmt_ctx->interrupt_callback.opaque = scan;
+	fmt_ctx->probesize = METADATA_PROBESIZE;
+	fmt_ctx->format_probesize = METADATA_PROBESIZE;
+	fmt_ctx->max_analyze_duration = METADATA_ANALYZE_DURATION;
+
+	if (avformat_open_input(&fmt_ctx, path, NULL, NULL) < 0) {
+		av_log(NULL, AV_LOG_ERROR, "metadata : cannot open %s\n", path);
+		return -1;
+	}
+
+	stream_index = find_audio_stream(fmt_ctx);
+	if (-1 == stream_index) {
+		goto end;
+	}
+	st = fmt_ctx->streams[stream_index];
+	par = st->codecpar;
+
+	// raw streams (adts, mpegts..) only describe themselves in packets
+	if (par->codec_id == AV_CODEC_ID_NONE || par->sample_rate <= 0
+			|| par->channels <= 0) {
+		if (avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+			goto end;
+		}
+		rec->flags |= METADATA_PROBED;
+	}
+
+	rec->sample_rate = par->sample_rate;
+	rec->channels = (int16_t) par->channels;
+	rec->bit_rate = (int32_t) (par->bit_rate > 0 ?
+			par->bit_rate : FFMAX(fmt_ctx->bit_rate, 0));
+
+	if (AV_NOPTS_VALUE != fmt_ctx->duration) {
+		rec->duration = fmt_ctx->duration;
+	} else if (AV_NOPTS_VALUE != st->duration) {
+		rec->duration = av_rescale_q(st->duration, st->time_base,
+				AV_TIME_BASE_Q);
+	}
+
+	size = fmt_ctx->pb ? avio_size(fmt_ctx->pb) : -1;
+	if (rec->duration < 0 && rec->bit_rate > 0 && size > 0) {
+		rec->duration = av_rescale(size, 8 * (int64_t) AV_TIME_BASE,
+				rec->bit_rate);
+		rec->flags |= METADATA_DURATION_ESTIMATED;
+	} else if (!rec->bit_rate && rec->duration > 0 && size > 0) {
+		rec->bit_rate = (int32_t) av_rescale(size, 8 * (int64_t) AV_TIME_BASE,
+				rec->duration);
+	}
+
+	// the demuxer read the picture with the header, its packet knows where
+	// unless it came out of a tag
+	for (i = 0; i < fmt_ctx->nb_streams; i++) {
+		AVStream *pic = fmt_ctx->streams[i];
+		if (pic->disposition & AV_DISPOSITION_ATTACHED_PIC) {
+			rec->flags |= METADATA_HAS_COVER;
+			rec->cover_offset = pic->attached_pic.pos;
+			rec->cover_size = pic->attached_pic.size;
+			if (rec->cover_offset < 0 && fmt_ctx->pb) {
+				rec->cover_offset = metadata_find_cover(fmt_ctx->pb,
+						&pic->attached_pic);
+			}
+			if (rec->cover_offset < 0) {
+				rec->flags |= METADATA_COVER_UNLOCATED;
+			}
+			break;
+		}
+	}
+
+	e->strings[0] = av_strdup(avcodec_get_name(par->codec_id));
+	e->strings[1] = metadata_tag(fmt_ctx, st, "title");
+	e->strings[2] = metadata_tag(fmt_ctx, st, "artist");
+	e->strings[3] = metadata_tag(fmt_ctx, st, "album");
+
+	rec->flags |= METADATA_OK;
+	ret = 0;
+
+	end:
+
+	avformat_close_input(&fmt_ctx);
+	return ret;
+}
+
+static void* metadata_thread(void *arg) {
+	MetadataScan *scan = (MetadataScan*) arg;
+	int i;
+
+	// a library scan must not starve playback
+	setpriority(PRIO_PROCESS, syscall(__NR_gettid), METADATA_NICE);
+
+	while (!metadata_interrupt_cb(scan)) {
+		pthread_mutex_lock(&scan->mutex);
+		i = scan->next < scan->nb_paths ? scan->next++ : -1;
+		pthread_mutex_unlock(&scan->mutex);
+
+		if (i < 0) {
+			break;
+		}
+
+		// entries are apart, only the count is shared
+		if (metadata_read(scan, scan->paths[i], &scan->entries[i]) == 0) {
+			pthread_mutex_lock(&scan->mutex);
+			scan->nb_read++;
+			pthread_mutex_unlock(&scan->mutex);
+		}
+	}
+
+	return NULL;
+}
+
+static int metadata_table_write(const char *path, const MetadataEntry *entries,
+		int nb_entries) {
+	MetadataTableHeader header = { 0 };
+	MetadataRecord *records = NULL;
+	char *strings = NULL, tmp_path[1040];
+	size_t size = nb_entries * sizeof(MetadataRecord), pos = 1;
+	int fd = -1, i, j, ret = -1;
+
+	// the pool starts with the empty string shared by the missing ones
+	for (i = 0; i < nb_entries; i++) {
+		for (j = 0; j < 4; j++) {
+			pos += entries[i].strings[j] ? strlen(entries[i].strings[j]) + 1 : 0;
+		}
+	}
+	if (pos > INT_MAX) {
+		return -1;
+	}
+
+	records = (MetadataRecord*) av_malloc(FFMAX(size, 1));
+	strings = (char*) av_malloc(pos);
+	if (!records || !strings) {
+		goto end;
+	}
+
+	strings[0] = 0;
+	pos = 1;
+	for (i = 0; i < nb_entries; i++) {
+		MetadataRecord *rec = &records[i];
+		uint32_t *offsets[4] = { &rec->codec, &rec->title, &rec->artist,
+				&rec->album };
+
+		*rec = entries[i].record;
+		for (j = 0; j < 4; j++) {
+			const char *s = entries[i].strings[j];
+
+			*offsets[j] = 0;
+			if (s) {
+				size_t len = strlen(s) + 1;
+				*offsets[j] = (uint32_t) pos;
+				memcpy(strings + pos, s, len);
+				pos += len;
+			}
+		}
+	}
+
+	header.magic = METADATA_TABLE_MAGIC;
+	header.version = METADATA_TABLE_VERSION;
+	header.nb_records = nb_entries;
+	header.strings_size = (int32_t) pos;
+
+	// write aside and rename, readers never see a partial table
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		av_log(NULL, AV_LOG_ERROR, "metadata : cannot create %s\n", tmp_path);
+		goto end;
+	}
+
+	if (write(fd, &header, sizeof(header)) == sizeof(header)
+			&& write(fd, records, size) == (ssize_t) size
+			&& write(fd, strings, pos) == (ssize_t) pos) {
+		fsync(fd);
+		close(fd);
+		ret = rename(tmp_path, path);
+	} else {
+		close(fd);
+		unlink(tmp_path);
+	}
+
+	end:
+
+	av_free(records);
+	av_free(strings);
+	return ret;
+}
+
+/**
+ * Reads duration, codec, bitrate, audio format, title, artist, album and
+ * cover art location of every path from the container headers, on a pool
+ * of worker threads, and writes them to the table at table_path.
+ *
+ * @return the number of files read, -1 when the table was not written
+ */
+int metadata_scan(const char **paths, int nb_paths, const char *table_path) {
+	MetadataScan scan;
+	pthread_t threads[METADATA_MAX_THREADS];
+	int64_t t = av_gettime_relative();
+	int nb_threads, i, j, ret = -1;
+	double wall;
+
+	memset(&scan, 0, sizeof(scan));
+	scan.paths = paths;
+	scan.nb_paths = nb_paths;
+	scan.cancel_serial = cancel_serial;
+	pthread_mutex_init(&scan.mutex, NULL);
+
+	scan.entries = (MetadataEntry*) av_mallocz_array(FFMAX(nb_paths, 1),
+			sizeof(MetadataEntry));
+	if (!scan.entries) {
+		goto end;
+	}
+
+	for (i = 0; i < nb_paths; i++) {
+		scan.entries[i].record.duration = -1;
+		scan.entries[i].record.cover_offset = -1;
+	}
+
+	// one worker per core, opening a header is mostly CPU once cached
+	nb_threads = av_clip((int) sysconf(_SC_NPROCESSORS_ONLN), 1,
+			METADATA_MAX_THREADS);
+	nb_threads = FFMIN(nb_threads, nb_paths);
+	for (i = 0; i < nb_threads; i++) {
+		if (pthread_create(&threads[i], NULL, metadata_thread, &scan)) {
+			av_log(NULL, AV_LOG_ERROR, "metadata : pthread_create failure.\n");
+			break;
+		}
+	}
+	nb_threads = i;
+
+	for (i = 0; i < nb_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	wall = (av_gettime_relative() - t) / 1000000.0;
+	if (scan.nb_read && wall > 0) {
+		global_context.metadata_files_per_sec = (float) (scan.nb_read / wall);
+		LOGV("metadata : %d of %d files in %.2f s on %d threads, %.0f files/s",
+				scan.nb_read, nb_paths, wall, nb_threads,
+				global_context.metadata_files_per_sec);
+	}
+
+	// a cancelled scan leaves the previous table in place
+	if (!metadata_interrupt_cb(&scan)
+			&& metadata_table_write(table_path, scan.entries, nb_paths) == 0) {
+		ret = scan.nb_read;
+	}
+
+	end:
+
+	for (i = 0; scan.entries && i < nb_paths; i++) {
+		for (j = 0; j < 4; j++) {
+			av_free(scan.entries[i].strings[j]);
+		}
+	}
+	av_free(scan.entries);
+	pthread_mutex_destroy(&scan.mutex);
+
+	return ret;
+}
+
+// makes the scans running return -1 without writing their table
+void metadata_scan_cancel() {
+	__sync_fetch_and_add(&cancel_serial, 1);
+}
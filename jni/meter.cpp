@@ -0,0 +1,199 @@
+
+#include "player.h"
+
+#include <math.h>
+
+// frames converted to float at a time
+#define METER_CHUNK 1024
+
+// levels are published every 100 ms; momentary loudness spans 4 of these
+// blocks and short-term loudness 30, as in BS.1770 and EBU Tech 3341
+#define METER_BLOCK_MS 100
+#define METER_MOMENTARY_BLOCKS 4
+#define METER_SHORT_TERM_BLOCKS 30
+
+#define METER_FLOOR_DB -120
+
+// Level meter on the S16 output, the buffer as it goes to the device:
+// sample peak and RMS of every channel, and the momentary and short-term
+// loudness K-weighted with the sections of the loudness scanner. The
+// output callback is the only writer of the snapshot and publishes it
+// under a sequence count; readers copy it and retry while the count is
+// odd or moved, so neither side ever waits for the other.
+static MeterSnapshot snapshot = { { METER_FLOOR_DB, METER_FLOOR_DB }, {
+		METER_FLOOR_DB, METER_FLOOR_DB }, METER_FLOOR_DB, METER_FLOOR_DB };
+static volatile int snapshot_seq; // odd while snapshot is being written
+
+static int meter_rate;
+static int meter_channels;
+static float shelf[5];
+static float high_pass[5];
+static float shelf_state[4];
+static float high_pass_state[4];
+static float scratch[METER_CHUNK * 2];
+
+// current block
+static int block_len;
+static int block_pos;
+static float block_peak[2];
+static float block_power[2];
+static float block_weighted[2];
+
+// K-weighted mean squares of the last blocks, summed over the channels
+static double history[METER_SHORT_TERM_BLOCKS];
+static int64_t nb_blocks;
+
+static int64_t meter_frames;
+static int64_t meter_cpu_us;
+
+static inline float meter_db(double power) {
+	return power > 0 ?
+			FFMAX((float) (10 * log10(power)), (float) METER_FLOOR_DB) :
+			(float) METER_FLOOR_DB;
+}
+
+/**
+ * The two K-weighting sections for rate, as given at 48 kHz by BS.1770, in
+ * the coefficient layout of dsp_biquad().
+ */
+void k_weighting_init(int rate, float *shelf, float *high_pass) {
+	double f0 = 1681.974450955533, q = 0.7071752369554196;
+	double k = tan(M_PI * f0 / rate), a0;
+	double vh = pow(10, 3.999843853973347 / 20);
+	double vb = pow(vh, 0.4996667741545416);
+
+	a0 = 1 + k / q + k * k;
+	shelf[0] = (float) ((vh + vb * k / q + k * k) / a0);
+	shelf[1] = (float) (2 * (k * k - vh) / a0);
+	shelf[2] = (float) ((vh - vb * k / q + k * k) / a0);
+	shelf[3] = (float) (2 * (k * k - 1) / a0);
+	shelf[4] = (float) ((1 - k / q + k * k) / a0);
+
+	f0 = 38.13547087602444;
+	q = 0.5003270373238773;
+	k = tan(M_PI * f0 / rate);
+	a0 = 1 + k / q + k * k;
+	high_pass[0] = 1;
+	high_pass[1] = -2;
+	high_pass[2] = 1;
+	high_pass[3] = (float) (2 * (k * k - 1) / a0);
+	high_pass[4] = (float) ((1 - k / q + k * k) / a0);
+}
+
+static void meter_reset(int rate, int channels) {
+	meter_rate = rate;
+	meter_channels = channels;
+	block_len = rate * METER_BLOCK_MS / 1000;
+	block_pos = 0;
+	nb_blocks = 0;
+
+	k_weighting_init(rate, shelf, high_pass);
+	memset(shelf_state, 0, sizeof(shelf_state));
+	memset(high_pass_state, 0, sizeof(high_pass_state));
+	memset(block_peak, 0, sizeof(block_peak));
+	memset(block_power, 0, sizeof(block_power));
+	memset(block_weighted, 0, sizeof(block_weighted));
+}
+
+// the loudness of the last nb blocks, silence until there are that many
+static float meter_loudness(int nb) {
+	double sum = 0;
+	int i;
+
+	if (nb_blocks < nb) {
+		return METER_FLOOR_DB;
+	}
+
+	for (i = 1; i <= nb; i++) {
+		sum += history[(nb_blocks - i) % METER_SHORT_TERM_BLOCKS];
+	}
+
+	return FFMAX((float) (-0.691 + meter_db(sum / nb)),
+			(float) METER_FLOOR_DB);
+}
+
+static void meter_publish() {
+	float peak[2], rms[2];
+	int ch;
+
+	history[nb_blocks % METER_SHORT_TERM_BLOCKS] = (block_weighted[0]
+			+ (meter_channels > 1 ? block_weighted[1] : 0)) / block_len;
+	nb_blocks++;
+
+	// a mono output reads the same on both channels
+	for (ch = 0; ch < 2; ch++) {
+		int c = FFMIN(ch, meter_channels - 1);
+		peak[ch] = meter_db((double) block_peak[c] * block_peak[c]);
+		rms[ch] = meter_db(block_power[c] / block_len);
+	}
+
+	__sync_fetch_and_add(&snapshot_seq, 1);
+	__sync_synchronize();
+	for (ch = 0; ch < 2; ch++) {
+		snapshot.peak_db[ch] = peak[ch];
+		snapshot.rms_db[ch] = rms[ch];
+	}
+	snapshot.momentary_lufs = meter_loudness(METER_MOMENTARY_BLOCKS);
+	snapshot.short_term_lufs = meter_loudness(METER_SHORT_TERM_BLOCKS);
+	__sync_synchronize();
+	__sync_fetch_and_add(&snapshot_seq, 1);
+
+	block_pos = 0;
+	memset(block_peak, 0, sizeof(block_peak));
+	memset(block_power, 0, sizeof(block_power));
+	memset(block_weighted, 0, sizeof(block_weighted));
+}
+
+// measures nb_frames of output, called by the output callback
+void meter_process(const int16_t *buf, int nb_frames) {
+	int rate = global_context.audio_tgt.freq;
+	int channels = global_context.audio_tgt.channels;
+	int pos, n;
+	int64_t cpu;
+	float unused[2] = { 0, 0 };
+
+	if (rate <= 0 || channels < 1 || channels > 2) {
+		return;
+	}
+
+	cpu = get_thread_cpu_time();
+
+	if (rate != meter_rate || channels != meter_channels) {
+		meter_reset(rate, channels);
+	}
+
+	for (pos = 0; pos < nb_frames; pos += n) {
+		n = FFMIN(FFMIN(nb_frames - pos, METER_CHUNK), block_len - block_pos);
+
+		dsp_s16_to_float(scratch, buf + pos * channels, n * channels);
+		dsp_peak_power(scratch, n, channels, block_peak, block_power);
+
+		dsp_biquad(scratch, n, channels, shelf, shelf_state);
+		dsp_biquad(scratch, n, channels, high_pass, high_pass_state);
+		dsp_peak_power(scratch, n, channels, unused, block_weighted);
+
+		block_pos += n;
+		if (block_pos == block_len) {
+			meter_publish();
+		}
+	}
+
+	meter_cpu_us += get_thread_cpu_time() - cpu;
+	meter_frames += nb_frames;
+	if (meter_frames >= rate) {
+		global_context.meter_cpu_us = meter_cpu_us * rate / meter_frames;
+		meter_frames = meter_cpu_us = 0;
+	}
+}
+
+// copies the levels of the last published block, never blocks
+void meter_get_snapshot(MeterSnapshot *s) {
+	int seq;
+
+	do {
+		seq = snapshot_seq;
+		__sync_synchronize();
+		*s = snapshot;
+		__sync_synchronize();
+	} while ((seq & 1) || seq != snapshot_seq);
+}
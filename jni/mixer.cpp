@@ -0,0 +1,224 @@
+
+#include "player.h"
+
+#include <math.h>
+
+#define MIXER_MAX_VOICES 32
+
+enum VoiceState {
+	VOICE_FREE, VOICE_PLAYING,
+};
+
+typedef struct MixerVoice {
+	int state;
+	int generation; // tells a stale handle from the slot's current voice
+	ClipBuffer *clip; // referenced in the clip bank
+	int64_t start; // mixer time of the first frame
+	int pos; // frames of the clip played
+	float gain[2]; // per output channel, from gain and pan
+} MixerVoice;
+
+// Mixes short sounds over the tracks before the output conversion, so
+// music and effects share one OpenSL ES player. Voices come from a fixed
+// pool and start on an exact output frame; the callback mixes them in
+// float under mixer_mutex, which the UI thread only holds briefly. The
+// PCM of the sounds lives in the clip bank, see clip_bank.cpp.
+static MixerVoice voices[MIXER_MAX_VOICES];
+static int nb_active; // voices not free
+static int64_t mixer_clock; // output frames rendered
+static pthread_mutex_t mixer_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// load of the last second of output
+static int64_t load_frames;
+static int64_t load_cpu_us;
+static int load_peak_voices;
+
+static void voice_free(MixerVoice *v) {
+	clip_bank_unref(v->clip);
+	v->state = VOICE_FREE;
+	v->clip = NULL;
+	nb_active--;
+}
+
+// stops the voices of the clip and drops it from the clip bank
+void mixer_unload(int id) {
+	int i;
+
+	pthread_mutex_lock(&mixer_mutex);
+	for (i = 0; i < MIXER_MAX_VOICES; i++) {
+		if (voices[i].state != VOICE_FREE && voices[i].clip->id == id) {
+			voice_free(&voices[i]);
+		}
+	}
+	pthread_mutex_unlock(&mixer_mutex);
+
+	clip_bank_unload(id);
+}
+
+// constant-power pan, scaled so that the centre leaves both channels alone
+static void voice_set_gain(MixerVoice *v, float gain, float pan) {
+	double theta = (av_clipf(pan, -1, 1) + 1) * M_PI / 4;
+
+	if (global_context.audio_tgt.channels == 2) {
+		v->gain[0] = gain * (float) FFMIN(1, M_SQRT2 * cos(theta));
+		v->gain[1] = gain * (float) FFMIN(1, M_SQRT2 * sin(theta));
+	} else {
+		v->gain[0] = v->gain[1] = gain;
+	}
+}
+
+static MixerVoice *voice_get(int handle) {
+	MixerVoice *v;
+
+	if (handle < 0) {
+		return NULL;
+	}
+
+	v = &voices[(handle & 0xff) % MIXER_MAX_VOICES];
+	if (v->state == VOICE_FREE || v->generation != handle >> 8) {
+		return NULL;
+	}
+
+	return v;
+}
+
+/**
+ * Starts a voice playing a loaded clip.
+ *
+ * @param gain   linear gain
+ * @param pan    -1 (left) to 1 (right)
+ * @param start  mixer time of the first frame, see mixer_get_time(); a
+ *               time already rendered starts the voice in the next buffer
+ * @return a voice handle, -1 if the clip is unknown or all voices are busy
+ */
+int mixer_play(int id, float gain, float pan, int64_t start) {
+	static int generation;
+	MixerVoice *v = NULL;
+	ClipBuffer *clip;
+	int i, handle = -1;
+
+	// a reference for a cached sound, a decode if it was evicted
+	clip = clip_bank_ref(id);
+	if (!clip) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&mixer_mutex);
+
+	for (i = 0; i < MIXER_MAX_VOICES; i++) {
+		if (voices[i].state == VOICE_FREE) {
+			v = &voices[i];
+			break;
+		}
+	}
+
+	if (v) {
+		generation = (generation + 1) & 0x7fffff;
+		v->state = VOICE_PLAYING;
+		v->generation = generation;
+		v->clip = clip;
+		v->start = start;
+		v->pos = 0;
+		voice_set_gain(v, gain, pan);
+		nb_active++;
+		handle = generation << 8 | i;
+	}
+
+	pthread_mutex_unlock(&mixer_mutex);
+
+	if (!v) {
+		clip_bank_unref(clip);
+		av_log(NULL, AV_LOG_WARNING, "mixer : no voice for sound %d\n", id);
+	}
+	return handle;
+}
+
+void mixer_set_voice(int handle, float gain, float pan) {
+	MixerVoice *v;
+
+	pthread_mutex_lock(&mixer_mutex);
+	if ((v = voice_get(handle))) {
+		voice_set_gain(v, gain, pan);
+	}
+	pthread_mutex_unlock(&mixer_mutex);
+}
+
+void mixer_stop(int handle) {
+	MixerVoice *v;
+
+	pthread_mutex_lock(&mixer_mutex);
+	if ((v = voice_get(handle))) {
+		voice_free(v);
+	}
+	pthread_mutex_unlock(&mixer_mutex);
+}
+
+// output frames mixed so far, the time base of mixer_play()
+int64_t mixer_get_time() {
+	return mixer_clock;
+}
+
+// true while a voice is playing or waiting for its start
+bool mixer_active() {
+	return nb_active > 0;
+}
+
+/**
+ * Adds the voices to nb_frames of output in dst, called by the output
+ * callback for every buffer.
+ */
+void mixer_render(float *dst, int nb_frames) {
+	int channels = global_context.audio_tgt.channels;
+	int i, n, offset, active;
+	int64_t cpu;
+
+	pthread_mutex_lock(&mixer_mutex);
+
+	cpu = get_thread_cpu_time();
+	active = nb_active;
+
+	for (i = 0; i < MIXER_MAX_VOICES && nb_active; i++) {
+		MixerVoice *v = &voices[i];
+
+		if (v->state != VOICE_PLAYING) {
+			continue;
+		}
+
+		// a start inside this buffer is honoured to the frame
+		offset = (int) av_clip64(v->start - mixer_clock, 0, nb_frames);
+		n = FFMIN(nb_frames - offset, v->clip->nb_frames - v->pos);
+		if (n <= 0) {
+			continue;
+		}
+
+		dsp_mix_gain(dst + offset * channels,
+				v->clip->data + v->pos * channels, v->gain, n, channels);
+
+		v->pos += n;
+		if (v->pos >= v->clip->nb_frames) {
+			voice_free(v);
+		}
+	}
+
+	mixer_clock += nb_frames;
+
+	if (active) {
+		load_cpu_us += get_thread_cpu_time() - cpu;
+		load_peak_voices = FFMAX(load_peak_voices, active);
+	}
+
+	load_frames += nb_frames;
+	if (load_frames >= global_context.audio_tgt.freq) {
+		global_context.mixer_load = (int) (load_cpu_us * 100
+				* global_context.audio_tgt.freq / (load_frames * AV_TIME_BASE));
+		if (load_peak_voices) {
+			LOGV2("mixer : up to %d voices, %lld us CPU per %lld frames "
+					"(%d%%)", load_peak_voices, (long long) load_cpu_us,
+					(long long) load_frames, global_context.mixer_load);
+		}
+		load_frames = load_cpu_us = 0;
+		load_peak_voices = 0;
+	}
+
+	pthread_mutex_unlock(&mixer_mutex);
+}
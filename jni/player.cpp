@@ -6,8 +6,80 @@
 #define TEST_FILE_TFCARD "/mnt/extSdCard/clear.ts"
 //#define TEST_FILE_TFCARD "/mnt/extSdCard/baidu.mp4"
 
+// fast start probe limits, the defaults are 5 MB and 5 seconds
+#define FAST_START_PROBESIZE (64 * 1024)
+#define FAST_START_ANALYZE_DURATION (AV_TIME_BASE / 2)
+#define FULL_PROBESIZE 5000000
+
+// audio queued per position while scrubbing
+#define SCRUB_GRAIN (AV_TIME_BASE / 20)
+
+// the next playlist entry is opened this close to the end of the current one
+#define DEFAULT_PRELOAD (10 * AV_TIME_BASE)
+
+// demuxing stops once this much audio is queued and resumes below the low
+// mark, so the read-ahead and the storage idle between bursts instead of
+// the whole file being pulled into memory; packets without a duration are
+// bounded by their size
+#define DEMUX_HIGH_WATER (8 * AV_TIME_BASE)
+#define DEMUX_LOW_WATER (4 * AV_TIME_BASE)
+#define DEMUX_MAX_BYTES (1024 * 1024)
+
 GlobalContext global_context;
 
+// One opened playlist entry. The media thread demuxes it into queue, the
+// output callback decodes it through dec.
+typedef struct Track {
+	MediaSource source;
+	int index; // position in the playlist
+
+	MediaIO io;
+	AVFormatContext *fmt_ctx;
+	int stream_index;
+	ProbeCache *probe_cache;
+	SeekIndex *seek_index;
+
+	PacketQueue queue;
+	AudioDecoder dec;
+	ReplayGain replay_gain;
+
+	int preloaded; // the following entry was opened, or failed to
+	int demux_paused; // the queue went above the high water mark
+} Track;
+
+// The output callback reads current_track and moves on to next_track, once
+// the media thread has opened and warmed it up, in the same buffer it ends
+// in. The track it leaves is closed by the media thread.
+static Track *current_track;
+static Track *next_track;
+static Track *retired_track;
+static pthread_mutex_t track_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// frames rendered in float at a time
+#define RENDER_MAX_FRAMES 1024
+
+// crossfade from current_track into next_track, see render_crossfade()
+static int64_t fade_pos; // frames of the overlap played
+static int64_t fade_len; // frames of the overlap, 0 when not fading
+static int fade_done; // the last overlap just ended
+static int64_t fade_cpu_us; // callback CPU time during the overlap
+static int fade_peak_load; // highest callback load of a buffer, percent
+
+// output has at most two channels, see set_output_params()
+static float render_buf[RENDER_MAX_FRAMES * 2];
+static float fade_out_buf[RENDER_MAX_FRAMES * 2];
+static float fade_in_buf[RENDER_MAX_FRAMES * 2];
+static float fade_out_gain[RENDER_MAX_FRAMES * 2];
+static float fade_in_gain[RENDER_MAX_FRAMES * 2];
+
+// tempo change of the tracks, see render_tempo()
+static TimeStretch *time_stretch;
+static Track *stretch_track; // track and queue serial of the input
+static int stretch_serial;
+static float stretch_buf[RENDER_MAX_FRAMES * 2];
+static int64_t stretch_frames; // output frames of the metering second
+static int64_t stretch_cpu_us;
+
 static void sigterm_handler(int sig) {
 	av_log(NULL, AV_LOG_ERROR, "sigterm_handler : sig is %d \n", sig);
 	exit(123);
@@ -18,19 +90,11 @@ static void ffmpeg_log_callback(void *ptr, int level, const char *fmt,
 	//__android_log_vprint(ANDROID_LOG_DEBUG, "FFmpeg", fmt, vl);
 }
 
-void* open_media(void *argv) {
-	int i;
-	int err = 0;
-	int framecnt;
-	AVFormatContext *fmt_ctx = NULL;
-	AVDictionaryEntry *dict = NULL;
-	AVPacket pkt;
-	int audio_stream_index = -1;
-	bool firstPacket = true;
-	pthread_t thread;
+static pthread_once_t global_init_once = PTHREAD_ONCE_INIT;
+static pthread_once_t network_init_once = PTHREAD_ONCE_INIT;
 
-	global_context.quit = 0;
-	global_context.pause = 0;
+static void global_init() {
+	int64_t t = av_gettime_relative();
 
 	// register INT/TERM signal
 	signal(SIGINT, sigterm_handler); /* Interrupt (ANSI).    */
@@ -44,95 +108,1018 @@ void* open_media(void *argv) {
 	/* register all codecs, demux and protocols */
 	avfilter_register_all();
 	av_register_all();
+
+	LOGV("global init : %lld us", (long long) (av_gettime_relative() - t));
+}
+
+static void network_init() {
 	avformat_network_init();
+}
+
+// process-wide FFmpeg setup, runs once however many times it is called
+void player_global_init() {
+	pthread_once(&global_init_once, global_init);
+}
+
+// only network sources pay for the network stack, once per process
+void player_network_init() {
+	pthread_once(&network_init_once, network_init);
+}
+
+static void* global_init_thread(void *arg) {
+	player_global_init();
+	return NULL;
+}
+
+// starts player_global_init() early, off the caller's thread
+void player_global_init_async() {
+	pthread_t thread;
+
+	if (pthread_create(&thread, NULL, global_init_thread, NULL) == 0) {
+		pthread_detach(thread);
+	}
+}
+
+// Only the selected audio stream is demuxed: mpegts stops reassembling
+// PES packets of discarded PIDs and mov skips their samples, so unused
+// video is neither read into packets nor allocated.
+static void discard_unused_streams(AVFormatContext *fmt_ctx, int keep) {
+	unsigned int i;
+
+	for (i = 0; i < fmt_ctx->nb_streams; i++) {
+		if ((int) i != keep) {
+			fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+		}
+	}
+}
+
+// true if the decoder can be opened without avformat_find_stream_info()
+static bool has_codec_parameters(AVCodecParameters *par) {
+	return par->codec_id != AV_CODEC_ID_NONE && par->sample_rate > 0
+			&& par->channels > 0;
+}
+
+static int probe_stream_info(AVFormatContext *fmt_ctx, StartupTimes *times) {
+	int64_t t = av_gettime_relative();
+	int err;
+
+	if ((err = avformat_find_stream_info(fmt_ctx, NULL)) < 0) {
+		av_log(NULL, AV_LOG_ERROR, "avformat_find_stream_info : err is %d \n",
+				err);
+		return err;
+	}
+
+	times->probe_us += av_gettime_relative() - t;
+	return 0;
+}
+
+// the output keeps the rate of the first track for the whole playlist;
+// OpenSL ES takes mono or stereo, wider layouts are downmixed. Tracks are
+// decoded to float and converted to S16 after mixing.
+void set_output_params(int sample_rate, int channels) {
+	AudioParams *tgt = &global_context.audio_tgt;
+
+	tgt->fmt = AV_SAMPLE_FMT_FLT;
+	tgt->freq = sample_rate;
+	tgt->channels = channels >= 2 ? 2 : 1;
+	tgt->channel_layout = av_get_default_channel_layout(tgt->channels);
+	tgt->frame_size = av_samples_get_buffer_size(NULL, tgt->channels, 1,
+			tgt->fmt, 1);
+	tgt->bytes_per_sec = tgt->freq * tgt->frame_size;
+}
+
+// output format when PCM is decoded ahead before any track was played
+#define DEFAULT_OUTPUT_RATE 44100
+
+// sounds and impulse responses are decoded to the output format, which
+// stays fixed from then on
+void fix_output_params() {
+	if (!global_context.audio_tgt.freq) {
+		set_output_params(DEFAULT_OUTPUT_RATE, 2);
+	}
+	global_context.output_fixed = 1;
+}
+
+// called from the UI thread, the read loop performs the seek
+void request_seek(int64_t pos) {
+	global_context.seek_pos = FFMAX(pos, 0);
+	global_context.seek_start = av_gettime_relative();
+	// the read loop takes seek_pos once it sees the request
+	__sync_synchronize();
+	global_context.seek_req = 1;
+}
+
+// demuxers that bisect or scan the file to seek, see seek_index.cpp
+static bool needs_seek_index(AVFormatContext *fmt_ctx,
+		const MediaSource *src) {
+	static const char * const names[] = { "mpegts", "mpeg", "mp3", "aac",
+			"ac3", "eac3", "dts" };
+	unsigned int i;
+
+	if (src->type == MEDIA_SOURCE_URL && strstr(src->url, "://")
+			&& !av_strstart(src->url, "file:", NULL)) {
+		// indexing a network source would download all of it
+		return false;
+	}
+
+	for (i = 0; i < FF_ARRAY_ELEMS(names); i++) {
+		if (av_match_name(names[i], fmt_ctx->iformat->name)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void track_close(Track **ptrack) {
+	Track *track = *ptrack;
+
+	if (!track) {
+		return;
+	}
+
+	if (track->seek_index) {
+		const SeekIndexEntry *entries;
+		int nb_entries, nb_cached;
+
+		seek_index_stop(track->seek_index);
+
+		// persist the index with the probe data if it grew
+		entries = seek_index_entries(track->seek_index, &nb_entries);
+		probe_cache_get_index(track->probe_cache, &nb_cached);
+		if (nb_entries > nb_cached) {
+			probe_cache_store(track->probe_cache, track->fmt_ctx,
+					track->stream_index, entries, nb_entries);
+		}
+
+		seek_index_close(&track->seek_index);
+	}
+
+	audio_decoder_destroy(&track->dec);
+
+	if (track->fmt_ctx) {
+		avformat_close_input(&track->fmt_ctx);
+	}
+
+	if (track->io.http_cache) {
+		http_cache_get_stats(track->io.http_cache,
+				&global_context.cache_bytes_hit,
+				&global_context.cache_bytes_miss);
+	}
 
-	fmt_ctx = avformat_alloc_context();
+	media_io_close(&track->io);
+	probe_cache_close(&track->probe_cache);
+	packet_queue_destroy(&track->queue);
+	av_freep(ptrack);
+}
+
+/**
+ * Opens src up to a decoder ready to be read. The first track opened by
+ * open_media() also sets the output format.
+ *
+ * @param index  position of src in the playlist
+ * @param times  receives the time spent in each step
+ */
+static Track *track_open(const MediaSource *src, int index,
+		StartupTimes *times) {
+	Track *track;
+	AVFormatContext *fmt_ctx;
+	AVInputFormat *input_format = NULL;
+	AVStream *st;
+	const char *url = NULL;
+	bool probed = false;
+	int64_t t;
+	int err;
+
+	track = (Track*) av_mallocz(sizeof(Track));
+	if (!track) {
+		return NULL;
+	}
+
+	track->source = *src;
+	track->index = index;
+	track->stream_index = -1;
+	packet_queue_init(&track->queue);
+
+	track->fmt_ctx = avformat_alloc_context();
+	if (!track->fmt_ctx) {
+		goto failure;
+	}
+
+	if (media_io_open(&track->io, &track->source, track->fmt_ctx, &url) < 0) {
+		goto failure;
+	}
+
+	if (global_context.cache_dir[0]) {
+		track->probe_cache = probe_cache_open(&track->source,
+				global_context.cache_dir);
+		input_format = probe_cache_input_format(track->probe_cache);
+	}
+
+	if (global_context.fast_start || input_format) {
+		track->fmt_ctx->probesize = FAST_START_PROBESIZE;
+		track->fmt_ctx->max_analyze_duration = FAST_START_ANALYZE_DURATION;
+	}
 
-	err = avformat_open_input(&fmt_ctx, TEST_FILE_TFCARD, NULL, NULL);
+	t = av_gettime_relative();
+	err = avformat_open_input(&track->fmt_ctx, url, input_format, NULL);
 	if (err < 0) {
 		char errbuf[64];
 		av_strerror(err, errbuf, 64);
 		av_log(NULL, AV_LOG_ERROR, "avformat_open_input : err is %d , %s\n",
 				err, errbuf);
-		err = -1;
 		goto failure;
 	}
+	times->open_us = av_gettime_relative() - t;
 
-	if ((err = avformat_find_stream_info(fmt_ctx, NULL)) < 0) {
-		av_log(NULL, AV_LOG_ERROR, "avformat_find_stream_info : err is %d \n",
-				err);
-		err = -1;
-		goto failure;
+	fmt_ctx = track->fmt_ctx;
+
+	// a cache hit configures the stream without reading any packet
+	track->stream_index = probe_cache_apply(track->probe_cache, fmt_ctx);
+	if (-1 != track->stream_index) {
+		times->probe_cache_hit = 1;
+	} else {
+		track->stream_index = find_audio_stream(fmt_ctx);
 	}
 
-	// search audio stream in all streams.
-	for (i = 0; i < fmt_ctx->nb_streams; i++) {
-		// we used the first audio stream
-		if (fmt_ctx->streams[i]->codec->codec_type == AVMEDIA_TYPE_AUDIO) {
-			audio_stream_index = i;
-			break;
+	// the header alone may describe the audio completely (mp4, mkv, wav..)
+	if (!times->probe_cache_hit
+			&& (!global_context.fast_start || -1 == track->stream_index
+					|| !has_codec_parameters(
+							fmt_ctx->streams[track->stream_index]->codecpar))) {
+		if (probe_stream_info(fmt_ctx, times) < 0) {
+			goto failure;
 		}
+		probed = true;
+		track->stream_index = find_audio_stream(fmt_ctx);
 	}
 
 	// if no audio, exit
-	if (-1 == audio_stream_index) {
+	if (-1 == track->stream_index) {
 		goto failure;
 	}
 
 	// open audio
-	if (-1 != audio_stream_index) {
-		global_context.acodec_ctx = fmt_ctx->streams[audio_stream_index]->codec;
-		global_context.astream = fmt_ctx->streams[audio_stream_index];
-		global_context.acodec = avcodec_find_decoder(
-				global_context.acodec_ctx->codec_id);
-		//av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1,
-		//	&global_context.acodec, 0);
-		if (NULL == global_context.acodec) {
-			av_log(NULL, AV_LOG_ERROR, "avcodec_find_decoder failure. \n");
-			err = -1;
+	t = av_gettime_relative();
+	err = open_audio_decoder(fmt_ctx, track->stream_index, probed);
+	if (err < 0 && !probed) {
+		// the header lied or was incomplete, fall back to full probing
+		av_log(NULL, AV_LOG_WARNING, "fast start : decoder open failure, "
+				"probing stream info. \n");
+		fmt_ctx->probesize = FULL_PROBESIZE;
+		fmt_ctx->max_analyze_duration = 0;
+		if (probe_stream_info(fmt_ctx, times) < 0) {
 			goto failure;
 		}
+		err = open_audio_decoder(fmt_ctx, track->stream_index, true);
+	}
+	if (err < 0) {
+		goto failure;
+	}
+	times->codec_us = av_gettime_relative() - t;
 
-		//av_opt_set_int(global_context.acodec_ctx, "refcounted_frames", 1, 0);
-		if (avcodec_open2(global_context.acodec_ctx, global_context.acodec,
-				NULL) < 0) {
-			av_log(NULL, AV_LOG_ERROR, "avcodec_open2 failure. \n");
-			err = -1;
-			goto failure;
+	st = fmt_ctx->streams[track->stream_index];
+	replay_gain_read(fmt_ctx, track->stream_index, &track->replay_gain);
+	if (!global_context.audio_tgt.freq) {
+		set_output_params(st->codec->sample_rate, st->codec->channels);
+	}
+	audio_decoder_init(&track->dec, st->codec, st, &track->queue,
+			&global_context.audio_tgt);
+
+	if (track->probe_cache && !times->probe_cache_hit) {
+		probe_cache_store(track->probe_cache, fmt_ctx, track->stream_index,
+				NULL, 0);
+	}
+
+	discard_unused_streams(fmt_ctx, track->stream_index);
+
+	if (needs_seek_index(fmt_ctx, &track->source)) {
+		const SeekIndexEntry *cached;
+		int nb_cached;
+
+		cached = probe_cache_get_index(track->probe_cache, &nb_cached);
+		track->seek_index = seek_index_create(fmt_ctx, track->stream_index,
+				cached, nb_cached);
+		if (track->seek_index) {
+			seek_index_start(track->seek_index, &track->source);
 		}
 	}
 
-	// opensl es init
-	createEngine();
-	createBufferQueueAudioPlayer();
+	return track;
 
-	// read url media data circle
-	while ((av_read_frame(fmt_ctx, &pkt) >= 0) && (!global_context.quit)) {
-		if (pkt.stream_index == audio_stream_index) {
-			packet_queue_put(&global_context.audio_queue, &pkt);
-			if (firstPacket) {
-				firstPacket = false;
-				fireOnPlayer();
+	failure:
+
+	track_close(&track);
+	return NULL;
+}
+
+// demuxers whose packets carry their own timestamps after a byte seek;
+// the raw elementary ones only count from a timestamp seek
+static bool byte_seek_keeps_pts(AVFormatContext *fmt_ctx) {
+	return av_match_name("mpegts", fmt_ctx->iformat->name)
+			|| av_match_name("mpeg", fmt_ctx->iformat->name);
+}
+
+static void do_seek(Track *track) {
+	AVFormatContext *fmt_ctx = track->fmt_ctx;
+	AVStream *st = fmt_ctx->streams[track->stream_index];
+	int64_t pos, target;
+	SeekIndexEntry entry;
+	int ret = -1;
+
+	// a request arriving while this seek runs is kept for the next one
+	global_context.seek_req = 0;
+	__sync_synchronize();
+	pos = global_context.seek_pos;
+
+	target = pos;
+	if (AV_NOPTS_VALUE != fmt_ctx->start_time) {
+		target += fmt_ctx->start_time;
+	}
+
+	if (seek_index_lookup(track->seek_index,
+			av_rescale_q(target, AV_TIME_BASE_Q, st->time_base), &entry)
+			== 0) {
+		if (byte_seek_keeps_pts(fmt_ctx)) {
+			// direct byte seek to the indexed packet at or before the target
+			ret = avformat_seek_file(fmt_ctx, -1, entry.pos, entry.pos,
+					entry.pos, AVSEEK_FLAG_BYTE);
+		} else {
+			// the generic seek below lands on the entry with its timestamp
+			av_add_index_entry(st, entry.pos, entry.timestamp, 0, 0,
+					AVINDEX_KEYFRAME);
+		}
+	}
+
+	// mpegts has no native seek, this bisects the file on PCR/PTS
+	if (ret < 0) {
+		ret = avformat_seek_file(fmt_ctx, -1, INT64_MIN, target, target, 0);
+	}
+	if (ret < 0 && fmt_ctx->bit_rate > 0
+			&& !(fmt_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+		// no usable timestamps, estimate the byte position from the bitrate
+		int64_t byte = av_rescale(pos, fmt_ctx->bit_rate,
+				8 * (int64_t) AV_TIME_BASE);
+		ret = avformat_seek_file(fmt_ctx, -1, INT64_MIN, byte, byte,
+				AVSEEK_FLAG_BYTE);
+	}
+
+	if (ret < 0) {
+		av_log(NULL, AV_LOG_ERROR, "do_seek : seek to %" PRId64 " failure\n",
+				pos);
+		return;
+	}
+
+	// samples before the target are cut from the first decoded frames;
+	// a scrub grain starts right at the sync point instead
+	track->dec.seek_trim_pts = global_context.scrubbing ? AV_NOPTS_VALUE :
+			av_rescale_q(target, AV_TIME_BASE_Q, st->time_base);
+	track->dec.eof = 0;
+	packet_queue_flush(&track->queue);
+	global_context.seek_serial = track->queue.serial;
+	global_context.audio_clock = pos;
+
+	flushPlayer();
+}
+
+// audio queued for the decoder, AV_TIME_BASE
+static int64_t queued_duration(Track *track) {
+	AVStream *st = track->fmt_ctx->streams[track->stream_index];
+
+	return av_rescale_q(track->queue.duration, st->time_base, AV_TIME_BASE_Q);
+}
+
+// true once the demuxed track being heard is close enough to its end, by
+// the decoder clock, to open the next playlist entry, which must be ready
+// before a crossfade starts
+static bool should_preload(Track *track) {
+	int64_t duration = track->fmt_ctx->duration;
+	int64_t left;
+
+	if (track->preloaded || track->index + 1 >= global_context.nb_playlist) {
+		return false;
+	}
+
+	// without a container duration, what is left is what is queued
+	left = AV_NOPTS_VALUE != duration ?
+			duration - track->dec.clock : queued_duration(track);
+
+	return left <= global_context.preload_us + global_context.crossfade_us;
+}
+
+// true while the queue holds enough, with hysteresis between the marks;
+// the next entry is only opened once this one is demuxed, so the preload
+// window stays queued as well
+static bool demux_should_wait(Track *track) {
+	int64_t low = FFMAX(DEMUX_LOW_WATER,
+			global_context.preload_us + global_context.crossfade_us);
+	int64_t high = low + DEMUX_HIGH_WATER - DEMUX_LOW_WATER;
+	int64_t queued = queued_duration(track);
+	int size = track->queue.size;
+
+	if (track->demux_paused) {
+		track->demux_paused = queued > low || size > DEMUX_MAX_BYTES / 2;
+	} else {
+		track->demux_paused = queued >= high || size >= DEMUX_MAX_BYTES;
+	}
+
+	return track->demux_paused;
+}
+
+/**
+ * Opens the playlist entry after track, skipping the ones that fail, and
+ * decodes its first PCM, the whole crossfade if one is set, so the splice
+ * costs the output callback nothing but a copy.
+ */
+static Track *preload_track(Track *track) {
+	StartupTimes times = { 0 };
+	Track *next = NULL;
+	AVPacket pkt;
+	int index, ret, size;
+	int64_t t, warm_up;
+
+	track->preloaded = 1;
+
+	t = av_gettime_relative();
+	for (index = track->index + 1; !next && index < global_context.nb_playlist;
+			index++) {
+		next = track_open(&global_context.playlist[index], index, &times);
+	}
+
+	if (!next) {
+		return NULL;
+	}
+
+	size = (int) av_rescale(global_context.crossfade_us,
+			global_context.audio_tgt.freq, AV_TIME_BASE)
+			* global_context.audio_tgt.frame_size;
+
+	warm_up = av_gettime_relative();
+	while (!global_context.quit) {
+		ret = audio_decoder_prefill(&next->dec, FFMAX(size, 1));
+		if (ret != 0) {
+			break;
+		}
+
+		ret = av_read_frame(next->fmt_ctx, &pkt);
+		if (ret < 0) {
+			if (AVERROR_EOF == ret
+					|| (next->fmt_ctx->pb && avio_feof(next->fmt_ctx->pb))) {
+				next->dec.eof = 1;
+			} else {
+				usleep(10000);
 			}
+			continue;
+		}
+
+		if (pkt.stream_index == next->stream_index) {
+			packet_queue_put(&next->queue, &pkt);
 		} else {
 			av_free_packet(&pkt);
 		}
 	}
 
-	// wait exit
+	warm_up = av_gettime_relative() - warm_up;
+	LOGV("gapless : track %d ready in %lld us (open %lld, probe %lld%s, "
+			"codec %lld, warm up %lld)", next->index,
+			(long long) (av_gettime_relative() - t), (long long) times.open_us,
+			(long long) times.probe_us,
+			times.probe_cache_hit ? " cached" : "", (long long) times.codec_us,
+			(long long) warm_up);
+
+	return next;
+}
+
+// position of the next sample read from d, AV_TIME_BASE
+static int64_t decoder_position(AudioDecoder *d) {
+	int buffered = (d->buf_size - d->buf_index) / d->tgt.frame_size;
+
+	return d->clock - av_rescale(buffered, AV_TIME_BASE, d->tgt.freq);
+}
+
+// called with track_mutex held, like everything down to player_read_audio()
+static void switch_track() {
+	retired_track = current_track;
+	current_track = next_track;
+	next_track = NULL;
+	global_context.track_index = current_track->index;
+}
+
+// true once the current track is within the crossfade of its end
+static bool should_crossfade() {
+	int64_t duration;
+
+	if (!global_context.crossfade_us || !next_track || retired_track) {
+		return false;
+	}
+
+	// without a duration there is no telling when to start, splice instead
+	duration = current_track->fmt_ctx->duration;
+	if (AV_NOPTS_VALUE == duration) {
+		return false;
+	}
+
+	return duration - decoder_position(&current_track->dec)
+			<= global_context.crossfade_us;
+}
+
+static void start_crossfade() {
+	int64_t remaining = current_track->fmt_ctx->duration
+			- decoder_position(&current_track->dec);
+
+	// the overlap ends with the current track, even if it started late
+	fade_len = FFMAX(1,
+			av_rescale(remaining, global_context.audio_tgt.freq, AV_TIME_BASE));
+	fade_pos = 0;
+	fade_cpu_us = 0;
+	fade_peak_load = 0;
+
+	LOGV2("crossfade : track %d into %d over %lld ms", current_track->index,
+			next_track->index,
+			(long long) av_rescale(fade_len, 1000,
+					global_context.audio_tgt.freq));
+}
+
+/**
+ * Mixes the tail of the current track with the head of the next one, which
+ * the media thread decoded ahead for the whole overlap; the second decoder
+ * costs the callback a copy. A track that ends early is silence for the
+ * rest of the overlap.
+ *
+ * @return frames written, 0 when the current track is starving
+ */
+static int render_crossfade(float *dst, int nb_frames) {
+	int frame_size = global_context.audio_tgt.frame_size;
+	int channels = global_context.audio_tgt.channels;
+	int out_bytes, in_bytes, n;
+
+	nb_frames = (int) FFMIN(nb_frames, fade_len - fade_pos);
+
+	out_bytes = audio_decoder_read(&current_track->dec,
+			(uint8_t*) fade_out_buf, nb_frames * frame_size);
+	in_bytes = audio_decoder_read(&next_track->dec, (uint8_t*) fade_in_buf,
+			nb_frames * frame_size);
+
+	if (out_bytes < 0 && in_bytes < 0) {
+		// both ended inside the overlap
+		fade_pos = fade_len;
+		return 0;
+	}
+
+	out_bytes = FFMAX(out_bytes, 0);
+	in_bytes = FFMAX(in_bytes, 0);
+	n = FFMAX(out_bytes, in_bytes) / frame_size;
+	if (!n) {
+		return 0;
+	}
+
+	memset((uint8_t*) fade_out_buf + out_bytes, 0, n * frame_size - out_bytes);
+	memset((uint8_t*) fade_in_buf + in_bytes, 0, n * frame_size - in_bytes);
+
+	dsp_fade_gains(fade_out_gain, fade_in_gain, n, channels, fade_pos,
+			fade_len);
+	dsp_mix2(dst, fade_out_buf, fade_out_gain, fade_in_buf, fade_in_gain,
+			n * channels);
+
+	fade_pos += n;
+	return n;
+}
+
+// renders up to nb_frames of float output, moving on to the next track
+// when the current one ends or has faded out
+static int render_tracks(float *dst, int nb_frames) {
+	int frame_size = global_context.audio_tgt.frame_size;
+	int channels = global_context.audio_tgt.channels;
+	int filled = 0, n;
+
+	while (current_track && filled < nb_frames) {
+		if (!fade_len && should_crossfade()) {
+			start_crossfade();
+		}
+
+		if (fade_len && fade_pos >= fade_len) {
+			// the previous track is still being closed, try again later
+			if (retired_track) {
+				break;
+			}
+			fade_len = 0;
+			fade_done = 1;
+			switch_track();
+			continue;
+		}
+
+		if (fade_len) {
+			n = render_crossfade(dst + filled * channels, nb_frames - filled);
+			if (n <= 0 && fade_pos < fade_len) {
+				break;
+			}
+			filled += n;
+			continue;
+		}
+
+		n = audio_decoder_read(&current_track->dec,
+				(uint8_t*) (dst + filled * channels),
+				(nb_frames - filled) * frame_size);
+		if (n > 0) {
+			filled += n / frame_size;
+			continue;
+		}
+
+		// starving, or the end of the playlist
+		if (AVERROR_EOF != n || !next_track || retired_track) {
+			break;
+		}
+
+		switch_track();
+		LOGV2("gapless : track %d starts at frame %d of the buffer",
+				current_track->index, filled);
+	}
+
+	return filled;
+}
+
+// feeds the time stretch from the tracks, timing the stretch alone
+static int render_stretched(float *dst, int nb_frames, double speed) {
+	int channels = global_context.audio_tgt.channels;
+	int filled = 0, n;
+	int64_t cpu;
+
+	while (filled < nb_frames) {
+		cpu = get_thread_cpu_time();
+		n = time_stretch_read(time_stretch, dst + filled * channels,
+				nb_frames - filled, speed);
+		stretch_cpu_us += get_thread_cpu_time() - cpu;
+		if (n > 0) {
+			filled += n;
+			continue;
+		}
+
+		if (!time_stretch_active(time_stretch)) {
+			// drained back to normal speed, the tracks follow seamlessly
+			n = render_tracks(dst + filled * channels, nb_frames - filled);
+			if (n <= 0) {
+				break;
+			}
+			filled += n;
+			continue;
+		}
+
+		n = render_tracks(stretch_buf,
+				FFMIN(time_stretch_wants(time_stretch), RENDER_MAX_FRAMES));
+		if (n <= 0) {
+			break;
+		}
+
+		cpu = get_thread_cpu_time();
+		time_stretch_write(time_stretch, stretch_buf, n);
+		stretch_cpu_us += get_thread_cpu_time() - cpu;
+	}
+
+	return filled;
+}
+
+// renders the tracks at the playback speed; the stretch stays in the path
+// after a return to normal speed until it has drained
+static int render_tempo(float *dst, int nb_frames) {
+	int freq = global_context.audio_tgt.freq;
+	double speed = global_context.speed;
+	int n;
+
+	// a seek flushed the track, the buffered input is from before it
+	if (current_track && current_track == stretch_track
+			&& current_track->queue.serial != stretch_serial) {
+		time_stretch_flush(time_stretch);
+	}
+	stretch_track = current_track;
+	stretch_serial = current_track ? current_track->queue.serial : 0;
+
+	if (!time_stretch || (speed == 1 && !time_stretch_active(time_stretch))) {
+		return render_tracks(dst, nb_frames);
+	}
+
+	n = render_stretched(dst, nb_frames, speed);
+
+	stretch_frames += FFMAX(n, 0);
+	if (stretch_frames >= freq) {
+		global_context.stretch_cpu_us = stretch_cpu_us * freq / stretch_frames;
+		LOGV2("tempo : %.2fx, %lld us CPU per second of output", speed,
+				(long long) global_context.stretch_cpu_us);
+		stretch_frames = stretch_cpu_us = 0;
+	}
+
+	return n;
+}
+
+/**
+ * Fills buf with up to nb_frames of S16 output. When the current track
+ * ends inside the buffer the rest is read from the preloaded next track,
+ * so consecutive tracks are played without a single missing sample, or
+ * they overlap with an equal-power crossfade when one is set. The tracks
+ * then go through the time stretch, the equalizer and the reverb, the
+ * mixer voices are added, the compressor and limiter follow, the
+ * spectrum tap sees the result, the volume is applied by the S16
+ * conversion, and the meter measures what goes to the device.
+ *
+ * @return frames written, 0 when no audio is ready yet
+ */
+int player_read_audio(int16_t *buf, int nb_frames) {
+	int channels = global_context.audio_tgt.channels;
+	int filled = 0, n, load;
+	bool fading;
+	int64_t cpu;
+
+	pthread_mutex_lock(&track_mutex);
+
+	fading = fade_len > 0;
+	cpu = get_thread_cpu_time();
+
+	while (filled < nb_frames) {
+		int len = FFMIN(nb_frames - filled, RENDER_MAX_FRAMES);
+
+		n = render_tempo(render_buf, len);
+
+		// voices keep playing over a starved or finished track
+		if (mixer_active() && n < len) {
+			memset(render_buf + FFMAX(n, 0) * channels, 0,
+					(len - FFMAX(n, 0)) * channels * sizeof(float));
+			n = len;
+		}
+		if (n <= 0) {
+			break;
+		}
+		eq_process(render_buf, n);
+		reverb_process(render_buf, n);
+		mixer_render(render_buf, n);
+		dynamics_process(render_buf, n);
+		spectrum_write(render_buf, n);
+		gain_to_s16(buf + filled * channels, render_buf, n,
+				current_track ? &current_track->replay_gain : NULL);
+		meter_process(buf + filled * channels, n);
+		filled += n;
+	}
+
+	// CPU the callback spends on a buffer, against the time it plays for
+	if ((fading || fade_len || fade_done) && filled > 0) {
+		cpu = get_thread_cpu_time() - cpu;
+		load = (int) (cpu * 100 * global_context.audio_tgt.freq
+				/ ((int64_t) filled * AV_TIME_BASE));
+		fade_cpu_us += cpu;
+		fade_peak_load = FFMAX(fade_peak_load, load);
+	}
+
+	if (fade_done) {
+		fade_done = 0;
+		global_context.crossfade_headroom = FFMAX(0, 100 - fade_peak_load);
+		LOGV2("crossfade : %lld us CPU in the callback, peak load %d%%, "
+				"headroom %d%%", (long long) fade_cpu_us, fade_peak_load,
+				global_context.crossfade_headroom);
+	}
+
+	if (current_track && filled > 0) {
+		// the stretch holds input that was not heard yet
+		global_context.audio_clock = FFMAX(
+				decoder_position(&current_track->dec)
+						- av_rescale(time_stretch_latency(time_stretch),
+								AV_TIME_BASE, global_context.audio_tgt.freq),
+				0);
+		global_context.audio_serial = current_track->dec.serial;
+	}
+
+	pthread_mutex_unlock(&track_mutex);
+
+	return filled;
+}
+
+/**
+ * Enters scrub mode: every seek then queues only SCRUB_GRAIN of audio from
+ * the sync point before the target, and a seek requested while another is
+ * pending replaces it, so only the latest position of a drag is decoded.
+ */
+void scrub_begin() {
+	global_context.scrub_wall_start = av_gettime_relative();
+	global_context.scrub_cpu_start = get_process_cpu_time();
+	global_context.scrubbing = 1;
+}
+
+/**
+ * Leaves scrub mode with a sample-accurate seek to the last position, after
+ * which normal decoding resumes.
+ *
+ * @return CPU time used by the process during the scrub, in microseconds
+ */
+int64_t scrub_end() {
+	int64_t cpu, wall;
+
+	if (!global_context.scrubbing) {
+		return 0;
+	}
+
+	global_context.scrubbing = 0;
+	request_seek(global_context.seek_pos);
+
+	cpu = get_process_cpu_time() - global_context.scrub_cpu_start;
+	wall = av_gettime_relative() - global_context.scrub_wall_start;
+	LOGV("scrub : %lld us CPU over %lld us (%d%%)", (long long) cpu,
+			(long long) wall, wall > 0 ? (int) (cpu * 100 / wall) : 0);
+
+	return cpu;
+}
+
+
+void* open_media(void *argv) {
+	Track *track = NULL; // the track being demuxed
+	Track *tracks[3];
+	AVPacket pkt;
+	int64_t demux_window_start;
+	int demux_bytes = 0, demux_dropped = 0;
+	int64_t t;
+	int64_t grain = 0; // audio queued since the last seek, AV_TIME_BASE
+	int i, ret;
+
+	memset(&global_context.startup, 0, sizeof(StartupTimes));
+	global_context.startup.begin = av_gettime_relative();
+
+	global_context.pause = 0;
+	global_context.seek_req = 0;
+	global_context.scrubbing = 0;
+	global_context.audio_clock = 0;
+	global_context.track_index = 0;
+	// decoded sounds and impulse responses are in the output format
+	if (!global_context.output_fixed) {
+		memset(&global_context.audio_tgt, 0, sizeof(AudioParams));
+	}
+
+	if (global_context.preload_us <= 0) {
+		global_context.preload_us = DEFAULT_PRELOAD;
+	}
+	if (global_context.speed <= 0) {
+		global_context.speed = 1;
+	}
+
+	global_context.cache_bytes_hit = 0;
+	global_context.cache_bytes_miss = 0;
+
+	// returns at once unless JNI_OnLoad's background init is still running
+	player_global_init();
+
+	if (global_context.source.type == MEDIA_SOURCE_URL
+			&& !global_context.source.url[0]) {
+		av_strlcpy(global_context.source.url, TEST_FILE_TFCARD,
+				sizeof(global_context.source.url));
+	}
+
+	track = track_open(&global_context.source, 0, &global_context.startup);
+	if (!track) {
+		goto failure;
+	}
+
+	pthread_mutex_lock(&track_mutex);
+	current_track = track;
+	// the stretch works in the output format, which may have changed
+	time_stretch_free(&time_stretch);
+	time_stretch = time_stretch_alloc(global_context.audio_tgt.freq,
+			global_context.audio_tgt.channels, RENDER_MAX_FRAMES);
+	pthread_mutex_unlock(&track_mutex);
+
+	// opensl es init, reused from the previous source or the mixer
+	t = av_gettime_relative();
+	openOutput();
+	global_context.startup.output_us = av_gettime_relative() - t;
+
+	demux_window_start = av_gettime_relative();
+
+	// read url media data circle
 	while (!global_context.quit) {
-		usleep(1000);
+		int64_t now;
+		Track *done;
+
+		// the output callback moved on to the next track
+		pthread_mutex_lock(&track_mutex);
+		done = retired_track;
+		retired_track = NULL;
+		pthread_mutex_unlock(&track_mutex);
+		track_close(&done);
+
+		if (global_context.seek_req) {
+			// seeks are for the track being heard, drop a preloaded one
+			pthread_mutex_lock(&track_mutex);
+			done = next_track;
+			next_track = NULL;
+			fade_len = 0;
+			track = current_track;
+			pthread_mutex_unlock(&track_mutex);
+			track_close(&done);
+
+			track->preloaded = 0;
+			do_seek(track);
+			grain = 0;
+		}
+
+		// the grain of this scrub position is queued, wait for the next one
+		if (global_context.scrubbing && grain >= SCRUB_GRAIN) {
+			usleep(2000);
+			continue;
+		}
+
+		if (track->dec.eof) {
+			if (track == current_track && should_preload(track)) {
+				Track *next = preload_track(track);
+				if (next) {
+					pthread_mutex_lock(&track_mutex);
+					next_track = next;
+					pthread_mutex_unlock(&track_mutex);
+					track = next;
+
+					// the player may have drained the end of the previous track
+					if (isPlayerIdle()) {
+						fireOnPlayer();
+					}
+					continue;
+				}
+			}
+
+			// at the end of the media keep waiting, a seek may rewind it
+			usleep(10000);
+			continue;
+		}
+
+		// the decoder has enough, let the storage idle until it catches up
+		if (demux_should_wait(track)) {
+			usleep(10000);
+			continue;
+		}
+
+		ret = av_read_frame(track->fmt_ctx, &pkt);
+		if (ret < 0) {
+			if (AVERROR_EOF == ret
+					|| (track->fmt_ctx->pb && avio_feof(track->fmt_ctx->pb))) {
+				track->dec.eof = 1;
+
+				// a drained player reads the end, then the next track
+				if (isPlayerIdle()) {
+					fireOnPlayer();
+				}
+			} else {
+				usleep(10000);
+			}
+			continue;
+		}
+
+		now = av_gettime_relative();
+
+		global_context.io_wait_ms = readahead_get_io_wait(track->io.readahead);
+		http_cache_get_stats(track->io.http_cache,
+				&global_context.cache_bytes_hit,
+				&global_context.cache_bytes_miss);
+
+		demux_bytes += pkt.size;
+		if (pkt.stream_index != track->stream_index) {
+			demux_dropped += pkt.size;
+		}
+
+		if (now - demux_window_start >= 1000000) {
+			global_context.demux_bytes_per_sec = (int) (demux_bytes
+					* INT64_C(1000000) / (now - demux_window_start));
+			LOGV("demux : %d bytes/s allocated, %d bytes/s dropped",
+					global_context.demux_bytes_per_sec,
+					(int) (demux_dropped * INT64_C(1000000)
+							/ (now - demux_window_start)));
+			demux_bytes = demux_dropped = 0;
+			demux_window_start = now;
+		}
+
+		if (pkt.stream_index == track->stream_index) {
+			grain += pkt.duration > 0 ? av_rescale_q(pkt.duration,
+					track->fmt_ctx->streams[track->stream_index]->time_base,
+					AV_TIME_BASE_Q) : SCRUB_GRAIN / 2;
+
+			packet_queue_put(&track->queue, &pkt);
+
+			// first packet, or the player ran dry or was flushed by a seek
+			if (isPlayerIdle()) {
+				fireOnPlayer();
+			}
+		} else {
+			av_free_packet(&pkt);
+		}
 	}
 
 	failure:
 
-	if (fmt_ctx) {
-		avformat_close_input(&fmt_ctx);
-		avformat_free_context(fmt_ctx);
+	// the output callback finds no track from here on
+	pthread_mutex_lock(&track_mutex);
+	tracks[0] = current_track;
+	tracks[1] = next_track;
+	tracks[2] = retired_track;
+	current_track = next_track = retired_track = NULL;
+	fade_len = 0;
+	pthread_mutex_unlock(&track_mutex);
+
+	for (i = 0; i < 3; i++) {
+		track_close(&tracks[i]);
 	}
 
-	avformat_network_deinit();
+	global_context.io_wait_ms = 0;
 
 	return 0;
 }
-
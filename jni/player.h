@@ -26,12 +26,17 @@ extern "C" {
 
 #include "config.h"
 
+#include "libavutil/adler32.h"
+#include "libavutil/avstring.h"
 #include "libavutil/log.h"
+#include "libavutil/md5.h"
+#include "libavutil/replaygain.h"
 #include "libavutil/time.h"
 #include "libavutil/samplefmt.h"
 #include "libavutil/opt.h"
 #include "libavutil/channel_layout.h"
 #include "libavformat/avformat.h"
+#include "libavcodec/avfft.h"
 #include "libswscale/swscale.h"
 #include "libswresample/swresample.h"
 #include "libavfilter/avfilter.h"
@@ -53,13 +58,19 @@ extern "C" {
 #include <android/log.h>
 
 #define AVCODEC_MAX_AUDIO_FRAME_SIZE 192000 // 1 second of 48khz 32bit audio
+typedef struct PacketList {
+	AVPacket pkt;
+	struct PacketList *next;
+	int serial;
+} PacketList;
+
 typedef struct PacketQueue {
-	AVPacketList *first_pkt, *last_pkt;
+	PacketList *first_pkt, *last_pkt;
 	int nb_packets;
 	int size;
-	int abort_request;
+	int64_t duration; // of the packets, in their stream time base
 	int serial;
-	pthread_mutex_t *mutex;
+	pthread_mutex_t mutex;
 } PacketQueue;
 
 typedef struct AudioParams {
@@ -71,29 +82,373 @@ typedef struct AudioParams {
 	int bytes_per_sec;
 } AudioParams;
 
+// Decodes one audio stream from its packet queue into PCM of the output
+// format. The demuxer feeds queue, only one thread reads the decoder.
+typedef struct AudioDecoder {
+	AVCodecContext *avctx;
+	AVStream *stream;
+	PacketQueue *queue;
+
+	AVPacket pkt;
+	AVPacket pkt_temp; // the part of pkt not decoded yet
+	int pkt_serial; // queue serial of pkt
+	int decoder_serial; // queue serial the decoder was flushed for
+	int eof; // set by the demuxer once the last packet is queued
+
+	int64_t seek_trim_pts; // trim_pts of the next serial, set by a seek
+	int64_t trim_pts; // drop decoded samples before it, stream time base
+	int skip_samples; // encoder delay still to drop, see audio.cpp
+	int trailing_padding; // encoder padding of the last frame
+	int64_t out_skip; // output samples still to drop
+	int drained; // the decoder and filter tails were flushed at eof
+
+	AVFilterGraph *agraph;
+	AVFilterContext *in_filter; // the first filter in the audio chain
+	AVFilterContext *out_filter; // the last filter in the audio chain
+	AudioParams src;
+	AudioParams tgt;
+	int reconfigure;
+
+	uint8_t *buf; // output PCM not read yet, from buf_index to buf_size
+	unsigned int buf_alloc;
+	int buf_size;
+	int buf_index;
+	int buf_hold; // bytes at the end of buf kept until the drain
+
+	int64_t clock; // end of the last decoded frame, AV_TIME_BASE
+	int serial; // queue serial of the PCM in buf
+} AudioDecoder;
+
+// decoded PCM of a sound in the clip bank, in the output format
+typedef struct ClipBuffer {
+	float *data;
+	int nb_frames;
+	int id;
+} ClipBuffer;
+
+enum ReplayGainMode {
+	REPLAY_GAIN_OFF, REPLAY_GAIN_TRACK, REPLAY_GAIN_ALBUM,
+};
+
+// gains in dB, peaks linear with 0 for unknown
+typedef struct ReplayGain {
+	float track_db;
+	float track_peak;
+	float album_db;
+	float album_peak;
+	int has_track;
+	int has_album;
+} ReplayGain;
+
+// loudness of a track and of its album, in LUFS, LU and dBTP
+typedef struct LoudnessResult {
+	float integrated;
+	float range;
+	float true_peak;
+	float album_integrated;
+	float album_range;
+	float album_true_peak;
+} LoudnessResult;
+
+// output levels of the last 100 ms, mono repeated on both channels
+typedef struct MeterSnapshot {
+	float peak_db[2]; // dBFS
+	float rms_db[2]; // dBFS
+	float momentary_lufs; // 400 ms
+	float short_term_lufs; // 3 s
+} MeterSnapshot;
+
+enum ExportContainer {
+	EXPORT_RAW, EXPORT_WAV,
+};
+
+// headless decode of a range of a file, see pcm_export()
+typedef struct ExportParams {
+	int container; // ExportContainer
+	enum AVSampleFormat fmt; // AV_SAMPLE_FMT_S16 or AV_SAMPLE_FMT_FLT
+	int64_t start; // AV_TIME_BASE
+	int64_t end; // AV_TIME_BASE, 0 for the end of the media
+} ExportParams;
+
+// receives exported PCM, returns < 0 to abort the export
+typedef int (*ExportWriteFunc)(void *opaque, const uint8_t *buf, int size);
+
+typedef struct ReadAheadContext ReadAheadContext;
+typedef struct HttpCache HttpCache;
+typedef struct ProbeCache ProbeCache;
+typedef struct SeekIndex SeekIndex;
+typedef struct TimeStretch TimeStretch;
+typedef struct Reverb Reverb;
+
+typedef struct SeekIndexEntry {
+	int64_t timestamp; // in stream time base
+	int64_t pos; // byte offset of the packet
+	int32_t flags; // AVINDEX_KEYFRAME
+	int32_t reserved;
+} SeekIndexEntry;
+
+typedef struct MemoryReader {
+	const uint8_t *data;
+	int64_t size;
+	int64_t pos;
+} MemoryReader;
+
+enum MediaSourceType {
+	MEDIA_SOURCE_URL, // path or network url
+	MEDIA_SOURCE_FD, // range of a file descriptor, e.g. an APK asset
+	MEDIA_SOURCE_MEMORY, // caller owned memory, e.g. a direct ByteBuffer
+};
+
+typedef struct MediaSource {
+	int type;
+	char url[1024];
+	int fd;
+	int64_t offset;
+	int64_t length;
+	const uint8_t *data;
+	int64_t size;
+} MediaSource;
+
+typedef struct MediaIO {
+	AVIOContext *avio;
+	ReadAheadContext *readahead;
+	HttpCache *http_cache;
+	MemoryReader memory;
+} MediaIO;
+
+// startup time breakdown of the last open_media(), in microseconds
+typedef struct StartupTimes {
+	int64_t begin; // av_gettime_relative() at open_media() entry
+	int64_t open_us; // avformat_open_input
+	int64_t probe_us; // avformat_find_stream_info, 0 when skipped
+	int64_t codec_us; // decoder open
+	int64_t output_us; // OpenSL ES engine and player creation
+	int64_t first_buffer_us; // from begin to the first enqueued buffer
+	int probe_cache_hit; // stream info came from the probe cache
+} StartupTimes;
+
 typedef struct GlobalContexts {
-	AVCodecContext *acodec_ctx;
 	AVCodecContext *vcodec_ctx;
 	AVStream *vstream;
-	AVStream *astream;
 	AVCodec *vcodec;
-	AVCodec *acodec;
 
-	PacketQueue audio_queue;
+	MediaSource source;
+
+	// tracks played gaplessly after source, see player_read_audio()
+	MediaSource *playlist;
+	int nb_playlist; // source is playlist[0] when not 0
+	int track_index; // playlist entry being played
+	int64_t preload_us; // next track opened this close to the end
+	int64_t crossfade_us; // overlap of consecutive tracks, 0 for gapless
+	int crossfade_headroom; // percent of CPU left in the last crossfade
+	double speed; // playback tempo, 0.5 to 3, the pitch is kept
+	int64_t stretch_cpu_us; // time stretch CPU per second of output
+	int64_t eq_band_cpu_us; // CPU of one EQ band per second of output
+	int reverb_load; // percent of CPU the reverb took in the last second
+	float gain_reduction_db; // of the compressor and limiter, last block
+	int64_t dynamics_block_ns; // compressor CPU per block
+	float loudness_files_per_core; // throughput of the last loudness scan
+	int64_t spectrum_cpu_us; // spectrum analysis CPU per second
+	int64_t meter_cpu_us; // level meter CPU per second of output
+	float waveform_s_per_hour; // last waveform overview, per hour of audio
+	int waveform_max_threads; // segments of an overview, 0 for one per core
+	float export_speed; // last PCM export, times realtime
+	float metadata_files_per_sec; // throughput of the last metadata scan
+
+	AudioParams audio_tgt; // float PCM format of the tracks, S16 on output
+	int output_fixed; // audio_tgt kept across tracks, see fix_output_params()
+	int mixer_load; // percent of CPU the voices took in the last second
+
+	int fast_start; // bounded probing, skip find_stream_info when possible
+	StartupTimes startup;
+
+	int io_chunk_size; // read-ahead chunk size in bytes, 0 for the default
+	int io_wait_ms; // time the demuxer waited for I/O in the last second
+	int demux_bytes_per_sec; // packet payload allocated by the demuxer
+
+	char cache_dir[512]; // persistent caches, disabled while empty
+	int64_t cache_bytes_hit; // network source bytes served from the cache
+	int64_t cache_bytes_miss; // network source bytes fetched upstream
+
+	// seek request, see request_seek()
+	int seek_req;
+	int64_t seek_pos; // AV_TIME_BASE units from the start of the media
+	int64_t seek_start; // av_gettime_relative() of the request
+	int64_t seek_latency_us; // request to first buffer of the last seek
+
+	int seek_serial; // queue serial right after the last seek
+
+	int scrubbing; // seeks only queue a short grain, see scrub_begin()
+	int64_t scrub_wall_start;
+	int64_t scrub_cpu_start;
+
+	int64_t audio_clock; // end of the last decoded frame, AV_TIME_BASE
+	int audio_serial; // queue serial of the last decoded frame
 
 	int quit;
 	int pause;
 } GlobalContext;
 
 void packet_queue_init(PacketQueue *q);
-int packet_queue_get(PacketQueue *q, AVPacket *pkt);
+void packet_queue_destroy(PacketQueue *q);
+void packet_queue_flush(PacketQueue *q);
+int packet_queue_get(PacketQueue *q, AVPacket *pkt, int *serial);
 int packet_queue_put(PacketQueue *q, AVPacket *pkt);
 
-int audio_decode_frame(uint8_t *audio_buf, int buf_size);
+int64_t get_thread_cpu_time();
+int64_t get_process_cpu_time();
+
+ReadAheadContext *readahead_open(int fd, int64_t offset, int64_t length,
+		int chunk_size);
+ReadAheadContext *readahead_open_file(const char *path, int chunk_size);
+ReadAheadContext *readahead_open_fd(int fd, int64_t offset, int64_t length,
+		int chunk_size);
+AVIOContext *readahead_alloc_avio(ReadAheadContext *ra);
+int readahead_get_io_wait(ReadAheadContext *ra);
+void readahead_close(ReadAheadContext **pra);
+AVIOContext *memory_alloc_avio(MemoryReader *mr);
+void custom_avio_free(AVIOContext **pavio);
+
+HttpCache *http_cache_open(const char *url, const char *cache_dir);
+AVIOContext *http_cache_alloc_avio(HttpCache *hc);
+void http_cache_get_stats(HttpCache *hc, int64_t *from_cache,
+		int64_t *from_network);
+void http_cache_close(HttpCache **phc);
+
+ProbeCache *probe_cache_open(const MediaSource *src, const char *cache_dir);
+AVInputFormat *probe_cache_input_format(ProbeCache *pc);
+int probe_cache_apply(ProbeCache *pc, AVFormatContext *fmt_ctx);
+const SeekIndexEntry *probe_cache_get_index(ProbeCache *pc, int *nb_entries);
+int probe_cache_store(ProbeCache *pc, AVFormatContext *fmt_ctx,
+		int stream_index, const SeekIndexEntry *index, int nb_entries);
+void probe_cache_close(ProbeCache **ppc);
+
+SeekIndex *seek_index_create(AVFormatContext *fmt_ctx, int stream_index,
+		const SeekIndexEntry *cached, int nb_cached);
+int seek_index_start(SeekIndex *si, const MediaSource *src);
+int seek_index_lookup(SeekIndex *si, int64_t timestamp, SeekIndexEntry *entry);
+void seek_index_stop(SeekIndex *si);
+const SeekIndexEntry *seek_index_entries(SeekIndex *si, int *nb_entries);
+void seek_index_close(SeekIndex **psi);
+
+int media_io_open(MediaIO *io, const MediaSource *src,
+		AVFormatContext *fmt_ctx, const char **url);
+void media_io_close(MediaIO *io);
+
+void dsp_fade_gains(float *gain_out, float *gain_in, int nb_frames,
+		int channels, int64_t pos, int64_t len);
+void dsp_mix2(float *dst, const float *a, const float *gain_a,
+		const float *b, const float *gain_b, int n);
+void dsp_float_to_s16(int16_t *dst, const float *src, int nb_frames,
+		int channels, float gain, float step);
+void dsp_mix_gain(float *dst, const float *src, const float *gain,
+		int nb_frames, int channels);
+float dsp_dot(const float *a, const float *b, int n);
+void dsp_biquad(float *buf, int nb_frames, int channels, const float *c,
+		float *state);
+void dsp_complex_mac(float *acc, const float *a, const float *b, int n);
+void dsp_gain_ramp(float *buf, int nb_frames, int channels, float gain,
+		float step);
+void dsp_s16_to_float(float *dst, const int16_t *src, int n);
+void dsp_peak_power(const float *buf, int nb_frames, int channels,
+		float *peak, float *power);
+void dsp_min_max_power(const float *buf, int n, float *min, float *max,
+		float *power);
+
+int eq_set_band(int band, float freq, float gain_db, float q);
+void eq_process(float *buf, int nb_frames);
+float eq_response_db(float freq);
+
+int reverb_load(const char *url);
+void reverb_unload();
+void reverb_set_gain(float gain);
+void reverb_process(float *buf, int nb_frames);
+
+void gain_set_volume(float volume);
+void gain_set_replay_gain_mode(int mode);
+void replay_gain_read(AVFormatContext *fmt_ctx, int stream_index,
+		ReplayGain *rg);
+void gain_to_s16(int16_t *dst, const float *src, int nb_frames,
+		const ReplayGain *rg);
+
+void spectrum_write(const float *buf, int nb_frames);
+uint8_t *spectrum_get_buffer(int *size);
+int spectrum_configure(int fft_size, int nb_bins, float rate);
+
+void k_weighting_init(int rate, float *shelf, float *high_pass);
+void meter_process(const int16_t *buf, int nb_frames);
+void meter_get_snapshot(MeterSnapshot *s);
+
+int waveform_compute(const char *url, int nb_buckets, float *out);
+void waveform_cancel();
+
+int metadata_scan(const char **paths, int nb_paths, const char *table_path);
+void metadata_scan_cancel();
+
+int loudness_scan(const char **paths, const int *albums, int nb_paths,
+		const char *cache_path, LoudnessResult *results);
+void loudness_scan_cancel();
+
+int dynamics_set_compressor(bool enabled, bool rms, float threshold_db,
+		float ratio, float attack_ms, float release_ms, float makeup_db);
+int dynamics_set_limiter(bool enabled, float ceiling_db, float lookahead_ms);
+void dynamics_process(float *buf, int nb_frames);
+
+TimeStretch *time_stretch_alloc(int sample_rate, int channels,
+		int max_write);
+void time_stretch_flush(TimeStretch *ts);
+bool time_stretch_active(TimeStretch *ts);
+int time_stretch_wants(TimeStretch *ts);
+int time_stretch_latency(TimeStretch *ts);
+int time_stretch_write(TimeStretch *ts, const float *src, int nb_frames);
+int time_stretch_read(TimeStretch *ts, float *dst, int nb_frames,
+		double speed);
+void time_stretch_free(TimeStretch **pts);
+
+int64_t pcm_export(const char *url, const ExportParams *params,
+		ExportWriteFunc write, void *opaque);
+int64_t pcm_export_fd(const char *url, const ExportParams *params, int fd);
+
+int clip_decode(const char *url, float **pcm);
+int clip_bank_load(const char *url);
+ClipBuffer *clip_bank_ref(int id);
+void clip_bank_unref(ClipBuffer *buffer);
+void clip_bank_unload(int id);
+void clip_bank_set_budget(int64_t bytes);
+void clip_bank_get_stats(int64_t *stats);
+
+void mixer_unload(int id);
+int mixer_play(int id, float gain, float pan, int64_t start);
+void mixer_set_voice(int handle, float gain, float pan);
+void mixer_stop(int handle);
+int64_t mixer_get_time();
+bool mixer_active();
+void mixer_render(float *dst, int nb_frames);
+
+void audio_decoder_init(AudioDecoder *d, AVCodecContext *avctx, AVStream *st,
+		PacketQueue *q, const AudioParams *tgt);
+void audio_decoder_destroy(AudioDecoder *d);
+int audio_decoder_read(AudioDecoder *d, uint8_t *buf, int len);
+int audio_decoder_prefill(AudioDecoder *d, int size);
+int find_audio_stream(AVFormatContext *fmt_ctx);
+int open_audio_decoder(AVFormatContext *fmt_ctx, int stream_index,
+		bool probed);
+void set_output_params(int sample_rate, int channels);
+void fix_output_params();
+void player_global_init();
+void player_global_init_async();
+void player_network_init();
 void* open_media(void *argv);
+int player_read_audio(int16_t *buf, int nb_frames);
 int createEngine();
 int createBufferQueueAudioPlayer();
+int openOutput();
 void fireOnPlayer();
+void flushPlayer();
+bool isPlayerIdle();
+void request_seek(int64_t pos);
+void scrub_begin();
+int64_t scrub_end();
 
 extern GlobalContext global_context;
 
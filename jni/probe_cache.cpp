@@ -0,0 +1,420 @@
+
+#include "player.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define PROBE_CACHE_MAGIC MKTAG('F', 'O', 'P', 'C')
+#define PROBE_CACHE_VERSION 1
+#define PROBE_CACHE_HASH_SIZE (16 * 1024)
+#define PROBE_CACHE_MAX_INDEX 256
+
+// On-disk layout, read back with a single mmap():
+//   ProbeCacheHeader | extradata, padded to 8 bytes | SeekIndexEntry[]
+// Everything is stored in native byte order, the file never leaves the
+// device it was written on.
+typedef struct ProbeCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+
+	// file identity
+	int64_t file_size;
+	int64_t file_mtime;
+	uint32_t header_hash;
+
+	// selected audio stream
+	int32_t stream_index;
+	int32_t codec_id;
+	int32_t codec_tag;
+	int32_t format;
+	int32_t sample_rate;
+	int32_t channels;
+	int32_t block_align;
+	int32_t frame_size;
+	int32_t bits_per_coded_sample;
+	int32_t initial_padding;
+	int32_t trailing_padding;
+	uint64_t channel_layout;
+	int64_t bit_rate;
+	int32_t time_base_num;
+	int32_t time_base_den;
+	int64_t start_time; // in stream time base
+	int64_t duration; // container duration, AV_TIME_BASE units
+
+	char format_name[32];
+
+	int32_t extradata_size;
+	int32_t nb_index_entries;
+} ProbeCacheHeader;
+
+struct ProbeCache {
+	char path[1024];
+
+	// identity of the media being opened
+	int64_t file_size;
+	int64_t file_mtime;
+	uint32_t header_hash;
+
+	// valid entry mapped from path, NULL on a miss
+	const ProbeCacheHeader *header;
+	size_t map_size;
+};
+
+static const uint8_t *probe_cache_extradata(const ProbeCacheHeader *header) {
+	return (const uint8_t*) (header + 1);
+}
+
+static const SeekIndexEntry *probe_cache_index(const ProbeCacheHeader *header) {
+	return (const SeekIndexEntry*) (probe_cache_extradata(header)
+			+ FFALIGN(header->extradata_size, 8));
+}
+
+// identity of src: stat() data plus a hash of the first bytes, so files
+// rewritten within the mtime granularity are still told apart
+static int probe_cache_identify(ProbeCache *pc, const MediaSource *src,
+		char *key, int key_size) {
+	uint8_t buf[PROBE_CACHE_HASH_SIZE];
+	struct stat st;
+	int64_t offset = 0;
+	ssize_t n;
+	int fd;
+
+	switch (src->type) {
+	case MEDIA_SOURCE_URL: {
+		const char *path = src->url;
+
+		if (strstr(path, "://") && !av_strstart(path, "file:", &path)) {
+			return -1;
+		}
+
+		fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			return -1;
+		}
+
+		snprintf(key, key_size, "%s", path);
+		break;
+	}
+	case MEDIA_SOURCE_FD:
+		fd = dup(src->fd);
+		if (fd < 0) {
+			return -1;
+		}
+
+		offset = src->offset;
+		break;
+	default:
+		// in-memory media has no identity that outlives the session
+		return -1;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	if (src->type == MEDIA_SOURCE_FD) {
+		snprintf(key, key_size, "fd:%llx:%llx:%" PRId64 ":%" PRId64,
+				(unsigned long long) st.st_dev, (unsigned long long) st.st_ino,
+				src->offset, src->length);
+	}
+
+	pc->file_size = st.st_size;
+	pc->file_mtime = st.st_mtime;
+
+	n = pread64(fd, buf, sizeof(buf), offset);
+	close(fd);
+
+	if (n < 0) {
+		return -1;
+	}
+
+	pc->header_hash = av_adler32_update(1, buf, n);
+	return 0;
+}
+
+ProbeCache *probe_cache_open(const MediaSource *src, const char *cache_dir) {
+	const ProbeCacheHeader *header;
+	ProbeCache *pc;
+	char key[1024];
+	uint8_t md5[16];
+	struct stat st;
+	int64_t remaining, extradata;
+	void *map;
+	int fd, i, j;
+
+	pc = (ProbeCache*) av_mallocz(sizeof(ProbeCache));
+	if (!pc) {
+		return NULL;
+	}
+
+	if (probe_cache_identify(pc, src, key, sizeof(key)) < 0) {
+		av_free(pc);
+		return NULL;
+	}
+
+	av_md5_sum(md5, (const uint8_t*) key, strlen(key));
+	i = snprintf(pc->path, sizeof(pc->path), "%s/", cache_dir);
+	for (j = 0; j < 16 && i < (int) sizeof(pc->path) - 8; j++) {
+		i += snprintf(pc->path + i, 3, "%02x", md5[j]);
+	}
+	av_strlcat(pc->path, ".probe", sizeof(pc->path));
+
+	fd = open(pc->path, O_RDONLY);
+	if (fd < 0) {
+		return pc;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(ProbeCacheHeader)) {
+		close(fd);
+		return pc;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map) {
+		return pc;
+	}
+
+	// each size is bounded by what is left of the file on its own, a sum
+	// could wrap in the 32-bit size_t of armeabi
+	header = (const ProbeCacheHeader*) map;
+	remaining = st.st_size - (int64_t) sizeof(ProbeCacheHeader);
+	extradata = FFALIGN((int64_t) header->extradata_size, 8);
+	if (header->magic != PROBE_CACHE_MAGIC
+			|| header->version != PROBE_CACHE_VERSION
+			|| header->file_size != pc->file_size
+			|| header->file_mtime != pc->file_mtime
+			|| header->header_hash != pc->header_hash
+			|| header->extradata_size < 0 || header->nb_index_entries < 0
+			|| extradata > remaining
+			|| header->nb_index_entries
+					> (remaining - extradata) / (int64_t) sizeof(SeekIndexEntry)) {
+		// stale or foreign entry, it is rewritten after probing
+		munmap(map, st.st_size);
+		return pc;
+	}
+
+	pc->header = header;
+	pc->map_size = st.st_size;
+
+	return pc;
+}
+
+// demuxer that produced the entry, skips format probing; NULL on a miss
+AVInputFormat *probe_cache_input_format(ProbeCache *pc) {
+	if (!pc || !pc->header) {
+		return NULL;
+	}
+
+	return av_find_input_format(pc->header->format_name);
+}
+
+/**
+ * Configures the cached audio stream of an opened input, in place of
+ * avformat_find_stream_info().
+ *
+ * @return index of the audio stream, -1 on a miss or a mismatch
+ */
+int probe_cache_apply(ProbeCache *pc, AVFormatContext *fmt_ctx) {
+	const ProbeCacheHeader *header;
+	const SeekIndexEntry *index;
+	AVCodecParameters *par;
+	AVStream *st;
+	int i;
+
+	if (!pc || !pc->header) {
+		return -1;
+	}
+
+	header = pc->header;
+	if (header->stream_index < 0
+			|| header->stream_index >= (int) fmt_ctx->nb_streams) {
+		return -1;
+	}
+
+	st = fmt_ctx->streams[header->stream_index];
+	par = st->codecpar;
+	if (par->codec_type != AVMEDIA_TYPE_AUDIO
+			|| (par->codec_id != AV_CODEC_ID_NONE
+					&& par->codec_id != header->codec_id)) {
+		return -1;
+	}
+
+	if (st->time_base.num != header->time_base_num
+			|| st->time_base.den != header->time_base_den) {
+		return -1;
+	}
+
+	if (header->extradata_size > 0) {
+		uint8_t *extradata = (uint8_t*) av_mallocz(
+				header->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+		if (!extradata) {
+			return -1;
+		}
+		memcpy(extradata, probe_cache_extradata(header),
+				header->extradata_size);
+		av_free(par->extradata);
+		par->extradata = extradata;
+		par->extradata_size = header->extradata_size;
+	}
+
+	par->codec_id = (enum AVCodecID) header->codec_id;
+	par->codec_tag = header->codec_tag;
+	par->format = header->format;
+	par->sample_rate = header->sample_rate;
+	par->channels = header->channels;
+	par->channel_layout = header->channel_layout;
+	par->block_align = header->block_align;
+	par->frame_size = header->frame_size;
+	par->bits_per_coded_sample = header->bits_per_coded_sample;
+	par->initial_padding = header->initial_padding;
+	par->trailing_padding = header->trailing_padding;
+	par->bit_rate = header->bit_rate;
+
+	if (st->start_time == AV_NOPTS_VALUE) {
+		st->start_time = header->start_time;
+	}
+	if (fmt_ctx->duration == AV_NOPTS_VALUE) {
+		fmt_ctx->duration = header->duration;
+	}
+
+	// seed the demuxer index, it bounds the binary search of generic seeks
+	index = probe_cache_index(header);
+	for (i = 0; i < header->nb_index_entries; i++) {
+		av_add_index_entry(st, index[i].pos, index[i].timestamp, 0, 0,
+				index[i].flags & AVINDEX_KEYFRAME);
+	}
+
+	return header->stream_index;
+}
+
+const SeekIndexEntry *probe_cache_get_index(ProbeCache *pc, int *nb_entries) {
+	if (!pc || !pc->header) {
+		*nb_entries = 0;
+		return NULL;
+	}
+
+	*nb_entries = pc->header->nb_index_entries;
+	return probe_cache_index(pc->header);
+}
+
+/**
+ * Writes the probe results of the opened input to the cache entry.
+ *
+ * @param index      seek index to store, NULL to sample the demuxer index
+ * @param nb_entries number of entries in index
+ */
+int probe_cache_store(ProbeCache *pc, AVFormatContext *fmt_ctx,
+		int stream_index, const SeekIndexEntry *index, int nb_entries) {
+	ProbeCacheHeader header = { 0 };
+	SeekIndexEntry *entries = NULL;
+	AVStream *st = fmt_ctx->streams[stream_index];
+	AVCodecParameters *par = st->codecpar;
+	char tmp_path[1040];
+	static const uint8_t zero[8] = { 0 };
+	int fd, i, ret = -1;
+
+	if (!pc) {
+		return -1;
+	}
+
+	header.magic = PROBE_CACHE_MAGIC;
+	header.version = PROBE_CACHE_VERSION;
+	header.file_size = pc->file_size;
+	header.file_mtime = pc->file_mtime;
+	header.header_hash = pc->header_hash;
+	header.stream_index = stream_index;
+	header.codec_id = par->codec_id;
+	header.codec_tag = par->codec_tag;
+	header.format = par->format;
+	header.sample_rate = par->sample_rate;
+	header.channels = par->channels;
+	header.block_align = par->block_align;
+	header.frame_size = par->frame_size;
+	header.bits_per_coded_sample = par->bits_per_coded_sample;
+	header.initial_padding = par->initial_padding;
+	header.trailing_padding = par->trailing_padding;
+	header.channel_layout = par->channel_layout;
+	header.bit_rate = par->bit_rate;
+	header.time_base_num = st->time_base.num;
+	header.time_base_den = st->time_base.den;
+	header.start_time = st->start_time;
+	header.duration = fmt_ctx->duration;
+	header.extradata_size = par->extradata_size;
+	av_strlcpy(header.format_name, fmt_ctx->iformat->name,
+			sizeof(header.format_name));
+
+	// a comma separated list of names is not a valid av_find_input_format()
+	// argument, keep the first one
+	for (i = 0; header.format_name[i]; i++) {
+		if (header.format_name[i] == ',') {
+			header.format_name[i] = 0;
+			break;
+		}
+	}
+
+	if (!index && st->nb_index_entries > 0) {
+		// coarse sample of the demuxer index
+		int step = (st->nb_index_entries + PROBE_CACHE_MAX_INDEX - 1)
+				/ PROBE_CACHE_MAX_INDEX;
+
+		entries = (SeekIndexEntry*) av_malloc_array(PROBE_CACHE_MAX_INDEX,
+				sizeof(SeekIndexEntry));
+		if (entries) {
+			for (i = 0; i < st->nb_index_entries; i += step) {
+				SeekIndexEntry *e = entries + nb_entries++;
+				e->timestamp = st->index_entries[i].timestamp;
+				e->pos = st->index_entries[i].pos;
+				e->flags = st->index_entries[i].flags;
+				e->reserved = 0;
+			}
+			index = entries;
+		}
+	}
+	if (!index) {
+		nb_entries = 0;
+	}
+	header.nb_index_entries = nb_entries;
+
+	// write aside and rename, mapped readers keep the old inode
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", pc->path);
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd >= 0) {
+		size_t pad = FFALIGN(header.extradata_size, 8) - header.extradata_size;
+		size_t index_size = nb_entries * sizeof(SeekIndexEntry);
+
+		if (write(fd, &header, sizeof(header)) == sizeof(header)
+				&& write(fd, par->extradata, header.extradata_size)
+						== header.extradata_size
+				&& write(fd, zero, pad) == (ssize_t) pad
+				&& write(fd, index, index_size) == (ssize_t) index_size) {
+			ret = 0;
+		}
+		close(fd);
+
+		if (0 == ret && rename(tmp_path, pc->path) == 0) {
+			ret = 0;
+		} else {
+			unlink(tmp_path);
+			ret = -1;
+		}
+	}
+
+	av_free(entries);
+	return ret;
+}
+
+void probe_cache_close(ProbeCache **ppc) {
+	ProbeCache *pc = *ppc;
+
+	if (!pc) {
+		return;
+	}
+
+	if (pc->header) {
+		munmap((void*) pc->header, pc->map_size);
+	}
+
+	av_freep(ppc);
+}
@@ -0,0 +1,270 @@
+
+#include "player.h"
+
+#include <math.h>
+
+// partition length; the wet signal lags the dry one by one partition
+#define REVERB_BLOCK_BITS 9
+#define REVERB_BLOCK (1 << REVERB_BLOCK_BITS)
+#define REVERB_FFT_SIZE (REVERB_BLOCK * 2)
+
+// impulse responses are cut to this length, which bounds the CPU
+#define REVERB_MAX_SECONDS 4
+
+// Convolution reverb by uniformly partitioned overlap-save. The impulse
+// response is cut into partitions of REVERB_BLOCK frames whose spectra are
+// computed once; every block of input is transformed once, kept in a
+// frequency-domain delay line, and multiplied with all partitions, so the
+// cost of a block grows linearly with the length of the response.
+struct Reverb {
+	int channels;
+	int nb_parts;
+	RDFTContext *rdft;
+	RDFTContext *irdft;
+
+	float *ir; // [channels][nb_parts][REVERB_FFT_SIZE] spectra
+	float *fdl; // [channels][nb_parts][REVERB_FFT_SIZE] input spectra
+	int fdl_pos; // partition slot of the newest input block
+
+	float *in; // [channels][REVERB_FFT_SIZE] last two input blocks
+	float *wet; // [channels][REVERB_BLOCK] output of the last block
+	float *acc; // REVERB_FFT_SIZE
+	int pos; // frames of the current block
+};
+
+static Reverb *reverb;
+static float reverb_gain = 0.3f;
+static pthread_mutex_t reverb_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t reverb_frames;
+static int64_t reverb_cpu_us;
+
+static void reverb_free(Reverb **pr) {
+	Reverb *r = *pr;
+
+	if (!r) {
+		return;
+	}
+
+	if (r->rdft) {
+		av_rdft_end(r->rdft);
+	}
+	if (r->irdft) {
+		av_rdft_end(r->irdft);
+	}
+	av_freep(&r->ir);
+	av_freep(&r->fdl);
+	av_freep(&r->in);
+	av_freep(&r->wet);
+	av_freep(&r->acc);
+	av_freep(pr);
+}
+
+// spectra of the partitions of the interleaved response
+static void reverb_set_ir(Reverb *r, const float *pcm, int nb_frames) {
+	int channels = r->channels;
+	double energy = 0, scale;
+	int ch, p, i, n;
+
+	// unit energy in the loudest channel, the wet gain then means the same
+	// for every response
+	for (ch = 0; ch < channels; ch++) {
+		double e = 0;
+		for (i = 0; i < nb_frames; i++) {
+			e += (double) pcm[i * channels + ch] * pcm[i * channels + ch];
+		}
+		energy = FFMAX(energy, e);
+	}
+	scale = energy > 0 ? 1 / sqrt(energy) : 0;
+
+	for (ch = 0; ch < channels; ch++) {
+		for (p = 0; p < r->nb_parts; p++) {
+			float *h = r->ir + (ch * r->nb_parts + p) * REVERB_FFT_SIZE;
+			n = FFMIN(REVERB_BLOCK, nb_frames - p * REVERB_BLOCK);
+			for (i = 0; i < n; i++) {
+				h[i] = (float) (pcm[(p * REVERB_BLOCK + i) * channels + ch]
+						* scale);
+			}
+			av_rdft_calc(r->rdft, h);
+		}
+	}
+}
+
+/**
+ * Loads an impulse response, replacing the current one. It is decoded to
+ * the output format, which is fixed from then on.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int reverb_load(const char *url) {
+	Reverb *r, *old;
+	float *pcm = NULL;
+	int channels, nb_frames, max_frames, size;
+
+	player_global_init();
+	fix_output_params();
+
+	size = clip_decode(url, &pcm);
+	if (size <= 0) {
+		return -1;
+	}
+
+	channels = global_context.audio_tgt.channels;
+	nb_frames = size / global_context.audio_tgt.frame_size;
+	max_frames = global_context.audio_tgt.freq * REVERB_MAX_SECONDS;
+	if (nb_frames > max_frames) {
+		av_log(NULL, AV_LOG_WARNING, "reverb : %s cut to %d s\n", url,
+				REVERB_MAX_SECONDS);
+		nb_frames = max_frames;
+	}
+
+	r = (Reverb*) av_mallocz(sizeof(Reverb));
+	if (!r) {
+		av_free(pcm);
+		return -1;
+	}
+
+	r->channels = channels;
+	r->nb_parts = (nb_frames + REVERB_BLOCK - 1) / REVERB_BLOCK;
+	r->rdft = av_rdft_init(REVERB_BLOCK_BITS + 1, DFT_R2C);
+	r->irdft = av_rdft_init(REVERB_BLOCK_BITS + 1, IDFT_C2R);
+	r->ir = (float*) av_mallocz_array(channels * r->nb_parts,
+			REVERB_FFT_SIZE * sizeof(float));
+	r->fdl = (float*) av_mallocz_array(channels * r->nb_parts,
+			REVERB_FFT_SIZE * sizeof(float));
+	r->in = (float*) av_mallocz_array(channels,
+			REVERB_FFT_SIZE * sizeof(float));
+	r->wet = (float*) av_mallocz_array(channels,
+			REVERB_BLOCK * sizeof(float));
+	r->acc = (float*) av_malloc(REVERB_FFT_SIZE * sizeof(float));
+	if (!r->rdft || !r->irdft || !r->ir || !r->fdl || !r->in || !r->wet
+			|| !r->acc) {
+		av_free(pcm);
+		reverb_free(&r);
+		return -1;
+	}
+
+	reverb_set_ir(r, pcm, nb_frames);
+	av_free(pcm);
+
+	LOGV("reverb : %s, %d frames in %d partitions", url, nb_frames,
+			r->nb_parts);
+
+	pthread_mutex_lock(&reverb_mutex);
+	old = reverb;
+	reverb = r;
+	pthread_mutex_unlock(&reverb_mutex);
+
+	reverb_free(&old);
+	return 0;
+}
+
+// removes the reverb from the output
+void reverb_unload() {
+	Reverb *old;
+
+	pthread_mutex_lock(&reverb_mutex);
+	old = reverb;
+	reverb = NULL;
+	pthread_mutex_unlock(&reverb_mutex);
+
+	reverb_free(&old);
+}
+
+// level of the reverberated signal added to the dry one, 0 to 1
+void reverb_set_gain(float gain) {
+	reverb_gain = gain;
+}
+
+// convolves the last full block of each channel into wet
+static void reverb_block(Reverb *r) {
+	int ch, p, slot;
+
+	r->fdl_pos = (r->fdl_pos + 1) % r->nb_parts;
+
+	for (ch = 0; ch < r->channels; ch++) {
+		float *in = r->in + ch * REVERB_FFT_SIZE;
+		float *fdl = r->fdl + ch * r->nb_parts * REVERB_FFT_SIZE;
+		float *ir = r->ir + ch * r->nb_parts * REVERB_FFT_SIZE;
+		float *x = fdl + r->fdl_pos * REVERB_FFT_SIZE;
+
+		memcpy(x, in, REVERB_FFT_SIZE * sizeof(float));
+		av_rdft_calc(r->rdft, x);
+
+		// the newest input block meets the first partition, and so on
+		memset(r->acc, 0, REVERB_FFT_SIZE * sizeof(float));
+		for (p = 0; p < r->nb_parts; p++) {
+			const float *h = ir + p * REVERB_FFT_SIZE;
+			slot = (r->fdl_pos - p + r->nb_parts) % r->nb_parts;
+			x = fdl + slot * REVERB_FFT_SIZE;
+
+			// DC and Nyquist are packed as two reals in front
+			r->acc[0] += x[0] * h[0];
+			r->acc[1] += x[1] * h[1];
+			dsp_complex_mac(r->acc + 2, x + 2, h + 2, REVERB_FFT_SIZE - 2);
+		}
+
+		// the second half is free of circular wrap-around
+		av_rdft_calc(r->irdft, r->acc);
+		for (p = 0; p < REVERB_BLOCK; p++) {
+			r->wet[ch * REVERB_BLOCK + p] = r->acc[REVERB_BLOCK + p]
+					* (2.0f / REVERB_FFT_SIZE);
+		}
+
+		memcpy(in, in + REVERB_BLOCK, REVERB_BLOCK * sizeof(float));
+	}
+}
+
+// adds the reverb of nb_frames of output in place, in the output callback
+void reverb_process(float *buf, int nb_frames) {
+	float gain = reverb_gain;
+	Reverb *r;
+	int64_t cpu;
+	int i, ch, n;
+
+	pthread_mutex_lock(&reverb_mutex);
+
+	r = reverb;
+	if (!r || gain <= 0 || r->channels != global_context.audio_tgt.channels) {
+		pthread_mutex_unlock(&reverb_mutex);
+		return;
+	}
+
+	cpu = get_thread_cpu_time();
+
+	for (i = 0; i < nb_frames; i += n) {
+		n = FFMIN(nb_frames - i, REVERB_BLOCK - r->pos);
+
+		for (ch = 0; ch < r->channels; ch++) {
+			float *in = r->in + ch * REVERB_FFT_SIZE + REVERB_BLOCK + r->pos;
+			const float *wet = r->wet + ch * REVERB_BLOCK + r->pos;
+			float *frame = buf + i * r->channels + ch;
+			int k;
+
+			for (k = 0; k < n; k++) {
+				in[k] = frame[k * r->channels];
+				frame[k * r->channels] += wet[k] * gain;
+			}
+		}
+
+		r->pos += n;
+		if (r->pos == REVERB_BLOCK) {
+			reverb_block(r);
+			r->pos = 0;
+		}
+	}
+
+	reverb_cpu_us += get_thread_cpu_time() - cpu;
+	reverb_frames += nb_frames;
+	if (reverb_frames >= global_context.audio_tgt.freq) {
+		global_context.reverb_load = (int) (reverb_cpu_us * 100
+				* global_context.audio_tgt.freq
+				/ (reverb_frames * AV_TIME_BASE));
+		LOGV2("reverb : %d partitions, %lld us CPU per %lld frames (%d%%)",
+				r->nb_parts, (long long) reverb_cpu_us,
+				(long long) reverb_frames, global_context.reverb_load);
+		reverb_frames = reverb_cpu_us = 0;
+	}
+
+	pthread_mutex_unlock(&reverb_mutex);
+}
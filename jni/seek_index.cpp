@@ -0,0 +1,281 @@
+
+#include "player.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+// one entry per half second of audio
+#define SEEK_INDEX_INTERVAL (AV_TIME_BASE / 2)
+#define SEEK_INDEX_NICE 10
+
+// Time-to-byte index for containers without a usable native one (MPEG-TS,
+// MP3 without a TOC). A low priority thread demuxes the file ahead of
+// playback through its own context, recording the byte position of an
+// audio packet every SEEK_INDEX_INTERVAL; seeks then jump straight to the
+// entry found by binary search instead of bisecting the file.
+struct SeekIndex {
+	SeekIndexEntry *entries; // sorted by timestamp
+	int nb_entries;
+	int entries_alloc;
+	int complete; // the indexer reached the end of the file
+
+	int64_t interval; // in stream time base
+
+	MediaSource source;
+	AVInputFormat *input_format;
+	int stream_index;
+	AVRational time_base;
+
+	int64_t build_us; // wall time of the indexer run
+	int64_t build_cpu_us; // CPU time of the indexer run
+
+	int abort_request;
+	bool thread_started;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+};
+
+static int seek_index_add(SeekIndex *si, int64_t timestamp, int64_t pos,
+		int flags) {
+	SeekIndexEntry *e;
+
+	pthread_mutex_lock(&si->mutex);
+
+	if (si->nb_entries > 0) {
+		SeekIndexEntry *last = si->entries + si->nb_entries - 1;
+		if (timestamp < last->timestamp + si->interval || pos <= last->pos) {
+			pthread_mutex_unlock(&si->mutex);
+			return 0;
+		}
+	}
+
+	if (si->nb_entries == si->entries_alloc) {
+		int alloc = FFMAX(256, si->entries_alloc * 2);
+		if (av_reallocp_array(&si->entries, alloc, sizeof(SeekIndexEntry))
+				< 0) {
+			si->nb_entries = si->entries_alloc = 0;
+			pthread_mutex_unlock(&si->mutex);
+			return AVERROR(ENOMEM);
+		}
+		si->entries_alloc = alloc;
+	}
+
+	e = si->entries + si->nb_entries++;
+	e->timestamp = timestamp;
+	e->pos = pos;
+	e->flags = flags;
+	e->reserved = 0;
+
+	pthread_mutex_unlock(&si->mutex);
+	return 0;
+}
+
+static int seek_index_interrupt_cb(void *opaque) {
+	SeekIndex *si = (SeekIndex*) opaque;
+	return si->abort_request || global_context.quit;
+}
+
+static void* seek_index_thread(void *arg) {
+	SeekIndex *si = (SeekIndex*) arg;
+	AVFormatContext *fmt_ctx = NULL;
+	MediaIO io = { 0 };
+	const char *url = NULL;
+	AVPacket pkt;
+	int64_t t = av_gettime_relative(), cpu = get_thread_cpu_time();
+	int64_t resume_pos = 0;
+	unsigned int i;
+	int ret;
+
+	// stay out of the way of the read loop and the audio callback
+	setpriority(PRIO_PROCESS, syscall(__NR_gettid), SEEK_INDEX_NICE);
+
+	fmt_ctx = avformat_alloc_context();
+	if (!fmt_ctx) {
+		return NULL;
+	}
+
+	fmt_ctx->interrupt_callback.callback = seek_index_interrupt_cb;
+	fmt_ctx->interrupt_callback.opaque = si;
+
+	if (media_io_open(&io, &si->source, fmt_ctx, &url) < 0
+			|| avformat_open_input(&fmt_ctx, url, si->input_format, NULL) < 0) {
+		goto end;
+	}
+
+	// the stream layout comes from the same demuxer, check it anyway
+	if (si->stream_index >= (int) fmt_ctx->nb_streams
+			|| fmt_ctx->streams[si->stream_index]->codecpar->codec_type
+					!= AVMEDIA_TYPE_AUDIO) {
+		goto end;
+	}
+
+	for (i = 0; i < fmt_ctx->nb_streams; i++) {
+		if ((int) i != si->stream_index) {
+			fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+		}
+	}
+
+	// continue where a previous session stopped
+	pthread_mutex_lock(&si->mutex);
+	if (si->nb_entries > 0) {
+		resume_pos = si->entries[si->nb_entries - 1].pos;
+	}
+	pthread_mutex_unlock(&si->mutex);
+
+	if (resume_pos > 0) {
+		avformat_seek_file(fmt_ctx, -1, resume_pos, resume_pos, resume_pos,
+				AVSEEK_FLAG_BYTE);
+	}
+
+	while (!si->abort_request && !global_context.quit) {
+		ret = av_read_frame(fmt_ctx, &pkt);
+		if (ret < 0) {
+			if (AVERROR_EOF == ret || avio_feof(fmt_ctx->pb)) {
+				si->complete = 1;
+			}
+			break;
+		}
+
+		if (pkt.stream_index == si->stream_index && pkt.pos >= 0) {
+			int64_t ts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+			if (ts != AV_NOPTS_VALUE) {
+				seek_index_add(si, ts, pkt.pos,
+						(pkt.flags & AV_PKT_FLAG_KEY) ? AVINDEX_KEYFRAME : 0);
+			}
+		}
+
+		av_free_packet(&pkt);
+	}
+
+	si->build_us = av_gettime_relative() - t;
+	si->build_cpu_us = get_thread_cpu_time() - cpu;
+	LOGV("seek index : %d entries%s in %lld us, %lld us CPU", si->nb_entries,
+			si->complete ? "" : " (partial)", (long long) si->build_us,
+			(long long) si->build_cpu_us);
+
+	end:
+
+	if (fmt_ctx) {
+		avformat_close_input(&fmt_ctx);
+	}
+	media_io_close(&io);
+
+	return NULL;
+}
+
+/**
+ * Creates an index for the audio stream of an opened input.
+ *
+ * @param cached     entries of a previous session, may be NULL
+ * @param nb_cached  number of entries in cached
+ */
+SeekIndex *seek_index_create(AVFormatContext *fmt_ctx, int stream_index,
+		const SeekIndexEntry *cached, int nb_cached) {
+	AVStream *st = fmt_ctx->streams[stream_index];
+	SeekIndex *si;
+
+	si = (SeekIndex*) av_mallocz(sizeof(SeekIndex));
+	if (!si) {
+		return NULL;
+	}
+
+	pthread_mutex_init(&si->mutex, NULL);
+
+	si->stream_index = stream_index;
+	si->time_base = st->time_base;
+	si->input_format = fmt_ctx->iformat;
+	si->interval = av_rescale_q(SEEK_INDEX_INTERVAL, AV_TIME_BASE_Q,
+			st->time_base);
+
+	if (nb_cached > 0) {
+		si->entries = (SeekIndexEntry*) av_malloc_array(nb_cached,
+				sizeof(SeekIndexEntry));
+		if (si->entries) {
+			memcpy(si->entries, cached, nb_cached * sizeof(SeekIndexEntry));
+			si->nb_entries = si->entries_alloc = nb_cached;
+		}
+	}
+
+	return si;
+}
+
+// starts the background indexer on src, which must be the opened media
+int seek_index_start(SeekIndex *si, const MediaSource *src) {
+	si->source = *src;
+
+	if (pthread_create(&si->thread, NULL, seek_index_thread, si)) {
+		av_log(NULL, AV_LOG_ERROR, "seek_index : pthread_create failure.\n");
+		return -1;
+	}
+
+	si->thread_started = true;
+	return 0;
+}
+
+/**
+ * Finds the last entry at or before timestamp.
+ *
+ * @return 0 if found, -1 if timestamp is outside the indexed range
+ */
+int seek_index_lookup(SeekIndex *si, int64_t timestamp, SeekIndexEntry *entry) {
+	int lo, hi, found = -1;
+
+	if (!si) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&si->mutex);
+
+	lo = 0;
+	hi = si->nb_entries - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (si->entries[mid].timestamp <= timestamp) {
+			found = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	// past the last entry only the complete index knows nothing follows
+	if (found >= 0 && found == si->nb_entries - 1 && !si->complete
+			&& timestamp - si->entries[found].timestamp > si->interval) {
+		found = -1;
+	}
+
+	if (found >= 0) {
+		*entry = si->entries[found];
+	}
+
+	pthread_mutex_unlock(&si->mutex);
+
+	return found >= 0 ? 0 : -1;
+}
+
+// stops the indexer; the entries stay readable for seek_index_entries()
+void seek_index_stop(SeekIndex *si) {
+	if (si && si->thread_started) {
+		si->abort_request = 1;
+		pthread_join(si->thread, NULL);
+		si->thread_started = false;
+	}
+}
+
+const SeekIndexEntry *seek_index_entries(SeekIndex *si, int *nb_entries) {
+	*nb_entries = si ? si->nb_entries : 0;
+	return si ? si->entries : NULL;
+}
+
+void seek_index_close(SeekIndex **psi) {
+	SeekIndex *si = *psi;
+
+	if (!si) {
+		return;
+	}
+
+	seek_index_stop(si);
+	pthread_mutex_destroy(&si->mutex);
+	av_freep(&si->entries);
+	av_freep(psi);
+}
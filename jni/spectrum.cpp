@@ -0,0 +1,288 @@
+
+#include "player.h"
+
+#include <math.h>
+
+#define SPECTRUM_MIN_BITS 8
+#define SPECTRUM_MAX_BITS 12
+#define SPECTRUM_MAX_BINS 256
+#define SPECTRUM_MAX_RATE 60
+
+// mono frames of the tap, four times the largest window
+#define SPECTRUM_RING (1 << 14)
+
+#define SPECTRUM_MIN_FREQ 20
+#define SPECTRUM_MAX_FREQ 20000
+#define SPECTRUM_FLOOR_DB -120
+
+// CPU the analysis may take per second, 2% of one core; frames are
+// spaced out beyond the requested rate to stay within it
+#define SPECTRUM_CPU_BUDGET_US 20000
+
+// Shared with Java through a direct ByteBuffer, in native byte order:
+//   SpectrumHeader | float bins[2][SPECTRUM_MAX_BINS]
+// The analysis fills the half Java is not told about, switches front to
+// it and then bumps sequence; a reader copies bins[front] and retries when
+// sequence changed meanwhile. Values are dBFS, 0 for a full scale sine.
+typedef struct SpectrumHeader {
+	volatile int32_t sequence;
+	volatile int32_t front;
+	int32_t nb_bins;
+	int32_t sample_rate;
+	float min_freq; // lower edge of the first bin
+	float max_freq; // upper edge of the last bin
+	int32_t reserved[2];
+} SpectrumHeader;
+
+#define SPECTRUM_SHARED_SIZE (sizeof(SpectrumHeader) \
+		+ 2 * SPECTRUM_MAX_BINS * sizeof(float))
+
+// Analysis tap on the float output. The output callback only downmixes
+// into a ring, never taking a lock; a thread of its own picks the newest
+// window from there at the requested rate and publishes log-spaced
+// magnitudes. A frame is skipped when the output did not move, so a
+// paused player costs nothing.
+static uint8_t *shared; // never freed, Java may hold it at any time
+static float ring[SPECTRUM_RING];
+static volatile unsigned int ring_pos;
+static volatile int tap_enabled;
+
+static int spectrum_bits;
+static int spectrum_bins;
+static float spectrum_rate;
+
+static int spectrum_abort;
+static bool thread_started;
+static pthread_t thread;
+static pthread_mutex_t spectrum_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t spectrum_cond = PTHREAD_COND_INITIALIZER;
+
+// called by the output callback with the final float output
+void spectrum_write(const float *buf, int nb_frames) {
+	int channels = global_context.audio_tgt.channels;
+	unsigned int pos = ring_pos;
+	int i;
+
+	if (!tap_enabled) {
+		return;
+	}
+
+	if (channels == 2) {
+		for (i = 0; i < nb_frames; i++) {
+			ring[(pos + i) & (SPECTRUM_RING - 1)] = (buf[i * 2] + buf[i * 2 + 1])
+					* 0.5f;
+		}
+	} else {
+		for (i = 0; i < nb_frames; i++) {
+			ring[(pos + i) & (SPECTRUM_RING - 1)] = buf[i * channels];
+		}
+	}
+
+	// the samples are in place before the reader can see them
+	__sync_synchronize();
+	ring_pos = pos + nb_frames;
+}
+
+// first FFT bin of every output bin, log-spaced between the frequency limits
+static void spectrum_set_edges(int *edges, int nb_bins, int bits, int rate) {
+	float max_freq = FFMIN(SPECTRUM_MAX_FREQ, rate / 2);
+	SpectrumHeader *header = (SpectrumHeader*) shared;
+	int half = 1 << (bits - 1), b;
+
+	for (b = 0; b <= nb_bins; b++) {
+		double f = SPECTRUM_MIN_FREQ
+				* pow(max_freq / SPECTRUM_MIN_FREQ, (double) b / nb_bins);
+		edges[b] = av_clip((int) lrint(f * (2 * half) / rate), 1, half);
+	}
+
+	header->nb_bins = nb_bins;
+	header->sample_rate = rate;
+	header->min_freq = SPECTRUM_MIN_FREQ;
+	header->max_freq = max_freq;
+}
+
+// log-binned magnitudes of the RDFT output x into the back buffer
+static void spectrum_publish(const float *x, const int *edges, int nb_bins,
+		int bits, float scale_db) {
+	SpectrumHeader *header = (SpectrumHeader*) shared;
+	int half = 1 << (bits - 1), back = !header->front, b, k;
+	float *bins = (float*) (header + 1) + back * SPECTRUM_MAX_BINS;
+
+	for (b = 0; b < nb_bins; b++) {
+		// bins narrower than the FFT resolution repeat their FFT bin
+		int lo = FFMIN(edges[b], half - 1);
+		int hi = FFMIN(FFMAX(edges[b + 1], lo + 1), half);
+		float peak = 0;
+
+		for (k = lo; k < hi; k++) {
+			float p = x[k * 2] * x[k * 2] + x[k * 2 + 1] * x[k * 2 + 1];
+			peak = FFMAX(peak, p);
+		}
+
+		bins[b] = peak > 0 ?
+				FFMAX(10 * log10f(peak) + scale_db, (float) SPECTRUM_FLOOR_DB) :
+				(float) SPECTRUM_FLOOR_DB;
+	}
+
+	__sync_synchronize();
+	header->front = back;
+	__sync_synchronize();
+	header->sequence++;
+}
+
+static void spectrum_wait(int64_t us) {
+	struct timespec ts;
+	int64_t t;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	t = (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + us;
+	ts.tv_sec = (time_t) (t / 1000000);
+	ts.tv_nsec = (long) (t % 1000000) * 1000;
+
+	pthread_mutex_lock(&spectrum_mutex);
+	if (!spectrum_abort) {
+		pthread_cond_timedwait(&spectrum_cond, &spectrum_mutex, &ts);
+	}
+	pthread_mutex_unlock(&spectrum_mutex);
+}
+
+static void* spectrum_thread(void *arg) {
+	int bits = spectrum_bits, nb_bins = spectrum_bins;
+	int size = 1 << bits, rate = 0, i;
+	int64_t interval = (int64_t) (AV_TIME_BASE / spectrum_rate);
+	int64_t period_cpu = 0, period_us = 0;
+	int edges[SPECTRUM_MAX_BINS + 1];
+	unsigned int last_pos = ring_pos - 1;
+	RDFTContext *rdft;
+	float *window, *x;
+	float scale_db;
+	double sum = 0;
+
+	rdft = av_rdft_init(bits, DFT_R2C);
+	window = (float*) av_malloc_array(size, sizeof(float));
+	x = (float*) av_malloc_array(size, sizeof(float));
+	if (!rdft || !window || !x) {
+		goto end;
+	}
+
+	// Hann window; a full scale sine peaks at sum / 2 in its bin
+	for (i = 0; i < size; i++) {
+		window[i] = (float) (0.5 - 0.5 * cos(2 * M_PI * i / size));
+		sum += window[i];
+	}
+	scale_db = (float) (20 * log10(2 / sum));
+
+	while (!spectrum_abort) {
+		int64_t cpu = get_thread_cpu_time(), wait;
+		unsigned int pos = ring_pos;
+
+		__sync_synchronize();
+		if (pos != last_pos && global_context.audio_tgt.freq > 0) {
+			if (rate != global_context.audio_tgt.freq) {
+				rate = global_context.audio_tgt.freq;
+				spectrum_set_edges(edges, nb_bins, bits, rate);
+			}
+
+			for (i = 0; i < size; i++) {
+				x[i] = ring[(pos - size + i) & (SPECTRUM_RING - 1)] * window[i];
+			}
+			av_rdft_calc(rdft, x);
+			spectrum_publish(x, edges, nb_bins, bits, scale_db);
+			last_pos = pos;
+		}
+
+		cpu = get_thread_cpu_time() - cpu;
+		wait = FFMAX(interval, cpu * AV_TIME_BASE / SPECTRUM_CPU_BUDGET_US);
+
+		period_cpu += cpu;
+		period_us += wait;
+		if (period_us >= AV_TIME_BASE) {
+			global_context.spectrum_cpu_us = period_cpu * AV_TIME_BASE
+					/ period_us;
+			period_cpu = period_us = 0;
+		}
+
+		spectrum_wait(wait);
+	}
+
+	end:
+
+	if (rdft) {
+		av_rdft_end(rdft);
+	}
+	av_free(window);
+	av_free(x);
+
+	return NULL;
+}
+
+static void spectrum_stop() {
+	if (!thread_started) {
+		return;
+	}
+
+	tap_enabled = 0;
+
+	pthread_mutex_lock(&spectrum_mutex);
+	spectrum_abort = 1;
+	pthread_cond_signal(&spectrum_cond);
+	pthread_mutex_unlock(&spectrum_mutex);
+
+	pthread_join(thread, NULL);
+	thread_started = false;
+}
+
+/**
+ * Returns the block shared with Java, see SpectrumHeader.
+ *
+ * @param size  set to the size of the block in bytes
+ */
+uint8_t *spectrum_get_buffer(int *size) {
+	if (!shared) {
+		shared = (uint8_t*) av_mallocz(SPECTRUM_SHARED_SIZE);
+	}
+
+	*size = shared ? (int) SPECTRUM_SHARED_SIZE : 0;
+	return shared;
+}
+
+/**
+ * Starts the analysis of the output, or stops it when rate is 0.
+ *
+ * @param fft_size  window length, a power of two from 256 to 4096
+ * @param nb_bins   log-spaced output bins, 8 to SPECTRUM_MAX_BINS
+ * @param rate      spectra per second, up to SPECTRUM_MAX_RATE
+ */
+int spectrum_configure(int fft_size, int nb_bins, float rate) {
+	int bits = av_log2(fft_size), size;
+
+	if (rate < 0 || rate > SPECTRUM_MAX_RATE || nb_bins < 8
+			|| nb_bins > SPECTRUM_MAX_BINS || fft_size != 1 << bits
+			|| bits < SPECTRUM_MIN_BITS || bits > SPECTRUM_MAX_BITS) {
+		return -1;
+	}
+
+	spectrum_stop();
+
+	if (!rate) {
+		return 0;
+	}
+
+	if (!spectrum_get_buffer(&size)) {
+		return -1;
+	}
+
+	spectrum_bits = bits;
+	spectrum_bins = nb_bins;
+	spectrum_rate = rate;
+	spectrum_abort = 0;
+
+	if (pthread_create(&thread, NULL, spectrum_thread, NULL)) {
+		av_log(NULL, AV_LOG_ERROR, "spectrum : pthread_create failure.\n");
+		return -1;
+	}
+
+	thread_started = true;
+	tap_enabled = 1;
+	return 0;
+}
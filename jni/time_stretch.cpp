@@ -0,0 +1,324 @@
+
+#include "player.h"
+
+#include <math.h>
+
+// segment length and search radius, in milliseconds; short enough for
+// speech, long enough to hold a couple of pitch periods
+#define TIME_STRETCH_WINDOW_MS 30
+#define TIME_STRETCH_SEARCH_MS 12
+
+// the coarse search tests every COARSE_STEP offset, then refines around
+// the best one
+#define TIME_STRETCH_COARSE_STEP 4
+
+// Tempo change without pitch change by WSOLA: output is built from
+// Hann-windowed segments of window frames, overlap-added every hop frames.
+// The next segment ideally starts hop * speed input frames after the last
+// one; it is moved by up to search frames to where the input looks most
+// like the natural continuation of the last segment, so the overlap adds
+// up without phase cancellation. The speed is read at every hop and can
+// change at any time.
+struct TimeStretch {
+	int channels;
+	int window; // segment length, twice hop
+	int hop; // output frames per segment
+	int search; // radius of the segment position search
+
+	float *in; // interleaved input, in_start onwards
+	float *mono; // downmix of in, for the search
+	int in_frames;
+	int capacity;
+	int64_t in_start; // input frame number of in[0]
+
+	double ana_pos; // ideal start of the next segment
+	int64_t prev_pos; // start of the last segment, -1 before the first
+	int64_t drain_pos; // >= 0 when passing the input through again
+
+	float *win; // Hann window of window frames
+	float *ola; // second half of the last segment, windowed
+	float *out; // hop frames of output
+	int out_frames;
+	int out_index;
+	double *energy; // prefix sums of mono squared over the search range
+};
+
+TimeStretch *time_stretch_alloc(int sample_rate, int channels,
+		int max_write) {
+	TimeStretch *ts;
+	int i, range;
+
+	ts = (TimeStretch*) av_mallocz(sizeof(TimeStretch));
+	if (!ts) {
+		return NULL;
+	}
+
+	ts->channels = channels;
+	ts->hop = sample_rate * TIME_STRETCH_WINDOW_MS / 2000;
+	ts->window = ts->hop * 2;
+	ts->search = sample_rate * TIME_STRETCH_SEARCH_MS / 1000;
+
+	// a segment, the search around it, the previous one and a write
+	ts->capacity = ts->window * 3 + ts->search * 2 + max_write;
+	range = ts->search * 2 + ts->hop + 1;
+
+	ts->in = (float*) av_malloc_array(ts->capacity * channels, sizeof(float));
+	ts->mono = (float*) av_malloc_array(ts->capacity, sizeof(float));
+	ts->win = (float*) av_malloc_array(ts->window, sizeof(float));
+	ts->ola = (float*) av_malloc_array(ts->hop * channels, sizeof(float));
+	ts->out = (float*) av_malloc_array(ts->hop * channels, sizeof(float));
+	ts->energy = (double*) av_malloc_array(range, sizeof(double));
+	if (!ts->in || !ts->mono || !ts->win || !ts->ola || !ts->out
+			|| !ts->energy) {
+		time_stretch_free(&ts);
+		return NULL;
+	}
+
+	// periodic, so that windows hop apart add up to exactly 1
+	for (i = 0; i < ts->window; i++) {
+		ts->win[i] = (float) (0.5 - 0.5 * cos(2 * M_PI * i / ts->window));
+	}
+
+	time_stretch_flush(ts);
+	return ts;
+}
+
+// drops all input and output, the next write starts a new stream
+void time_stretch_flush(TimeStretch *ts) {
+	if (!ts) {
+		return;
+	}
+
+	ts->in_frames = 0;
+	ts->in_start = 0;
+	ts->ana_pos = 0;
+	ts->prev_pos = -1;
+	ts->drain_pos = -1;
+	ts->out_frames = ts->out_index = 0;
+}
+
+// true while input or output is buffered, a bypass would skip it
+bool time_stretch_active(TimeStretch *ts) {
+	return ts && (ts->in_frames > 0 || ts->out_index < ts->out_frames);
+}
+
+// drops the input no later segment or search can reach
+static void time_stretch_compact(TimeStretch *ts) {
+	int channels = ts->channels;
+	int64_t keep;
+	int drop;
+
+	// the search range and the continuation of the last segment stay
+	keep = (int64_t) ts->ana_pos - ts->search;
+	if (ts->prev_pos >= 0) {
+		keep = FFMIN(keep, ts->prev_pos + ts->hop);
+	}
+	if (ts->drain_pos >= 0) {
+		keep = FFMIN(keep, ts->drain_pos);
+	}
+
+	drop = (int) av_clip64(keep - ts->in_start, 0, ts->in_frames);
+	if (drop > 0) {
+		memmove(ts->in, ts->in + drop * channels,
+				(ts->in_frames - drop) * channels * sizeof(float));
+		memmove(ts->mono, ts->mono + drop,
+				(ts->in_frames - drop) * sizeof(float));
+		ts->in_frames -= drop;
+		ts->in_start += drop;
+	}
+}
+
+// input frames to write before the next time_stretch_read() can succeed
+int time_stretch_wants(TimeStretch *ts) {
+	int64_t need = (int64_t) ts->ana_pos + ts->search + ts->window;
+
+	if (ts->drain_pos >= 0) {
+		return 0;
+	}
+
+	time_stretch_compact(ts);
+	return (int) av_clip64(need - (ts->in_start + ts->in_frames), 0,
+			ts->capacity - ts->in_frames);
+}
+
+// input frames buffered that were not heard yet, for the media clock
+int time_stretch_latency(TimeStretch *ts) {
+	int64_t heard;
+
+	if (!time_stretch_active(ts)) {
+		return 0;
+	}
+
+	heard = ts->drain_pos >= 0 ? ts->drain_pos : (int64_t) ts->ana_pos;
+	return (int) FFMAX(ts->in_start + ts->in_frames - heard, 0);
+}
+
+/**
+ * Appends input frames.
+ *
+ * @return frames taken, fewer than nb_frames only past time_stretch_wants()
+ */
+int time_stretch_write(TimeStretch *ts, const float *src, int nb_frames) {
+	int channels = ts->channels;
+	int i, c;
+
+	time_stretch_compact(ts);
+
+	nb_frames = FFMIN(nb_frames, ts->capacity - ts->in_frames);
+	memcpy(ts->in + ts->in_frames * channels, src,
+			nb_frames * channels * sizeof(float));
+	for (i = 0; i < nb_frames; i++) {
+		float sum = 0;
+		for (c = 0; c < channels; c++) {
+			sum += src[i * channels + c];
+		}
+		ts->mono[ts->in_frames + i] = sum;
+	}
+	ts->in_frames += nb_frames;
+
+	return nb_frames;
+}
+
+// normalized correlation of the candidate at index pos with the template
+static double candidate_score(TimeStretch *ts, int pos, int lo,
+		const float *tmpl) {
+	double energy = ts->energy[pos - lo + ts->hop] - ts->energy[pos - lo];
+	double corr = dsp_dot(ts->mono + pos, tmpl, ts->hop);
+
+	return corr / sqrt(energy + 1e-9);
+}
+
+// segment start, index into in, that best continues the last segment
+static int find_segment(TimeStretch *ts, int center) {
+	const float *tmpl = ts->mono + (ts->prev_pos + ts->hop - ts->in_start);
+	int lo = FFMAX(center - ts->search, 0);
+	int hi = center + ts->search;
+	int i, pos, best = center, fine_lo, fine_hi;
+	double score, best_score = -HUGE_VAL;
+
+	ts->energy[0] = 0;
+	for (i = lo; i < hi + ts->hop; i++) {
+		ts->energy[i - lo + 1] = ts->energy[i - lo]
+				+ (double) ts->mono[i] * ts->mono[i];
+	}
+
+	for (pos = lo; pos <= hi; pos += TIME_STRETCH_COARSE_STEP) {
+		score = candidate_score(ts, pos, lo, tmpl);
+		if (score > best_score) {
+			best_score = score;
+			best = pos;
+		}
+	}
+
+	fine_lo = FFMAX(best - TIME_STRETCH_COARSE_STEP + 1, lo);
+	fine_hi = FFMIN(best + TIME_STRETCH_COARSE_STEP - 1, hi);
+	for (pos = fine_lo; pos <= fine_hi; pos++) {
+		score = candidate_score(ts, pos, lo, tmpl);
+		if (score > best_score) {
+			best_score = score;
+			best = pos;
+		}
+	}
+
+	return best;
+}
+
+// overlap-adds the next segment into hop frames of output
+static void time_stretch_step(TimeStretch *ts, double speed) {
+	int channels = ts->channels;
+	int center = (int) ((int64_t) ts->ana_pos - ts->in_start);
+	int pos, i, c;
+	const float *seg;
+
+	if (ts->prev_pos < 0) {
+		// the first segment plays as it is, like the input before it
+		pos = center;
+		seg = ts->in + pos * channels;
+		memcpy(ts->out, seg, ts->hop * channels * sizeof(float));
+	} else {
+		pos = find_segment(ts, center);
+		seg = ts->in + pos * channels;
+		for (i = 0; i < ts->hop; i++) {
+			for (c = 0; c < channels; c++) {
+				ts->out[i * channels + c] = ts->ola[i * channels + c]
+						+ seg[i * channels + c] * ts->win[i];
+			}
+		}
+	}
+
+	for (i = 0; i < ts->hop; i++) {
+		for (c = 0; c < channels; c++) {
+			ts->ola[i * channels + c] = seg[(ts->hop + i) * channels + c]
+					* ts->win[ts->hop + i];
+		}
+	}
+
+	ts->prev_pos = ts->in_start + pos;
+	ts->ana_pos += ts->hop * speed;
+	ts->out_frames = ts->hop;
+	ts->out_index = 0;
+}
+
+/**
+ * Reads stretched output. At speed 1 the stage drains: the input after the
+ * last segment is passed through, which continues it seamlessly, and the
+ * stage becomes inactive once it is empty.
+ *
+ * @param speed  0.5 to 3, input frames consumed per output frame
+ * @return frames written, 0 when more input is needed or the stage drained
+ */
+int time_stretch_read(TimeStretch *ts, float *dst, int nb_frames,
+		double speed) {
+	int channels = ts->channels;
+	int n;
+
+	if (ts->out_index == ts->out_frames) {
+		if (speed == 1 && ts->drain_pos < 0) {
+			ts->drain_pos = ts->prev_pos >= 0 ?
+					ts->prev_pos + ts->hop : (int64_t) ts->ana_pos;
+		}
+
+		if (ts->drain_pos >= 0) {
+			n = (int) FFMIN(nb_frames,
+					ts->in_start + ts->in_frames - ts->drain_pos);
+			if (n <= 0) {
+				time_stretch_flush(ts);
+				return 0;
+			}
+			memcpy(dst, ts->in + (ts->drain_pos - ts->in_start) * channels,
+					n * channels * sizeof(float));
+			ts->drain_pos += n;
+			return n;
+		}
+
+		if (ts->in_start + ts->in_frames
+				< (int64_t) ts->ana_pos + ts->search + ts->window) {
+			return 0;
+		}
+
+		time_stretch_step(ts, av_clipd(speed, 0.5, 3));
+	}
+
+	n = FFMIN(nb_frames, ts->out_frames - ts->out_index);
+	memcpy(dst, ts->out + ts->out_index * channels,
+			n * channels * sizeof(float));
+	ts->out_index += n;
+
+	return n;
+}
+
+void time_stretch_free(TimeStretch **pts) {
+	TimeStretch *ts = *pts;
+
+	if (!ts) {
+		return;
+	}
+
+	av_freep(&ts->in);
+	av_freep(&ts->mono);
+	av_freep(&ts->win);
+	av_freep(&ts->ola);
+	av_freep(&ts->out);
+	av_freep(&ts->energy);
+	av_freep(pts);
+}
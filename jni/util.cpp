@@ -2,11 +2,39 @@
 
 void packet_queue_init(PacketQueue *q) {
 	memset(q, 0, sizeof(PacketQueue));
-	pthread_mutex_init(q->mutex, NULL);
+	pthread_mutex_init(&q->mutex, NULL);
+}
+
+void packet_queue_destroy(PacketQueue *q) {
+	packet_queue_flush(q);
+	pthread_mutex_destroy(&q->mutex);
+}
+
+// drops every queued packet; bumping the serial also invalidates the
+// packet the decoder is working on, so nothing stale is played after a seek
+void packet_queue_flush(PacketQueue *q) {
+	PacketList *pkt, *pkt1;
+
+	pthread_mutex_lock(&q->mutex);
+
+	for (pkt = q->first_pkt; pkt; pkt = pkt1) {
+		pkt1 = pkt->next;
+		av_free_packet(&pkt->pkt);
+		av_free(pkt);
+	}
+
+	q->first_pkt = NULL;
+	q->last_pkt = NULL;
+	q->nb_packets = 0;
+	q->size = 0;
+	q->duration = 0;
+	q->serial++;
+
+	pthread_mutex_unlock(&q->mutex);
 }
 
 int packet_queue_put(PacketQueue *q, AVPacket *pkt) {
-	AVPacketList *pkt1;
+	PacketList *pkt1;
 
 	if ((NULL == pkt) || (NULL == q)) {
 		av_log(NULL, AV_LOG_ERROR,
@@ -19,7 +47,7 @@ int packet_queue_put(PacketQueue *q, AVPacket *pkt) {
 		return -1;
 	}
 
-	pkt1 = (AVPacketList*) av_malloc(sizeof(AVPacketList));
+	pkt1 = (PacketList*) av_malloc(sizeof(PacketList));
 	if (!pkt1) {
 		av_log(NULL, AV_LOG_ERROR, "packet_queue_put av_malloc failure.\n");
 		return -1;
@@ -28,7 +56,9 @@ int packet_queue_put(PacketQueue *q, AVPacket *pkt) {
 	pkt1->pkt = *pkt;
 	pkt1->next = NULL;
 
-	pthread_mutex_lock(q->mutex);
+	pthread_mutex_lock(&q->mutex);
+
+	pkt1->serial = q->serial;
 
 	if (!q->last_pkt) {
 		q->first_pkt = pkt1;
@@ -39,21 +69,20 @@ int packet_queue_put(PacketQueue *q, AVPacket *pkt) {
 	q->last_pkt = pkt1;
 	q->nb_packets++;
 	q->size += pkt1->pkt.size;
+	q->duration += FFMAX(pkt1->pkt.duration, 0);
 
-	pthread_mutex_unlock(q->mutex);
+	pthread_mutex_unlock(&q->mutex);
 
 	return 0;
 }
 
-int packet_queue_get(PacketQueue *q, AVPacket *pkt) {
-	AVPacketList *pkt1;
+// never blocks, returns 1 with a packet and 0 when the queue is empty;
+// serial, if not NULL, receives the queue serial the packet was put with
+int packet_queue_get(PacketQueue *q, AVPacket *pkt, int *serial) {
+	PacketList *pkt1;
 	int ret;
 
-	if (global_context.quit) {
-		return -1;
-	}
-
-	pthread_mutex_lock(q->mutex);
+	pthread_mutex_lock(&q->mutex);
 
 	pkt1 = q->first_pkt;
 
@@ -66,14 +95,18 @@ int packet_queue_get(PacketQueue *q, AVPacket *pkt) {
 
 		q->nb_packets--;
 		q->size -= pkt1->pkt.size;
+		q->duration -= FFMAX(pkt1->pkt.duration, 0);
 		*pkt = pkt1->pkt;
+		if (serial) {
+			*serial = pkt1->serial;
+		}
 		av_free(pkt1);
 		ret = 1;
 	} else {
 		ret = 0;
 	}
 
-	pthread_mutex_unlock(q->mutex);
+	pthread_mutex_unlock(&q->mutex);
 
 	return ret;
 }
@@ -82,3 +115,41 @@ int packet_queue_size(PacketQueue *q) {
 	return q->size;
 }
 
+int find_audio_stream(AVFormatContext *fmt_ctx) {
+	unsigned int i;
+
+	// we used the first audio stream
+	for (i = 0; i < fmt_ctx->nb_streams; i++) {
+		if (fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+int open_audio_decoder(AVFormatContext *fmt_ctx, int stream_index,
+		bool probed) {
+	AVStream *st = fmt_ctx->streams[stream_index];
+	AVCodec *codec;
+
+	// avformat_find_stream_info() is what fills st->codec from codecpar
+	if (!probed
+			&& avcodec_parameters_to_context(st->codec, st->codecpar) < 0) {
+		return -1;
+	}
+
+	codec = avcodec_find_decoder(st->codecpar->codec_id);
+	if (NULL == codec) {
+		av_log(NULL, AV_LOG_ERROR, "avcodec_find_decoder failure. \n");
+		return -1;
+	}
+
+	//av_opt_set_int(st->codec, "refcounted_frames", 1, 0);
+	if (avcodec_open2(st->codec, codec, NULL) < 0) {
+		av_log(NULL, AV_LOG_ERROR, "avcodec_open2 failure. \n");
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,579 @@
+
+#include "player.h"
+
+#include <float.h>
+#include <math.h>
+#include <unistd.h>
+
+#define WAVEFORM_CACHE_MAGIC MKTAG('F', 'O', 'W', 'F')
+#define WAVEFORM_CACHE_VERSION 1
+#define WAVEFORM_MAX_BUCKETS (1 << 16)
+#define WAVEFORM_MAX_THREADS 8
+#define WAVEFORM_MAX_PLANES 8
+
+// files are split into segments of at least this length, one per thread
+#define WAVEFORM_MIN_SEGMENT (60 * (int64_t) AV_TIME_BASE)
+
+// On-disk layout: WaveformCacheHeader | float[nb_buckets][3]
+typedef struct WaveformCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	int64_t file_size;
+	int64_t file_mtime;
+	int32_t nb_buckets;
+	int32_t reserved;
+} WaveformCacheHeader;
+
+// Min/max/RMS overview of a whole file for seek bars. Frames are read
+// straight from the decoder in its own sample format, without the filter
+// graph of the playback path. Seekable files are cut into segments at
+// equal times which are demuxed and decoded in parallel, each through its
+// own context; a sample lands in the bucket its timestamp falls into, so
+// the segments need no coordination beyond the buckets they share at
+// their edges, which are merged once all are done.
+typedef struct Waveform {
+	const char *url;
+	int stream_index;
+	int sample_rate;
+	int64_t start_time; // in stream time base
+	int64_t nb_samples; // per channel, from the container duration
+	int nb_buckets;
+	int cancel_serial; // the global one when the overview started
+} Waveform;
+
+// bumped to cancel the overviews running, never by the player
+static volatile int cancel_serial;
+
+typedef struct WaveformSegment {
+	Waveform *wf;
+	int64_t start; // sample positions, end excluded
+	int64_t end;
+
+	// buckets first to first + nb - 1
+	int first;
+	int nb;
+	float *min;
+	float *max;
+	double *power;
+	int64_t *count;
+
+	float *scratch;
+	unsigned int scratch_size;
+
+	bool thread_started;
+	pthread_t thread;
+	int ret;
+} WaveformSegment;
+
+static inline int bucket_of(const Waveform *wf, int64_t pos) {
+	return (int) FFMIN(pos * wf->nb_buckets / wf->nb_samples,
+			wf->nb_buckets - 1);
+}
+
+// first sample position of bucket b
+static inline int64_t bucket_start(const Waveform *wf, int b) {
+	return av_rescale_rnd(b, wf->nb_samples, wf->nb_buckets, AV_ROUND_UP);
+}
+
+static int waveform_interrupt_cb(void *opaque) {
+	return ((Waveform*) opaque)->cancel_serial != cancel_serial;
+}
+
+// float samples of the planes of frame, converted into scratch if needed
+static int segment_get_planes(WaveformSegment *seg, AVFrame *frame,
+		const float **planes, int nb_planes, int n) {
+	enum AVSampleFormat fmt = av_get_packed_sample_fmt(
+			(enum AVSampleFormat) frame->format);
+	int p, i;
+
+	if (AV_SAMPLE_FMT_FLT == fmt) {
+		for (p = 0; p < nb_planes; p++) {
+			planes[p] = (const float*) frame->extended_data[p];
+		}
+		return 0;
+	}
+
+	av_fast_malloc(&seg->scratch, &seg->scratch_size,
+			nb_planes * n * sizeof(float));
+	if (!seg->scratch) {
+		return AVERROR(ENOMEM);
+	}
+
+	for (p = 0; p < nb_planes; p++) {
+		const uint8_t *src = frame->extended_data[p];
+		float *dst = seg->scratch + p * n;
+
+		switch (fmt) {
+		case AV_SAMPLE_FMT_S16:
+			dsp_s16_to_float(dst, (const int16_t*) src, n);
+			break;
+		case AV_SAMPLE_FMT_S32:
+			for (i = 0; i < n; i++) {
+				dst[i] = ((const int32_t*) src)[i] * (1.0f / 2147483648.0f);
+			}
+			break;
+		case AV_SAMPLE_FMT_DBL:
+			for (i = 0; i < n; i++) {
+				dst[i] = (float) ((const double*) src)[i];
+			}
+			break;
+		case AV_SAMPLE_FMT_U8:
+			for (i = 0; i < n; i++) {
+				dst[i] = (src[i] - 128) * (1.0f / 128);
+			}
+			break;
+		default:
+			return AVERROR(ENOSYS);
+		}
+		planes[p] = dst;
+	}
+
+	return 0;
+}
+
+// adds the samples of frame, starting at position pos, that lie in seg
+static int segment_add_frame(WaveformSegment *seg, AVFrame *frame,
+		int64_t pos) {
+	Waveform *wf = seg->wf;
+	int channels = av_frame_get_channels(frame);
+	int planar = av_sample_fmt_is_planar((enum AVSampleFormat) frame->format);
+	int nb_planes = planar ? FFMIN(channels, WAVEFORM_MAX_PLANES) : 1;
+	int stride = planar ? 1 : channels; // samples of a frame in a plane
+	int64_t p = FFMAX(pos, seg->start);
+	int64_t end = FFMIN(pos + frame->nb_samples, seg->end);
+	const float *planes[WAVEFORM_MAX_PLANES];
+	int64_t run;
+	int ret, k;
+
+	if (p >= end) {
+		return 0;
+	}
+
+	ret = segment_get_planes(seg, frame, planes, nb_planes,
+			frame->nb_samples * stride);
+	if (ret < 0) {
+		return ret;
+	}
+
+	for (; p < end; p += run) {
+		int b = bucket_of(wf, p), i = b - seg->first;
+		float power = 0;
+
+		run = b == wf->nb_buckets - 1 ?
+				end - p : FFMIN(end, bucket_start(wf, b + 1)) - p;
+
+		for (k = 0; k < nb_planes; k++) {
+			dsp_min_max_power(planes[k] + (p - pos) * stride,
+					(int) run * stride, &seg->min[i], &seg->max[i], &power);
+		}
+		seg->power[i] += power;
+		seg->count[i] += run * stride * nb_planes;
+	}
+
+	return 0;
+}
+
+static void* waveform_segment_thread(void *arg) {
+	WaveformSegment *seg = (WaveformSegment*) arg;
+	Waveform *wf = seg->wf;
+	AVFormatContext *fmt_ctx = NULL;
+	AVCodecContext *avctx;
+	AVFrame *frame = NULL;
+	AVStream *st;
+	AVPacket pkt, tmp;
+	int64_t pos = seg->start, ts;
+	int got_frame, len;
+	unsigned int i;
+
+	seg->ret = -1;
+
+	fmt_ctx = avformat_alloc_context();
+	if (!fmt_ctx) {
+		return NULL;
+	}
+	fmt_ctx->interrupt_callback.callback = waveform_interrupt_cb;
+	fmt_ctx->interrupt_callback.opaque = wf;
+
+	if (avformat_open_input(&fmt_ctx, wf->url, NULL, NULL) < 0
+			|| wf->stream_index >= (int) fmt_ctx->nb_streams) {
+		goto end;
+	}
+
+	for (i = 0; i < fmt_ctx->nb_streams; i++) {
+		if ((int) i != wf->stream_index) {
+			fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+		}
+	}
+
+	// waveform_compute() probed the file once, the header is enough here
+	st = fmt_ctx->streams[wf->stream_index];
+	if (open_audio_decoder(fmt_ctx, wf->stream_index, false) < 0) {
+		goto end;
+	}
+	avctx = st->codec;
+
+	if (seg->start > 0) {
+		ts = wf->start_time + av_rescale_q(seg->start,
+				(AVRational ) { 1, wf->sample_rate }, st->time_base);
+		if (av_seek_frame(fmt_ctx, wf->stream_index, ts,
+				AVSEEK_FLAG_BACKWARD) < 0) {
+			goto end;
+		}
+	}
+
+	frame = av_frame_alloc();
+	if (!frame) {
+		goto end;
+	}
+
+	while (pos < seg->end && !waveform_interrupt_cb(wf)
+			&& av_read_frame(fmt_ctx, &pkt) >= 0) {
+		if (pkt.stream_index != wf->stream_index) {
+			av_free_packet(&pkt);
+			continue;
+		}
+
+		tmp = pkt;
+		while (tmp.size > 0) {
+			len = avcodec_decode_audio4(avctx, frame, &got_frame, &tmp);
+			if (len < 0 || (!len && !got_frame)) {
+				break;
+			}
+			tmp.data += len;
+			tmp.size -= len;
+			if (!got_frame) {
+				continue;
+			}
+
+			ts = av_frame_get_best_effort_timestamp(frame);
+			if (ts != AV_NOPTS_VALUE) {
+				pos = av_rescale_q(ts - wf->start_time, st->time_base,
+						(AVRational ) { 1, wf->sample_rate });
+			}
+
+			if (segment_add_frame(seg, frame, pos) < 0) {
+				av_free_packet(&pkt);
+				goto end;
+			}
+			pos += frame->nb_samples;
+		}
+
+		av_free_packet(&pkt);
+	}
+
+	seg->ret = waveform_interrupt_cb(wf) ? -1 : 0;
+
+	end:
+
+	av_frame_free(&frame);
+	if (fmt_ctx) {
+		avformat_close_input(&fmt_ctx);
+	}
+
+	return NULL;
+}
+
+// path of the cache entry of url, which must be a local file, and its
+// identity
+static int waveform_cache_path(const char *url, char *path, int size,
+		int64_t *file_size, int64_t *file_mtime) {
+	const char *file = url;
+	struct stat st;
+	uint8_t md5[16];
+	int i, j;
+
+	if (!global_context.cache_dir[0]
+			|| (strstr(url, "://") && !av_strstart(url, "file:", &file))
+			|| stat(file, &st) < 0) {
+		return -1;
+	}
+
+	*file_size = st.st_size;
+	*file_mtime = st.st_mtime;
+
+	av_md5_sum(md5, (const uint8_t*) file, strlen(file));
+	i = snprintf(path, size, "%s/", global_context.cache_dir);
+	for (j = 0; j < 16 && i < size - 8; j++) {
+		i += snprintf(path + i, 3, "%02x", md5[j]);
+	}
+	av_strlcat(path, ".wave", size);
+
+	return 0;
+}
+
+// reads an entry of nb_buckets, or of a multiple of it merged down
+static int waveform_cache_load(const char *path, int64_t file_size,
+		int64_t file_mtime, int nb_buckets, float *out) {
+	WaveformCacheHeader header;
+	float *data = NULL;
+	size_t size;
+	int fd, ratio, b, k, ret = -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (read(fd, &header, sizeof(header)) != sizeof(header)
+			|| header.magic != WAVEFORM_CACHE_MAGIC
+			|| header.version != WAVEFORM_CACHE_VERSION
+			|| header.file_size != file_size || header.file_mtime != file_mtime
+			|| header.nb_buckets < nb_buckets
+			|| header.nb_buckets > WAVEFORM_MAX_BUCKETS
+			|| header.nb_buckets % nb_buckets) {
+		goto end;
+	}
+
+	size = header.nb_buckets * 3 * sizeof(float);
+	data = (float*) av_malloc(size);
+	if (!data || read(fd, data, size) != (ssize_t) size) {
+		goto end;
+	}
+
+	ratio = header.nb_buckets / nb_buckets;
+	for (b = 0; b < nb_buckets; b++) {
+		const float *src = data + b * ratio * 3;
+		float lo = src[0], hi = src[1];
+		double power = 0;
+
+		for (k = 0; k < ratio; k++) {
+			lo = FFMIN(lo, src[k * 3]);
+			hi = FFMAX(hi, src[k * 3 + 1]);
+			power += (double) src[k * 3 + 2] * src[k * 3 + 2];
+		}
+		out[b * 3] = lo;
+		out[b * 3 + 1] = hi;
+		out[b * 3 + 2] = (float) sqrt(power / ratio);
+	}
+	ret = 0;
+
+	end:
+
+	av_free(data);
+	close(fd);
+	return ret;
+}
+
+static void waveform_cache_store(const char *path, int64_t file_size,
+		int64_t file_mtime, int nb_buckets, const float *out) {
+	WaveformCacheHeader header = { 0 };
+	char tmp_path[1040];
+	size_t size = nb_buckets * 3 * sizeof(float);
+	int fd;
+
+	header.magic = WAVEFORM_CACHE_MAGIC;
+	header.version = WAVEFORM_CACHE_VERSION;
+	header.file_size = file_size;
+	header.file_mtime = file_mtime;
+	header.nb_buckets = nb_buckets;
+
+	// write aside and rename, so a crash never leaves a torn entry
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		return;
+	}
+
+	if (write(fd, &header, sizeof(header)) == sizeof(header)
+			&& write(fd, out, size) == (ssize_t) size) {
+		close(fd);
+		rename(tmp_path, path);
+	} else {
+		close(fd);
+		unlink(tmp_path);
+	}
+}
+
+// duration, stream and layout of url, probed once for all the segments
+static int waveform_probe(Waveform *wf, int64_t *duration, bool *seekable) {
+	AVFormatContext *fmt_ctx = NULL;
+	AVStream *st;
+	int ret = -1;
+
+	fmt_ctx = avformat_alloc_context();
+	if (!fmt_ctx) {
+		return -1;
+	}
+	fmt_ctx->interrupt_callback.callback = waveform_interrupt_cb;
+	fmt_ctx->interrupt_callback.opaque = wf;
+
+	if (avformat_open_input(&fmt_ctx, wf->url, NULL, NULL) < 0) {
+		av_log(NULL, AV_LOG_ERROR, "waveform : cannot open %s\n", wf->url);
+		goto end;
+	}
+
+	if (avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+		goto end;
+	}
+
+	wf->stream_index = find_audio_stream(fmt_ctx);
+	if (wf->stream_index < 0) {
+		goto end;
+	}
+
+	st = fmt_ctx->streams[wf->stream_index];
+	wf->sample_rate = st->codecpar->sample_rate;
+	wf->start_time = st->start_time != AV_NOPTS_VALUE ? st->start_time : 0;
+
+	*duration = fmt_ctx->duration;
+	if (*duration <= 0 && st->duration > 0) {
+		*duration = av_rescale_q(st->duration, st->time_base, AV_TIME_BASE_Q);
+	}
+	*seekable = fmt_ctx->pb && (fmt_ctx->pb->seekable & AVIO_SEEKABLE_NORMAL);
+
+	// the buckets are laid out over the duration, a seek bar needs it anyway
+	if (wf->sample_rate > 0 && *duration > 0) {
+		wf->nb_samples = FFMAX(
+				av_rescale(*duration, wf->sample_rate, AV_TIME_BASE), 1);
+		ret = 0;
+	}
+
+	end:
+
+	avformat_close_input(&fmt_ctx);
+	return ret;
+}
+
+/**
+ * Computes a min/max/RMS overview of url over nb_buckets equal slices of
+ * its duration, all channels together. Local files are cached in the
+ * cache directory.
+ *
+ * @param out  nb_buckets triples { min, max, rms }, samples in [-1, 1]
+ * @return 0 on success, -1 on failure
+ */
+int waveform_compute(const char *url, int nb_buckets, float *out) {
+	Waveform wf = { 0 };
+	WaveformSegment segments[WAVEFORM_MAX_THREADS];
+	char cache_path[1024];
+	int64_t file_size = 0, file_mtime = 0, duration = 0;
+	int64_t t = av_gettime_relative();
+	int nb_segments, nb_threads, i, b, ret = -1;
+	bool seekable = false, cached;
+
+	if (nb_buckets < 1 || nb_buckets > WAVEFORM_MAX_BUCKETS) {
+		return -1;
+	}
+
+	cached = !waveform_cache_path(url, cache_path, sizeof(cache_path),
+			&file_size, &file_mtime);
+	if (cached && !waveform_cache_load(cache_path, file_size, file_mtime,
+			nb_buckets, out)) {
+		return 0;
+	}
+
+	wf.url = url;
+	wf.nb_buckets = nb_buckets;
+	wf.cancel_serial = cancel_serial;
+	if (waveform_probe(&wf, &duration, &seekable) < 0) {
+		return -1;
+	}
+
+	nb_threads = av_clip(global_context.waveform_max_threads > 0 ?
+			global_context.waveform_max_threads :
+			(int) sysconf(_SC_NPROCESSORS_ONLN), 1, WAVEFORM_MAX_THREADS);
+	nb_segments = seekable ?
+			(int) av_clip64(duration / WAVEFORM_MIN_SEGMENT, 1, nb_threads) : 1;
+
+	memset(segments, 0, sizeof(segments));
+	for (i = 0; i < nb_segments; i++) {
+		WaveformSegment *seg = &segments[i];
+		int last;
+
+		seg->wf = &wf;
+		seg->start = wf.nb_samples * i / nb_segments;
+		seg->end = i == nb_segments - 1 ?
+				INT64_MAX : wf.nb_samples * (i + 1) / nb_segments;
+		seg->first = bucket_of(&wf, seg->start);
+		last = i == nb_segments - 1 ?
+				nb_buckets - 1 : bucket_of(&wf, seg->end - 1);
+		seg->nb = last - seg->first + 1;
+
+		seg->min = (float*) av_malloc_array(seg->nb, sizeof(float));
+		seg->max = (float*) av_malloc_array(seg->nb, sizeof(float));
+		seg->power = (double*) av_mallocz_array(seg->nb, sizeof(double));
+		seg->count = (int64_t*) av_mallocz_array(seg->nb, sizeof(int64_t));
+		if (!seg->min || !seg->max || !seg->power || !seg->count) {
+			goto end;
+		}
+		for (b = 0; b < seg->nb; b++) {
+			seg->min[b] = FLT_MAX;
+			seg->max[b] = -FLT_MAX;
+		}
+	}
+
+	// the first segment is decoded on the calling thread
+	for (i = 1; i < nb_segments; i++) {
+		if (pthread_create(&segments[i].thread, NULL, waveform_segment_thread,
+				&segments[i])) {
+			av_log(NULL, AV_LOG_ERROR, "waveform : pthread_create failure.\n");
+			segments[i].ret = -1;
+		} else {
+			segments[i].thread_started = true;
+		}
+	}
+	waveform_segment_thread(&segments[0]);
+	for (i = 1; i < nb_segments; i++) {
+		if (segments[i].thread_started) {
+			pthread_join(segments[i].thread, NULL);
+		}
+	}
+
+	for (i = 0; i < nb_segments; i++) {
+		if (segments[i].ret < 0) {
+			goto end;
+		}
+	}
+
+	// buckets at the edges of two segments get samples from both
+	for (b = 0; b < nb_buckets; b++) {
+		float lo = FLT_MAX, hi = -FLT_MAX;
+		double power = 0;
+		int64_t count = 0;
+
+		for (i = 0; i < nb_segments; i++) {
+			WaveformSegment *seg = &segments[i];
+			int k = b - seg->first;
+			if (k >= 0 && k < seg->nb && seg->count[k]) {
+				lo = FFMIN(lo, seg->min[k]);
+				hi = FFMAX(hi, seg->max[k]);
+				power += seg->power[k];
+				count += seg->count[k];
+			}
+		}
+
+		out[b * 3] = count ? lo : 0;
+		out[b * 3 + 1] = count ? hi : 0;
+		out[b * 3 + 2] = count ? (float) sqrt(power / count) : 0;
+	}
+	ret = 0;
+
+	t = av_gettime_relative() - t;
+	global_context.waveform_s_per_hour = (float) (t * 3600.0 / duration);
+	LOGV("waveform : %d buckets of %.1f s in %lld us on %d threads, "
+			"%.2f s per hour of audio", nb_buckets,
+			duration / (double) AV_TIME_BASE, (long long) t, nb_segments,
+			global_context.waveform_s_per_hour);
+
+	if (cached) {
+		waveform_cache_store(cache_path, file_size, file_mtime, nb_buckets,
+				out);
+	}
+
+	end:
+
+	for (i = 0; i < nb_segments; i++) {
+		av_free(segments[i].min);
+		av_free(segments[i].max);
+		av_free(segments[i].power);
+		av_free(segments[i].count);
+		av_free(segments[i].scratch);
+	}
+
+	return ret;
+}
+
+// makes the overviews running fail early
+void waveform_cancel() {
+	__sync_fetch_and_add(&cancel_serial, 1);
+}
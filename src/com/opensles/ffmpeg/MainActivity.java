@@ -1,5 +1,7 @@
 package com.opensles.ffmpeg;
 
+import java.nio.ByteBuffer;
+
 import android.app.Activity;
 import android.os.Bundle;
 
@@ -27,5 +29,294 @@ public class MainActivity extends Activity {
 
 	public static native int startAudioPlayer();
 
+	public static native int startAudioPlayerFromUrl(String url);
+
+	public static native int startAudioPlayerFromBuffer(ByteBuffer buffer);
+
+	public static native int startAudioPlayerFromFd(int fd, long offset,
+			long length);
+
+	/**
+	 * Plays the urls back to back without gaps; each track is opened and
+	 * decoded ahead while the previous one ends.
+	 */
+	public static native int startPlaylist(String[] urls);
+
+	public static native int setPreloadTime(int seconds);
+
+	/**
+	 * @param seconds
+	 *            overlap of consecutive playlist tracks, 1 to 12, or 0 to
+	 *            play them gaplessly
+	 */
+	public static native int setCrossfade(int seconds);
+
+	/**
+	 * @return percent of CPU time left in the busiest buffer of the last
+	 *         crossfade
+	 */
+	public static native int getCrossfadeHeadroom();
+
+	public static native int getTrackIndex();
+
 	public static native int stopAudioPlayer();
+
+	public static native int setReadAheadSize(int bytes);
+
+	public static native int getIOWaitPerSecond();
+
+	public static native int setCacheDir(String dir);
+
+	/**
+	 * @return { bytes served from the cache, bytes fetched from network }
+	 */
+	public static native long[] getHttpCacheStats();
+
+	public static native int setFastStart(boolean enable);
+
+	/**
+	 * @return microseconds spent in { open, probe, codec open, output
+	 *         creation } and until the first buffer was enqueued, followed
+	 *         by 1 if the stream info came from the probe cache
+	 */
+	public static native long[] getStartupTimes();
+
+	public static native int seekTo(long ms);
+
+	public static native int scrubBegin();
+
+	public static native int scrubTo(long ms);
+
+	/**
+	 * @return CPU time used during the scrub gesture, in microseconds
+	 */
+	public static native long scrubEnd();
+
+	public static native long getPosition();
+
+	public static native long getSeekLatency();
+
+	/**
+	 * Decodes a short sound for playSound() into the clip bank, or finds it
+	 * there. The output then keeps its format.
+	 *
+	 * @return sound id, -1 on failure
+	 */
+	public static native int loadSound(String url);
+
+	public static native int unloadSound(int id);
+
+	/**
+	 * @param pan        -1 (left) to 1 (right)
+	 * @param startFrame getMixerTime() frame to start on, 0 for the next buffer
+	 * @return voice handle, -1 on failure
+	 */
+	public static native int playSound(int id, float gain, float pan,
+			long startFrame);
+
+	public static native int setVoice(int voice, float gain, float pan);
+
+	public static native int stopVoice(int voice);
+
+	public static native long getMixerTime();
+
+	/**
+	 * @return percent of CPU the mixer used in the last second of output
+	 */
+	public static native int getMixerLoad();
+
+	/**
+	 * Bytes of decoded sounds kept, least recently used ones are evicted.
+	 */
+	public static native int setClipBankBudget(int bytes);
+
+	/**
+	 * @return { hits, misses, bytes in use, budget }
+	 */
+	public static native long[] getClipBankStats();
+
+	/**
+	 * Playback tempo, 0.5 to 3, changed live without a pitch change.
+	 */
+	public static native int setSpeed(float speed);
+
+	public static native long getTimeStretchCpu();
+
+	/**
+	 * Sets one of the 10 peaking bands, a gain of 0 dB turns it off.
+	 *
+	 * @param gainDb -24 to 24
+	 * @param q      0.1 to 10
+	 */
+	public static native int setEqBand(int band, float freq, float gainDb,
+			float q);
+
+	/**
+	 * @return gain of the equalizer at freq, in dB
+	 */
+	public static native float getEqResponse(float freq);
+
+	public static native long getEqBandCpu();
+
+	/**
+	 * Convolves the tracks with an impulse response file, cut to 4 seconds.
+	 */
+	public static native int loadReverb(String url);
+
+	public static native int unloadReverb();
+
+	/**
+	 * @param level 0 (dry) to 1
+	 */
+	public static native int setReverbLevel(float level);
+
+	public static native int getReverbLoad();
+
+	/**
+	 * Compressor on the whole output, ahead of the limiter.
+	 *
+	 * @param rms         RMS detector if true, peak otherwise
+	 * @param thresholdDb -60 to 0 dBFS
+	 * @param ratio       1 to 20
+	 * @param makeupDb    0 to 24
+	 */
+	public static native int setCompressor(boolean enabled, boolean rms,
+			float thresholdDb, float ratio, float attackMs, float releaseMs,
+			float makeupDb);
+
+	/**
+	 * @param ceilingDb   -12 to 0 dBFS
+	 * @param lookaheadMs 0 to 10, peaks are caught from 1.5 ms
+	 */
+	public static native int setLimiter(boolean enabled, float ceilingDb,
+			float lookaheadMs);
+
+	public static native float getGainReduction();
+
+	public static native long getDynamicsBlockCost();
+
+	/**
+	 * Output volume, 0 to 1, applied in software with a short ramp.
+	 */
+	public static native int setVolume(float volume);
+
+	public static final int REPLAY_GAIN_OFF = 0;
+	public static final int REPLAY_GAIN_TRACK = 1;
+	public static final int REPLAY_GAIN_ALBUM = 2;
+
+	/**
+	 * Normalizes tracks by their ReplayGain or R128 tags; album mode falls
+	 * back to the track gain when a file has no album gain.
+	 */
+	public static native int setReplayGainMode(int mode);
+
+	/**
+	 * Measures EBU R128 loudness on a pool of worker threads, blocking until
+	 * done. Results are cached in the cache directory when one is set.
+	 *
+	 * @param albums album of each path from 0, -1 or null for none
+	 * @return per path { integrated LUFS, range LU, true peak dBTP, and the
+	 *         same for its album }, NaN for the files that failed
+	 */
+	public static native float[] scanLoudness(String[] paths, int[] albums);
+
+	public static native float getLoudnessScanRate();
+
+	public static native int cancelLoudnessScan();
+
+	/**
+	 * Analyzes the output for getSpectrumBuffer().
+	 *
+	 * @param fftSize power of two from 256 to 4096
+	 * @param bins    log-spaced bins from 20 Hz, 8 to 256
+	 * @param rate    spectra per second up to 60, 0 stops the analysis
+	 */
+	public static native int setSpectrum(int fftSize, int bins, float rate);
+
+	/**
+	 * Memory the spectrum is published to, read it in native byte order:
+	 * int sequence, int front, int bins, int sampleRate, float minFreq,
+	 * float maxFreq, 8 reserved bytes, then two halves of 256 floats. The
+	 * latest spectrum, in dBFS, is the first bins floats of half front;
+	 * copy them and read again if sequence changed meanwhile.
+	 */
+	public static native java.nio.ByteBuffer getSpectrumBuffer();
+
+	public static native long getSpectrumCpu();
+
+	/**
+	 * Output levels of the last 100 ms.
+	 *
+	 * @return { peak left, peak right, RMS left, RMS right } in dBFS, then
+	 *         { momentary, short-term } loudness in LUFS
+	 */
+	public static native float[] getMeter();
+
+	public static native long getMeterCpu();
+
+	/**
+	 * Overview of a whole file for a seek bar, cached in the cache
+	 * directory for local files.
+	 *
+	 * @param buckets 1 to 65536 equal slices of the duration
+	 * @return { min, max, rms } of every bucket, null on failure
+	 */
+	public static native float[] getWaveform(String url, int buckets);
+
+	public static native float getWaveformSpeed();
+
+	public static native int cancelWaveform();
+
+	public static final int EXPORT_WAV = 1;
+	public static final int EXPORT_FLOAT = 2;
+
+	/**
+	 * Receives exported PCM in large batches.
+	 */
+	public interface PcmSink {
+		/**
+		 * @param pcm  direct buffer only valid during the call
+		 * @return < 0 to abort the export
+		 */
+		int write(ByteBuffer pcm, int size);
+	}
+
+	/**
+	 * Decodes a range of a file to 16 bit or float PCM as fast as the CPU
+	 * allows, without an output; the WAV sizes are filled in when fd is
+	 * seekable.
+	 *
+	 * @param endMs 0 for the end of the file
+	 * @param flags EXPORT_WAV, EXPORT_FLOAT
+	 * @return the number of frames written, -1 on failure
+	 */
+	public static native long exportPcm(String url, int fd, long startMs,
+			long endMs, int flags);
+
+	public static native long exportPcmToSink(String url, long startMs,
+			long endMs, int flags, PcmSink sink);
+
+	public static native float getExportSpeed();
+
+	/**
+	 * Reads the container headers of the files, without decoding, into a
+	 * table at tablePath in native byte order:
+	 * <pre>
+	 * header  { int magic "FOMT", version, count, stringsSize }
+	 * records { long durationUs, coverOffset; int coverSize, bitRate,
+	 *           sampleRate; short channels, flags; int codec, title,
+	 *           artist, album } x count, in the order of paths
+	 * strings NUL terminated UTF-8, codec to album are offsets into them
+	 * </pre>
+	 * flags: 1 read, 2 duration estimated, 4 probed, 8 has cover art,
+	 * 16 cover art not stored as is (coverOffset -1, extract it with
+	 * FFmpeg).
+	 *
+	 * @return the number of files read, -1 on failure
+	 */
+	public static native int scanMetadata(String[] paths, String tablePath);
+
+	public static native float getMetadataScanRate();
+
+	public static native int cancelMetadataScan();
 }
@@ -0,0 +1,104 @@
+#include "player.h"
+
+#include <math.h>
+
+// Checks the look-ahead limiter: a -6 dBFS tone with +6 dBFS bursts is
+// run through dynamics_process() in callback-sized chunks, and no output
+// sample may go over the ceiling. Ahead of the first burst the output must
+// be the input delayed by the look-ahead, untouched.
+//
+//   make -C tests check
+
+#define CHUNK_FRAMES 333 // not a multiple of the 32-frame blocks
+#define SECONDS 2
+#define FIRST_BURST 4000
+#define BURST_PERIOD 5000
+#define BURST_FRAMES 300
+#define DYN_BLOCK 32 // of dynamics.cpp
+
+typedef struct LimiterCase {
+	int rate;
+	float ceiling_db;
+	float lookahead_ms;
+} LimiterCase;
+
+// the look-ahead catches peaks from 2 blocks, 1.5 ms
+static const LimiterCase cases[] = {
+	{ 44100, -1, 5 },
+	{ 48000, -1, 5 },
+	{ 44100, -0.3f, 1.5f },
+	{ 48000, -0.3f, 2 },
+	{ 44100, -6, 10 },
+	{ 48000, 0, 10 },
+};
+
+GlobalContext global_context;
+
+static int run_case(const LimiterCase *c) {
+	int frames = c->rate * SECONDS, delay, i, failures = 0;
+	float *in = (float*) malloc(sizeof(float) * 2 * frames);
+	float *out = (float*) malloc(sizeof(float) * 2 * frames);
+	float ceiling = powf(10, c->ceiling_db / 20), peak = 0, silence[2 * 64];
+	double peak_db;
+
+	for (i = 0; i < frames; i++) {
+		float a = i >= FIRST_BURST
+				&& (i - FIRST_BURST) % BURST_PERIOD < BURST_FRAMES ? 2 : 0.5f;
+		in[2 * i] = out[2 * i] = a * sinf(i * 0.05f);
+		in[2 * i + 1] = out[2 * i + 1] = a * cosf(i * 0.031f);
+	}
+
+	global_context.audio_tgt.freq = c->rate;
+	global_context.audio_tgt.channels = 2;
+
+	// a stage enabled again starts over from silence and full gain
+	dynamics_set_limiter(false, c->ceiling_db, c->lookahead_ms);
+	memset(silence, 0, sizeof(silence));
+	dynamics_process(silence, 64);
+	if (dynamics_set_limiter(true, c->ceiling_db, c->lookahead_ms) < 0) {
+		printf("%5d Hz %5.1f dBFS %4.1f ms  rejected\n", c->rate,
+				c->ceiling_db, c->lookahead_ms);
+		return 1;
+	}
+
+	for (i = 0; i < frames; i += CHUNK_FRAMES) {
+		dynamics_process(out + 2 * i, FFMIN(CHUNK_FRAMES, frames - i));
+	}
+
+	for (i = 0; i < 2 * frames; i++) {
+		peak = FFMAX(peak, fabsf(out[i]));
+	}
+	if (peak > ceiling * (1 + 1e-6f)) {
+		failures++;
+	}
+
+	// rounded to blocks as dynamics_update() does
+	delay = (int) lrint(c->lookahead_ms / 1000
+			/ ((double) DYN_BLOCK / c->rate)) * DYN_BLOCK;
+	for (i = 0; i < 2 * FIRST_BURST; i++) {
+		if (out[i] != (i < 2 * delay ? 0 : in[i - 2 * delay])) {
+			failures++;
+			break;
+		}
+	}
+
+	peak_db = 20 * log10(peak);
+	printf("%5d Hz %5.1f dBFS %4.1f ms  %s, peak %.3f dBFS, delay %d\n",
+			c->rate, c->ceiling_db, c->lookahead_ms, failures ? "FAIL" : "ok",
+			peak_db, delay);
+
+	free(in);
+	free(out);
+	return failures;
+}
+
+int main() {
+	unsigned int i;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		failures += run_case(&cases[i]);
+	}
+
+	return failures ? 1 : 0;
+}
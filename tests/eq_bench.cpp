@@ -0,0 +1,60 @@
+#include "player.h"
+
+// CPU of eq_process() with 1 to 10 bands on, per second of 48 kHz stereo
+// output, fed in callback-sized chunks of noise.
+//
+//   make -C tests bench
+
+#define RATE 48000
+#define CHUNK_FRAMES 240 // a 5 ms output buffer
+#define SECONDS 60
+
+GlobalContext global_context;
+
+// CPU of SECONDS of chunks copied from src, through eq_process() if eq
+static int64_t run(const float *src, float *buf, bool eq) {
+	int64_t cpu = get_thread_cpu_time();
+	int64_t pos;
+
+	for (pos = 0; pos < (int64_t) SECONDS * RATE; pos += CHUNK_FRAMES) {
+		memcpy(buf, src + 2 * (pos % RATE), sizeof(float) * 2 * CHUNK_FRAMES);
+		if (eq) {
+			eq_process(buf, CHUNK_FRAMES);
+		}
+	}
+
+	return get_thread_cpu_time() - cpu;
+}
+
+int main() {
+	float *src = (float*) malloc(sizeof(float) * 2 * (RATE + CHUNK_FRAMES));
+	float *buf = (float*) malloc(sizeof(float) * 2 * CHUNK_FRAMES);
+	int64_t copy, cpu;
+	unsigned int seed = 1;
+	int i, n;
+
+	// -20 dBFS white noise, one second looped
+	for (i = 0; i < 2 * (RATE + CHUNK_FRAMES); i++) {
+		seed = seed * 1664525 + 1013904223;
+		src[i] = (float) (0.1 * ((int) seed / 2147483648.0));
+	}
+
+	global_context.audio_tgt.freq = RATE;
+	global_context.audio_tgt.channels = 2;
+
+	copy = run(src, buf, false);
+
+	printf("bands  us/s   us/s per band  own estimate\n");
+	for (n = 1; n <= 10; n++) {
+		eq_set_band(n - 1, 31.25f * (1 << (n - 1)), n & 1 ? 6 : -6, 1.41f);
+
+		cpu = run(src, buf, true) - copy;
+		printf("%5d  %5lld  %13lld  %12lld\n", n,
+				(long long) (cpu / SECONDS), (long long) (cpu / SECONDS / n),
+				(long long) global_context.eq_band_cpu_us);
+	}
+
+	free(src);
+	free(buf);
+	return 0;
+}
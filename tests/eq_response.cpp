@@ -0,0 +1,154 @@
+#include "player.h"
+
+#include <math.h>
+
+// Checks the equalizer against its own analytic curve: sines are filtered
+// by eq_process(), the steady-state gain is fitted on the output, and it
+// must match eq_response_db() at every frequency.
+//
+//   make -C tests check
+
+#define CHUNK_FRAMES 256 // like the output callback, the state spans calls
+#define TOLERANCE_DB 0.01
+
+typedef struct EqSetting {
+	int band;
+	float freq;
+	float gain_db;
+	float q;
+} EqSetting;
+
+typedef struct EqCase {
+	const char *name;
+	int rate;
+	EqSetting settings[10];
+	int nb_settings;
+} EqCase;
+
+static const EqCase cases[] = {
+	{ "flat", 44100, { }, 0 },
+	{ "1 kHz +12 dB", 44100, { { 5, 1000, 12, 1.41f } }, 1 },
+	{ "1 kHz -12 dB", 48000, { { 5, 1000, -12, 1.41f } }, 1 },
+	{ "bass boost", 44100, { { 0, 31.25f, 9, 1.41f }, { 1, 62.5f, 6, 1.41f },
+			{ 2, 125, 3, 1.41f } }, 3 },
+	{ "alternating 6 dB", 48000, { { 0, 31.25f, 6, 1.41f }, { 1, 62.5f, -6,
+			1.41f }, { 2, 125, 6, 1.41f }, { 3, 250, -6, 1.41f }, { 4, 500, 6,
+			1.41f }, { 5, 1000, -6, 1.41f }, { 6, 2000, 6, 1.41f }, { 7, 4000,
+			-6, 1.41f }, { 8, 8000, 6, 1.41f }, { 9, 16000, -6, 1.41f } }, 10 },
+	{ "narrow +24 dB", 44100, { { 3, 250, 24, 10 }, { 8, 8000, 24, 10 } }, 2 },
+	{ "wide -24 dB", 48000, { { 4, 500, -24, 0.1f } }, 1 },
+	{ "16 kHz near nyquist", 32000, { { 9, 16000, 12, 1.41f } }, 1 },
+};
+
+GlobalContext global_context;
+
+// amplitude of the sine at freq in the last n frames of the left channel,
+// a least-squares fit of a sin + b cos so the window needs no whole periods
+static double fit_amplitude(const float *buf, int64_t start, int n,
+		double w) {
+	double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0, det, a, b;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		double s = sin(w * (start + i)), c = cos(w * (start + i));
+		double y = buf[2 * i];
+		ss += s * s;
+		cc += c * c;
+		sc += s * c;
+		ys += y * s;
+		yc += y * c;
+	}
+
+	det = ss * cc - sc * sc;
+	a = (ys * cc - yc * sc) / det;
+	b = (yc * ss - ys * sc) / det;
+
+	return sqrt(a * a + b * b);
+}
+
+// filters 2 seconds of a stereo sine and returns its gain in dB over the
+// second half, -HUGE_VAL if the channels differ
+static double measure_db(int rate, double freq) {
+	int64_t total = 2 * rate, pos;
+	int n = rate, i;
+	double w = 2 * M_PI * freq / rate;
+	float *buf = (float*) malloc(sizeof(float) * 2 * total);
+	double db;
+
+	for (pos = 0; pos < total; pos++) {
+		buf[2 * pos] = buf[2 * pos + 1] = (float) (0.25 * sin(w * pos));
+	}
+
+	for (pos = 0; pos < total; pos += CHUNK_FRAMES) {
+		eq_process(buf + 2 * pos, (int) FFMIN(CHUNK_FRAMES, total - pos));
+	}
+
+	db = 20 * log10(fit_amplitude(buf + 2 * (total - n), total - n, n, w)
+			/ 0.25);
+	for (i = 0; i < n; i++) {
+		if (buf[2 * (total - n + i)] != buf[2 * (total - n + i) + 1]) {
+			db = -HUGE_VAL;
+			break;
+		}
+	}
+
+	free(buf);
+	return db;
+}
+
+static int run_case(const EqCase *c) {
+	double worst = 0, worst_freq = 0;
+	int i, failures = 0;
+
+	for (i = 0; i < 10; i++) {
+		eq_set_band(i, 1000, 0, 1.41f);
+	}
+	for (i = 0; i < c->nb_settings; i++) {
+		const EqSetting *s = &c->settings[i];
+		if (eq_set_band(s->band, s->freq, s->gain_db, s->q) < 0) {
+			printf("%-22s band %d rejected\n", c->name, s->band);
+			return 1;
+		}
+	}
+
+	global_context.audio_tgt.freq = c->rate;
+	global_context.audio_tgt.channels = 2;
+
+	// third octaves from 20 Hz, below nyquist
+	for (i = 0; i < 31; i++) {
+		double freq = 20 * pow(2, i / 3.0);
+		double expected, measured, err;
+
+		if (freq >= c->rate * 0.48) {
+			break;
+		}
+
+		expected = eq_response_db((float) freq);
+		measured = measure_db(c->rate, freq);
+		err = fabs(measured - expected);
+		if (!(err <= TOLERANCE_DB)) {
+			printf("%-22s %8.1f Hz expected %7.3f dB, measured %7.3f dB\n",
+					c->name, freq, expected, measured);
+			failures++;
+		}
+		if (err > worst) {
+			worst = err;
+			worst_freq = freq;
+		}
+	}
+
+	printf("%-22s %s, worst error %.4f dB at %.1f Hz\n", c->name,
+			failures ? "FAIL" : "ok", worst, worst_freq);
+	return failures;
+}
+
+int main() {
+	unsigned int i;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		failures += run_case(&cases[i]);
+	}
+
+	return failures ? 1 : 0;
+}
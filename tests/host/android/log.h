@@ -0,0 +1,35 @@
+#ifndef HOST_ANDROID_LOG_H
+#define HOST_ANDROID_LOG_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+// logcat stand-in for the host checks, warnings and errors go to stderr
+
+enum {
+	ANDROID_LOG_VERBOSE = 2,
+	ANDROID_LOG_DEBUG,
+	ANDROID_LOG_INFO,
+	ANDROID_LOG_WARN,
+	ANDROID_LOG_ERROR,
+};
+
+static inline int __android_log_print(int prio, const char *tag,
+		const char *fmt, ...) {
+	va_list vl;
+	int ret;
+
+	if (prio < ANDROID_LOG_WARN) {
+		return 0;
+	}
+
+	va_start(vl, fmt);
+	fprintf(stderr, "%s : ", tag);
+	ret = vfprintf(stderr, fmt, vl);
+	fputc('\n', stderr);
+	va_end(vl);
+
+	return ret;
+}
+
+#endif
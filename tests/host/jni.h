@@ -0,0 +1 @@
+// player.h includes <jni.h> without using it, the host checks need no JNI
@@ -0,0 +1,258 @@
+#include "player.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Serves a generated file from a local HTTP server with Range support and
+// reads it through http_cache_alloc_avio() the way the demuxer does: a
+// first play, a replay from the saved index, then on a new cache a play
+// that seeks backwards. The bytes must match the file, and the split
+// between cache and network that http_cache_get_stats() reports must be
+// the one each pass implies.
+//
+//   make -C tests http_cache_test FFMPEG_PREFIX=...
+//   tests/http_cache_test
+
+#define FILE_SIZE (4 * 1024 * 1024 + 123)
+#define READ_SIZE 4096
+
+GlobalContext global_context;
+
+static uint8_t *file_data;
+static int server_port;
+static int nb_requests;
+
+// answers one request, a whole or a partial GET of file_data
+static void *serve_connection(void *arg) {
+	int fd = (int) (intptr_t) arg;
+	char req[4096], head[512];
+	const char *range;
+	int64_t start = 0, end = FILE_SIZE - 1;
+	int len = 0, n, partial = 0;
+
+	while (len < (int) sizeof(req) - 1) {
+		n = (int) recv(fd, req + len, sizeof(req) - 1 - len, 0);
+		if (n <= 0) {
+			goto end;
+		}
+		len += n;
+		req[len] = 0;
+		if (strstr(req, "\r\n\r\n")) {
+			break;
+		}
+	}
+	__sync_fetch_and_add(&nb_requests, 1);
+
+	range = strcasestr(req, "\r\nRange: bytes=");
+	if (range) {
+		long long s = 0, e = -1;
+		if (sscanf(range + 15, "%lld-%lld", &s, &e) >= 1) {
+			start = s;
+			end = e >= s ? FFMIN(e, (long long) FILE_SIZE - 1) : FILE_SIZE - 1;
+			partial = 1;
+		}
+	}
+
+	if (start >= FILE_SIZE) {
+		n = snprintf(head, sizeof(head), "HTTP/1.1 416 Range Not Satisfiable\r\n"
+				"Content-Range: bytes */%d\r\nContent-Length: 0\r\n"
+				"Connection: close\r\n\r\n", FILE_SIZE);
+		send(fd, head, n, MSG_NOSIGNAL);
+		goto end;
+	}
+
+	if (partial) {
+		n = snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\n"
+				"Content-Range: bytes %lld-%lld/%d\r\n", (long long) start,
+				(long long) end, FILE_SIZE);
+	} else {
+		n = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\n");
+	}
+	n += snprintf(head + n, sizeof(head) - n, "Content-Type: "
+			"application/octet-stream\r\nAccept-Ranges: bytes\r\n"
+			"Content-Length: %lld\r\nConnection: close\r\n\r\n",
+			(long long) (end - start + 1));
+	if (send(fd, head, n, MSG_NOSIGNAL) != n) {
+		goto end;
+	}
+
+	// the client drops the connection when it seeks away
+	while (start <= end) {
+		n = (int) send(fd, file_data + start,
+				(size_t) FFMIN(64 * 1024, end - start + 1), MSG_NOSIGNAL);
+		if (n <= 0) {
+			break;
+		}
+		start += n;
+	}
+
+end:
+	close(fd);
+	return NULL;
+}
+
+// a thread per connection, an abandoned one may still be blocked sending
+static void *serve(void *arg) {
+	int listen_fd = (int) (intptr_t) arg;
+	pthread_t thread;
+	int fd;
+
+	while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+		if (pthread_create(&thread, NULL, serve_connection,
+				(void*) (intptr_t) fd) == 0) {
+			pthread_detach(thread);
+		} else {
+			close(fd);
+		}
+	}
+
+	return NULL;
+}
+
+static int start_server() {
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	pthread_t thread;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+			|| listen(fd, 16) < 0
+			|| getsockname(fd, (struct sockaddr*) &addr, &addr_len) < 0
+			|| pthread_create(&thread, NULL, serve, (void*) (intptr_t) fd)) {
+		close(fd);
+		return -1;
+	}
+
+	server_port = ntohs(addr.sin_port);
+	return 0;
+}
+
+// reads [from, to) at the position of avio, false if the bytes differ
+static bool read_range(AVIOContext *avio, int64_t from, int64_t to) {
+	uint8_t buf[READ_SIZE];
+	int n;
+
+	if (avio_seek(avio, from, SEEK_SET) != from) {
+		printf("seek to %lld failed\n", (long long) from);
+		return false;
+	}
+
+	while (from < to) {
+		n = avio_read(avio, buf, (int) FFMIN(READ_SIZE, to - from));
+		if (n <= 0 || memcmp(buf, file_data + from, n)) {
+			printf("%s at %lld\n", n <= 0 ? "short read" : "mismatch",
+					(long long) from);
+			return false;
+		}
+		from += n;
+	}
+
+	return true;
+}
+
+// one pass on the cache in cache_dir, reading the ranges in order; the
+// stats must fall in [min, max] for each source
+static int run_pass(const char *name, const char *url, const char *cache_dir,
+		const int64_t (*ranges)[2], int nb_ranges, int64_t min_cache,
+		int64_t max_cache, int64_t min_network, int64_t max_network) {
+	HttpCache *hc = http_cache_open(url, cache_dir);
+	AVIOContext *avio = NULL;
+	int64_t from_cache, from_network, total;
+	int i, ret = 1;
+
+	if (!hc || !(avio = http_cache_alloc_avio(hc))) {
+		printf("%-16s open failed\n", name);
+		goto end;
+	}
+
+	if (!(avio->seekable & AVIO_SEEKABLE_NORMAL)) {
+		printf("%-16s not seekable\n", name);
+		goto end;
+	}
+
+	for (i = 0; i < nb_ranges; i++) {
+		if (!read_range(avio, ranges[i][0], ranges[i][1])) {
+			goto end;
+		}
+	}
+
+	http_cache_get_stats(hc, &from_cache, &from_network);
+	total = from_cache + from_network;
+	ret = from_cache < min_cache || from_cache > max_cache
+			|| from_network < min_network || from_network > max_network;
+
+	printf("%-16s %s, hit ratio %5.1f%%, %8lld bytes saved, %8lld fetched\n",
+			name, ret ? "FAIL" : "ok",
+			total ? from_cache * 100.0 / total : 0.0,
+			(long long) from_cache, (long long) from_network);
+
+end:
+	// as custom_avio_free() does
+	if (avio) {
+		av_freep(&avio->buffer);
+		av_freep(&avio);
+	}
+	http_cache_close(&hc);
+	return ret;
+}
+
+int main() {
+	static const int64_t whole[][2] = { { 0, FILE_SIZE } };
+	// to 3/4, back to 1/4, then to the end
+	static const int64_t rewind[][2] = { { 0, FILE_SIZE / 4 * 3 },
+			{ FILE_SIZE / 4, FILE_SIZE } };
+	char cache_dir[] = "/tmp/http_cache_test.XXXXXX", url[64], cmd[128];
+	unsigned int seed = 1;
+	int i, failures = 0;
+
+	file_data = (uint8_t*) malloc(FILE_SIZE);
+	for (i = 0; i < FILE_SIZE; i++) {
+		seed = seed * 1664525 + 1013904223;
+		file_data[i] = (uint8_t) (seed >> 24);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	avformat_network_init();
+
+	if (start_server() < 0 || !mkdtemp(cache_dir)) {
+		printf("setup failed, %s\n", strerror(errno));
+		return 1;
+	}
+	snprintf(url, sizeof(url), "http://127.0.0.1:%d/test.bin", server_port);
+
+	// the first play fetches everything once and the replay nothing; the
+	// rewind fetches everything once too, and rereads from the cache at
+	// least what it went back over, more with the AVIO read-ahead
+	failures += run_pass("play", url, cache_dir, whole, 1, 0, 0, FILE_SIZE,
+			FILE_SIZE);
+	failures += run_pass("replay", url, cache_dir, whole, 1, FILE_SIZE,
+			FILE_SIZE, 0, 0);
+
+	snprintf(cmd, sizeof(cmd), "rm -f %s/*", cache_dir);
+	if (system(cmd)) {
+		return 1;
+	}
+	failures += run_pass("seek backwards", url, cache_dir, rewind, 2,
+			rewind[0][1] - rewind[1][0], rewind[0][1], FILE_SIZE, FILE_SIZE);
+
+	printf("%d requests served\n", nb_requests);
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", cache_dir);
+	if (system(cmd)) {
+		failures++;
+	}
+
+	free(file_data);
+	return failures ? 1 : 0;
+}
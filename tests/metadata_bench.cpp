@@ -0,0 +1,118 @@
+#include "player.h"
+
+#include <dirent.h>
+
+// Throughput of metadata_scan() on a corpus made by metadata_corpus.sh,
+// against opening each file the way open_media() does, with a full
+// avformat_find_stream_info() on a single thread.
+//
+//   tests/metadata_corpus.sh /tmp/corpus 10000
+//   make -C tests metadata_bench FFMPEG_PREFIX=...
+//   tests/metadata_bench /tmp/corpus
+//
+// Both are run on a warm page cache, after a first untimed scan; drop the
+// caches between runs (echo 3 > /proc/sys/vm/drop_caches) for cold ones.
+
+GlobalContext global_context;
+
+static int compare_paths(const void *a, const void *b) {
+	return strcmp(*(const char**) a, *(const char**) b);
+}
+
+// the regular files of dir, sorted
+static char **list_files(const char *dir, int *nb_paths) {
+	char **paths = NULL, path[1024];
+	struct dirent *de;
+	struct stat st;
+	int n = 0, alloc = 0;
+	DIR *d = opendir(dir);
+
+	if (!d) {
+		return NULL;
+	}
+
+	while ((de = readdir(d))) {
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+			continue;
+		}
+		if (n == alloc) {
+			alloc = FFMAX(1024, alloc * 2);
+			paths = (char**) realloc(paths, alloc * sizeof(char*));
+		}
+		paths[n++] = strdup(path);
+	}
+	closedir(d);
+
+	qsort(paths, n, sizeof(char*), compare_paths);
+	*nb_paths = n;
+	return paths;
+}
+
+// files per second opening every path like open_media()
+static double full_open_rate(char **paths, int nb_paths, int *nb_read) {
+	int64_t t = av_gettime_relative();
+	AVFormatContext *fmt_ctx;
+	int i;
+
+	*nb_read = 0;
+	for (i = 0; i < nb_paths; i++) {
+		fmt_ctx = NULL;
+		if (avformat_open_input(&fmt_ctx, paths[i], NULL, NULL) < 0) {
+			continue;
+		}
+		if (avformat_find_stream_info(fmt_ctx, NULL) >= 0
+				&& find_audio_stream(fmt_ctx) >= 0) {
+			(*nb_read)++;
+		}
+		avformat_close_input(&fmt_ctx);
+	}
+
+	t = av_gettime_relative() - t;
+	return t > 0 ? (double) nb_paths * AV_TIME_BASE / t : 0;
+}
+
+int main(int argc, char **argv) {
+	char table[1024], **paths;
+	double full;
+	int nb_paths = 0, nb_read, i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s corpus_dir [table]\n", argv[0]);
+		return 2;
+	}
+	snprintf(table, sizeof(table), "%s", argc > 2 ? argv[2] :
+			"/tmp/metadata_bench.table");
+
+	av_register_all();
+	av_log_set_level(AV_LOG_ERROR);
+
+	paths = list_files(argv[1], &nb_paths);
+	if (!paths || !nb_paths) {
+		fprintf(stderr, "no files in %s\n", argv[1]);
+		return 1;
+	}
+
+	// fills the page cache, the timed runs only measure the parsing
+	metadata_scan((const char**) paths, nb_paths, table);
+
+	nb_read = metadata_scan((const char**) paths, nb_paths, table);
+	printf("metadata_scan  %d of %d files, %.0f files/s\n", nb_read, nb_paths,
+			global_context.metadata_files_per_sec);
+
+	full = full_open_rate(paths, nb_paths, &nb_read);
+	printf("full open      %d of %d files, %.0f files/s, 1 thread\n", nb_read,
+			nb_paths, full);
+
+	if (full > 0) {
+		printf("speedup        %.1fx\n",
+				global_context.metadata_files_per_sec / full);
+	}
+
+	for (i = 0; i < nb_paths; i++) {
+		free(paths[i]);
+	}
+	free(paths);
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Generates the corpus metadata_bench scans: count files in dir, cycling
+# through the formats of a typical library, each with tags and most with
+# cover art. A short file of each format is encoded once with the ffmpeg
+# command line tool and copied, the scan only reads headers.
+#
+#   tests/metadata_corpus.sh /tmp/corpus 10000
+
+set -e
+
+dir=${1:?usage: $0 dir [count] [seconds]}
+count=${2:-10000}
+seconds=${3:-10}
+
+mkdir -p "$dir/base"
+dir=$(cd "$dir" && pwd)
+cd "$dir/base"
+
+ff() {
+	ffmpeg -v error -y "$@"
+}
+
+tags="-metadata title=Title -metadata artist=Artist -metadata album=Album"
+sine="-f lavfi -i sine=frequency=440:sample_rate=44100:duration=$seconds"
+
+ff -f lavfi -i testsrc=size=500x500 -frames:v 1 cover.jpg
+
+# an encoder missing from the local ffmpeg only drops its format
+ff $sine -i cover.jpg -map 0 -map 1 -ac 2 -c:a libmp3lame -b:a 128k \
+		-c:v copy -id3v2_version 3 $tags base.mp3 || rm -f base.mp3
+ff $sine -i cover.jpg -map 0 -map 1 -ac 2 -c:a flac -c:v copy \
+		-disposition:v attached_pic $tags base.flac || rm -f base.flac
+ff $sine -i cover.jpg -map 0 -map 1 -ac 2 -c:a aac -b:a 128k -c:v copy \
+		-disposition:v attached_pic $tags base.m4a || rm -f base.m4a
+ff $sine -ac 2 -c:a libvorbis $tags base.ogg || rm -f base.ogg
+ff $sine -ac 2 -c:a pcm_s16le $tags base.wav || rm -f base.wav
+ff $sine -ac 2 -c:a aac -b:a 128k -f adts base.aac || rm -f base.aac
+
+set -- base.*
+if [ "$1" = "base.*" ]; then
+	echo "no format could be encoded" >&2
+	exit 1
+fi
+
+cd "$dir"
+i=0
+while [ $i -lt "$count" ]; do
+	for f in "$@"; do
+		[ $i -lt "$count" ] || break
+		cp "base/$f" "$(printf %05d $i).${f#base.}"
+		i=$((i + 1))
+	done
+done
+
+echo "$count files in $dir from: $*"
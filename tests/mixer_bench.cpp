@@ -0,0 +1,88 @@
+#include "player.h"
+
+// CPU of mixer_render() with 1 to 32 voices, per second of 48 kHz stereo
+// output rendered in callback-sized buffers that are then dropped. Each
+// voice plays its own one-second clip of noise and is restarted when it
+// ends; the clip bank is replaced by a table of those clips.
+//
+//   make -C tests bench
+
+#define RATE 48000
+#define CHUNK_FRAMES 240 // a 5 ms output buffer
+#define SECONDS 20
+#define NB_CLIPS 32
+
+GlobalContext global_context;
+
+static ClipBuffer clips[NB_CLIPS];
+
+ClipBuffer *clip_bank_ref(int id) {
+	return id >= 0 && id < NB_CLIPS ? &clips[id] : NULL;
+}
+
+void clip_bank_unref(ClipBuffer *buffer) {
+}
+
+void clip_bank_unload(int id) {
+}
+
+extern "C" void av_log(void *avcl, int level, const char *fmt, ...) {
+}
+
+// CPU of SECONDS of output with nb_voices voices
+static int64_t run(float *buf, int nb_voices) {
+	int64_t cpu = get_thread_cpu_time();
+	int64_t pos;
+	int i;
+
+	for (pos = 0; pos < (int64_t) SECONDS * RATE; pos += CHUNK_FRAMES) {
+		if (pos % RATE == 0) {
+			for (i = 0; i < nb_voices; i++) {
+				mixer_play(i, 0.5f, (float) i / NB_CLIPS * 2 - 1,
+						mixer_get_time());
+			}
+		}
+
+		// the tracks' output the voices are mixed over
+		memset(buf, 0, sizeof(float) * 2 * CHUNK_FRAMES);
+		mixer_render(buf, CHUNK_FRAMES);
+	}
+
+	return get_thread_cpu_time() - cpu;
+}
+
+int main() {
+	float *buf = (float*) malloc(sizeof(float) * 2 * CHUNK_FRAMES);
+	unsigned int seed = 1;
+	int64_t idle, cpu;
+	int i, j, n;
+
+	for (i = 0; i < NB_CLIPS; i++) {
+		clips[i].id = i;
+		clips[i].nb_frames = RATE;
+		clips[i].data = (float*) malloc(sizeof(float) * 2 * RATE);
+		for (j = 0; j < 2 * RATE; j++) {
+			seed = seed * 1664525 + 1013904223;
+			clips[i].data[j] = (float) (0.1 * ((int) seed / 2147483648.0));
+		}
+	}
+
+	global_context.audio_tgt.freq = RATE;
+	global_context.audio_tgt.channels = 2;
+
+	idle = run(buf, 0);
+
+	printf("voices  us/s  us/s per voice  %% of a core\n");
+	for (n = 1; n <= NB_CLIPS; n++) {
+		cpu = run(buf, n) - idle;
+		printf("%6d  %4lld  %14lld  %11.3f\n", n, (long long) (cpu / SECONDS),
+				(long long) (cpu / SECONDS / n),
+				cpu * 100.0 / SECONDS / AV_TIME_BASE);
+	}
+
+	for (i = 0; i < NB_CLIPS; i++) {
+		free(clips[i].data);
+	}
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,225 @@
+#include "player.h"
+
+#include <math.h>
+
+// Checks the convolution reverb against direct convolution: noise is run
+// through reverb_process() in callback-sized chunks at full wet gain, and
+// what it added must be the input convolved in the time domain with the
+// normalized response, one partition late. av_rdft is replaced by a plain
+// DFT in the packed layout of FFmpeg, so everything but the FFT itself is
+// covered without FFmpeg.
+//
+//   make -C tests check
+
+#define RATE 8000
+#define CHUNK_FRAMES 300 // not a divisor of the partition
+#define PARTITION 512 // REVERB_BLOCK, the lag of the wet signal
+#define FRAMES 6000
+#define TOLERANCE 1e-6
+
+typedef struct ReverbCase {
+	const char *name;
+	int channels;
+	int ir_frames;
+} ReverbCase;
+
+static const ReverbCase cases[] = {
+	{ "mono, 1 partition", 1, 300 },
+	{ "stereo, 1 partition", 2, 512 },
+	{ "stereo, 2 partitions", 2, 1024 },
+	{ "stereo, 3 partitions", 2, 1300 },
+	{ "mono, 7 partitions", 1, 3500 },
+};
+
+GlobalContext global_context;
+
+struct RDFTContext {
+	int n;
+	int inverse;
+	double *cos_table;
+	double *sin_table;
+	double *tmp;
+};
+
+extern "C" RDFTContext *av_rdft_init(int nbits, enum RDFTransformType trans) {
+	RDFTContext *s = (RDFTContext*) calloc(1, sizeof(RDFTContext));
+	int i;
+
+	s->n = 1 << nbits;
+	s->inverse = trans == IDFT_C2R;
+	s->cos_table = (double*) malloc(s->n * sizeof(double));
+	s->sin_table = (double*) malloc(s->n * sizeof(double));
+	s->tmp = (double*) malloc(s->n * sizeof(double));
+	for (i = 0; i < s->n; i++) {
+		s->cos_table[i] = cos(2 * M_PI * i / s->n);
+		s->sin_table[i] = sin(2 * M_PI * i / s->n);
+	}
+
+	return s;
+}
+
+// forward: X[0].re, X[n/2].re, then X[k].re, X[k].im with e^-i; inverse:
+// the packed spectrum back to n/2 times the signal, as av_rdft_calc() does
+extern "C" void av_rdft_calc(RDFTContext *s, FFTSample *data) {
+	int n = s->n, i, k;
+
+	for (i = 0; i < n; i++) {
+		s->tmp[i] = 0;
+	}
+
+	if (!s->inverse) {
+		for (k = 0; k <= n / 2; k++) {
+			double re = 0, im = 0;
+			for (i = 0; i < n; i++) {
+				re += data[i] * s->cos_table[(int64_t) k * i % n];
+				im -= data[i] * s->sin_table[(int64_t) k * i % n];
+			}
+			if (k == 0) {
+				s->tmp[0] = re;
+			} else if (k == n / 2) {
+				s->tmp[1] = re;
+			} else {
+				s->tmp[2 * k] = re;
+				s->tmp[2 * k + 1] = im;
+			}
+		}
+	} else {
+		for (i = 0; i < n; i++) {
+			double x = data[0] + (i & 1 ? -data[1] : data[1]);
+			for (k = 1; k < n / 2; k++) {
+				x += 2 * (data[2 * k] * s->cos_table[(int64_t) k * i % n]
+						- data[2 * k + 1] * s->sin_table[(int64_t) k * i % n]);
+			}
+			s->tmp[i] = x / 2;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		data[i] = (FFTSample) s->tmp[i];
+	}
+}
+
+extern "C" void av_rdft_end(RDFTContext *s) {
+	free(s->cos_table);
+	free(s->sin_table);
+	free(s->tmp);
+	free(s);
+}
+
+extern "C" void *av_malloc(size_t size) {
+	return malloc(size);
+}
+
+extern "C" void *av_mallocz(size_t size) {
+	return calloc(1, size);
+}
+
+extern "C" void av_free(void *ptr) {
+	free(ptr);
+}
+
+extern "C" void av_freep(void *arg) {
+	void **ptr = (void**) arg;
+	free(*ptr);
+	*ptr = NULL;
+}
+
+extern "C" void av_log(void *avcl, int level, const char *fmt, ...) {
+}
+
+// the response "decoded" by reverb_load()
+static const float *test_ir;
+static int test_ir_frames;
+
+int clip_decode(const char *url, float **pcm) {
+	int size = test_ir_frames * global_context.audio_tgt.frame_size;
+
+	*pcm = (float*) av_malloc(size);
+	memcpy(*pcm, test_ir, size);
+	return size;
+}
+
+void player_global_init() {
+}
+
+void fix_output_params() {
+}
+
+static int run_case(const ReverbCase *c) {
+	int channels = c->channels, n = c->ir_frames;
+	float *ir = (float*) malloc(sizeof(float) * channels * n);
+	float *in = (float*) malloc(sizeof(float) * channels * FRAMES);
+	float *out = (float*) malloc(sizeof(float) * channels * FRAMES);
+	double energy = 0, scale, worst = 0;
+	unsigned int seed = 1;
+	int i, k, ch, pos, failures = 0;
+
+	// decaying resonances, a different one per channel
+	for (ch = 0; ch < channels; ch++) {
+		double e = 0;
+		for (i = 0; i < n; i++) {
+			double x = sin(i * (0.1 + 0.03 * ch)) * exp(-i / (n / 4.0));
+			ir[i * channels + ch] = (float) x;
+			e += (double) ir[i * channels + ch] * ir[i * channels + ch];
+		}
+		energy = FFMAX(energy, e);
+	}
+	scale = 1 / sqrt(energy);
+
+	for (i = 0; i < channels * FRAMES; i++) {
+		seed = seed * 1664525 + 1013904223;
+		in[i] = out[i] = (float) (0.5 * ((int) seed / 2147483648.0));
+	}
+
+	global_context.audio_tgt.freq = RATE;
+	global_context.audio_tgt.channels = channels;
+	global_context.audio_tgt.frame_size = channels * sizeof(float);
+
+	test_ir = ir;
+	test_ir_frames = n;
+	if (reverb_load("test") < 0) {
+		printf("%-22s load failed\n", c->name);
+		return 1;
+	}
+	reverb_set_gain(1);
+
+	for (pos = 0; pos < FRAMES; pos += CHUNK_FRAMES) {
+		reverb_process(out + pos * channels, FFMIN(CHUNK_FRAMES, FRAMES - pos));
+	}
+
+	for (ch = 0; ch < channels; ch++) {
+		for (i = 0; i < FRAMES; i++) {
+			double wet = 0, err;
+			for (k = 0; k < n && k <= i - PARTITION; k++) {
+				wet += in[(i - PARTITION - k) * channels + ch]
+						* ir[k * channels + ch] * scale;
+			}
+			err = fabs(out[i * channels + ch] - in[i * channels + ch] - wet);
+			if (!(err <= TOLERANCE)) {
+				failures++;
+			}
+			worst = FFMAX(worst, err);
+		}
+	}
+
+	reverb_unload();
+
+	printf("%-22s %s, worst error %.1e\n", c->name, failures ? "FAIL" : "ok",
+			worst);
+
+	free(ir);
+	free(in);
+	free(out);
+	return failures;
+}
+
+int main() {
+	unsigned int i;
+	int failures = 0;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		failures += run_case(&cases[i]);
+	}
+
+	return failures ? 1 : 0;
+}
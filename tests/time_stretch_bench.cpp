@@ -0,0 +1,79 @@
+#include "player.h"
+
+#include <math.h>
+
+// CPU of the WSOLA stage per second of 48 kHz stereo output, at the
+// speeds of the playback rate control, fed the way the output callback
+// does: whatever time_stretch_wants() before each 5 ms read.
+//
+//   make -C tests time_stretch_bench FFMPEG_PREFIX=...
+
+#define RATE 48000
+#define CHUNK_FRAMES 240
+#define MAX_WRITE 4096
+#define SOURCE_SECONDS 10
+#define SECONDS 20
+
+GlobalContext global_context;
+
+// CPU of SECONDS of output at speed, the input looped over src
+static int64_t run(const float *src, double speed) {
+	TimeStretch *ts = time_stretch_alloc(RATE, 2, MAX_WRITE);
+	float buf[2 * CHUNK_FRAMES];
+	int64_t out = 0, in = 0, cpu;
+	int n;
+
+	if (!ts) {
+		return -1;
+	}
+
+	cpu = get_thread_cpu_time();
+	while (out < (int64_t) SECONDS * RATE) {
+		n = time_stretch_read(ts, buf, CHUNK_FRAMES, speed);
+		if (n > 0) {
+			out += n;
+			continue;
+		}
+
+		n = FFMIN(FFMIN(time_stretch_wants(ts), MAX_WRITE),
+				SOURCE_SECONDS * RATE - (int) (in % (SOURCE_SECONDS * RATE)));
+		n = time_stretch_write(ts,
+				src + 2 * (in % (SOURCE_SECONDS * RATE)), FFMAX(n, 1));
+		in += n;
+	}
+	cpu = get_thread_cpu_time() - cpu;
+
+	time_stretch_free(&ts);
+	return cpu;
+}
+
+int main() {
+	static const double speeds[] = { 0.5, 0.75, 1.25, 1.5, 2, 3 };
+	int frames = SOURCE_SECONDS * RATE;
+	float *src = (float*) malloc(sizeof(float) * 2 * frames);
+	unsigned int seed = 1, i;
+	int64_t cpu;
+	int j;
+
+	// a voiced tone with vibrato over a little noise, so the search has
+	// periods to lock on to as with music
+	for (j = 0; j < frames; j++) {
+		double t = (double) j / RATE;
+		double f = 220 * (1 + 0.02 * sin(2 * M_PI * 5 * t));
+		double x = 0.3 * sin(2 * M_PI * f * t) + 0.1 * sin(4 * M_PI * f * t);
+		seed = seed * 1664525 + 1013904223;
+		x += 0.02 * ((int) seed / 2147483648.0);
+		src[2 * j] = src[2 * j + 1] = (float) x;
+	}
+
+	printf("speed  us/s  %% of a core\n");
+	for (i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+		cpu = run(src, speeds[i]);
+		printf("%5.2f  %4lld  %11.2f\n", speeds[i],
+				(long long) (cpu / SECONDS),
+				cpu * 100.0 / SECONDS / AV_TIME_BASE);
+	}
+
+	free(src);
+	return 0;
+}
@@ -0,0 +1,143 @@
+#include "player.h"
+
+#include <math.h>
+#include <unistd.h>
+
+// Wall time of waveform_compute() on long generated WAV files, 44.1 kHz
+// stereo S16, split in 1 to WAVEFORM_MAX_THREADS segments. The cache entry
+// is removed before each run so every overview is decoded; the files are
+// read once untimed first, so the runs are on a warm page cache. They are
+// kept in dir for the next runs, 10 and 30 minutes take 420 MB.
+//
+//   make -C tests waveform_bench FFMPEG_PREFIX=...
+//   tests/waveform_bench [dir] [minutes...]
+//
+// The overviews of a file must be the same whatever the segments.
+
+#define RATE 44100
+#define BUCKETS 1000
+#define MAX_SEGMENTS 8 // WAVEFORM_MAX_THREADS
+#define TOLERANCE 1e-6
+
+GlobalContext global_context;
+
+static void put_le32(uint8_t *p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+// a tone under a slow swell over a little noise, minutes long
+static int write_wav(const char *path, int minutes) {
+	static const uint8_t fmt[16] = { 1, 0, 2, 0, 0x44, 0xac, 0, 0, 0x10, 0xb1,
+			2, 0, 4, 0, 16, 0 };
+	int64_t frames = (int64_t) minutes * 60 * RATE, i;
+	uint32_t data_size = (uint32_t) (frames * 4);
+	unsigned int seed = 1;
+	uint8_t header[44];
+	int16_t buf[2 * 4096];
+	int n = 0;
+	FILE *f = fopen(path, "wb");
+
+	if (!f) {
+		return -1;
+	}
+
+	memcpy(header, "RIFF", 4);
+	put_le32(header + 4, 36 + data_size);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	put_le32(header + 16, 16);
+	memcpy(header + 20, fmt, 16);
+	memcpy(header + 36, "data", 4);
+	put_le32(header + 40, data_size);
+	fwrite(header, 1, sizeof(header), f);
+
+	for (i = 0; i < frames; i++) {
+		double t = (double) i / RATE;
+		double x = (0.5 + 0.4 * sin(2 * M_PI * t / 7)) * sin(2 * M_PI * 440 * t);
+		seed = seed * 1664525 + 1013904223;
+		x += 0.02 * ((int) seed / 2147483648.0);
+		buf[2 * n] = buf[2 * n + 1] = (int16_t) lrint(x * 32767 * 0.9);
+		if (++n == 4096) {
+			fwrite(buf, 4, n, f);
+			n = 0;
+		}
+	}
+	fwrite(buf, 4, n, f);
+
+	return fclose(f) ? -1 : 0;
+}
+
+// the cache entries of the overviews, so the next run decodes again
+static void clear_cache() {
+	char cmd[600];
+
+	snprintf(cmd, sizeof(cmd), "rm -f %s/*.wave", global_context.cache_dir);
+	if (system(cmd)) {
+		fprintf(stderr, "cannot clear %s\n", global_context.cache_dir);
+	}
+}
+
+int main(int argc, char **argv) {
+	static const int default_minutes[] = { 10, 30 };
+	static float out[MAX_SEGMENTS + 1][BUCKETS * 3];
+	const char *dir = argc > 1 ? argv[1] : "/tmp";
+	char path[1024];
+	int nb_files = argc > 2 ? argc - 2 : 2;
+	int i, j, n, minutes, failures = 0;
+	float s_per_hour, one = 0;
+	double diff;
+
+	av_register_all();
+	av_log_set_level(AV_LOG_ERROR);
+
+	snprintf(global_context.cache_dir, sizeof(global_context.cache_dir),
+			"%s/waveform_bench.cache", dir);
+	mkdir(global_context.cache_dir, 0700);
+
+	printf("minutes  segments  s/hour  speedup  max diff\n");
+	for (i = 0; i < nb_files; i++) {
+		minutes = argc > 2 ? atoi(argv[i + 2]) : default_minutes[i];
+		snprintf(path, sizeof(path), "%s/waveform_bench_%d.wav", dir, minutes);
+		if (minutes < 1 || (access(path, R_OK) && write_wav(path, minutes))) {
+			fprintf(stderr, "cannot write %s\n", path);
+			return 1;
+		}
+
+		// fills the page cache
+		global_context.waveform_max_threads = 1;
+		clear_cache();
+		waveform_compute(path, BUCKETS, out[0]);
+
+		// a segment is at least a minute long
+		for (n = 1; n <= FFMIN(MAX_SEGMENTS, minutes); n++) {
+			global_context.waveform_max_threads = n;
+			clear_cache();
+			if (waveform_compute(path, BUCKETS, out[n]) < 0) {
+				printf("%7d  %8d  failed\n", minutes, n);
+				failures++;
+				continue;
+			}
+			s_per_hour = global_context.waveform_s_per_hour;
+			if (n == 1) {
+				one = s_per_hour;
+			}
+
+			diff = 0;
+			for (j = 0; j < BUCKETS * 3; j++) {
+				diff = FFMAX(diff, fabs(out[n][j] - out[1][j]));
+			}
+			if (diff > TOLERANCE) {
+				failures++;
+			}
+
+			printf("%7d  %8d  %6.2f  %6.2fx  %8.1e\n", minutes, n, s_per_hour,
+					s_per_hour > 0 ? one / s_per_hour : 0, diff);
+		}
+	}
+
+	clear_cache();
+	rmdir(global_context.cache_dir);
+	return failures ? 1 : 0;
+}